@@ -913,6 +913,14 @@ static void page_flip_handler(int fd, unsigned seq,
 	}
 
 	if (drm->session->active) {
+		// DRM timestamps use CLOCK_MONOTONIC
+		struct timespec present = {
+			.tv_sec = tv_sec,
+			.tv_nsec = tv_usec * 1000,
+		};
+		wlr_output_send_present(&conn->output, &present, seq,
+			WLR_OUTPUT_PRESENT_VSYNC | WLR_OUTPUT_PRESENT_HW_CLOCK |
+			WLR_OUTPUT_PRESENT_HW_COMPLETION);
 		wlr_output_send_frame(&conn->output);
 	}
 }
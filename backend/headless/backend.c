@@ -1,9 +1,12 @@
 #include "util/signal.h"
+#include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wlr/interfaces/wlr_input_device.h>
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/render/egl.h>
 #include <wlr/render/gles2.h>
+#include <wlr/render/pixman.h>
 #include <wlr/util/log.h>
 #include "backend/headless.h"
 #include "glapi.h"
@@ -15,7 +18,7 @@ static bool backend_start(struct wlr_backend *wlr_backend) {
 
 	struct wlr_headless_output *output;
 	wl_list_for_each(output, &backend->outputs, link) {
-		wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+		headless_output_start_frames(output);
 		wlr_output_update_enabled(&output->wlr_output, true);
 		wlr_signal_emit_safe(&backend->backend.events.new_output,
 			&output->wlr_output);
@@ -54,7 +57,11 @@ static void backend_destroy(struct wlr_backend *wlr_backend) {
 
 	wlr_signal_emit_safe(&wlr_backend->events.destroy, backend);
 
-	wlr_egl_finish(&backend->egl);
+	if (backend->software) {
+		wlr_renderer_destroy(backend->renderer);
+	} else {
+		wlr_egl_finish(&backend->egl);
+	}
 	free(backend);
 }
 
@@ -77,9 +84,8 @@ static void handle_display_destroy(struct wl_listener *listener, void *data) {
 	backend_destroy(&backend->backend);
 }
 
-struct wlr_backend *wlr_headless_backend_create(struct wl_display *display) {
-	wlr_log(L_INFO, "Creating headless backend");
-
+static struct wlr_headless_backend *headless_backend_create(
+		struct wl_display *display) {
 	struct wlr_headless_backend *backend =
 		calloc(1, sizeof(struct wlr_headless_backend));
 	if (!backend) {
@@ -91,6 +97,49 @@ struct wlr_backend *wlr_headless_backend_create(struct wl_display *display) {
 	wl_list_init(&backend->outputs);
 	wl_list_init(&backend->input_devices);
 
+	const char *unthrottled = getenv("WLR_HEADLESS_UNTHROTTLED");
+	if (unthrottled != NULL && strcmp(unthrottled, "1") == 0) {
+		wlr_log(L_INFO, "WLR_HEADLESS_UNTHROTTLED set, not throttling frames");
+		backend->unthrottled = true;
+	}
+	return backend;
+}
+
+static void headless_backend_add_display(struct wlr_headless_backend *backend) {
+	backend->display_destroy.notify = handle_display_destroy;
+	wl_display_add_destroy_listener(backend->display,
+		&backend->display_destroy);
+}
+
+struct wlr_backend *wlr_headless_backend_create_software(
+		struct wl_display *display) {
+	wlr_log(L_INFO, "Creating software headless backend");
+
+	struct wlr_headless_backend *backend = headless_backend_create(display);
+	if (!backend) {
+		return NULL;
+	}
+	backend->software = true;
+
+	backend->renderer = wlr_pixman_renderer_create();
+	if (backend->renderer == NULL) {
+		wlr_log(L_ERROR, "Failed to create renderer");
+		free(backend);
+		return NULL;
+	}
+
+	headless_backend_add_display(backend);
+	return &backend->backend;
+}
+
+struct wlr_backend *wlr_headless_backend_create(struct wl_display *display) {
+	wlr_log(L_INFO, "Creating headless backend");
+
+	struct wlr_headless_backend *backend = headless_backend_create(display);
+	if (!backend) {
+		return NULL;
+	}
+
 	static const EGLint config_attribs[] = {
 		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
 		EGL_ALPHA_SIZE, 0,
@@ -104,7 +153,16 @@ struct wlr_backend *wlr_headless_backend_create(struct wl_display *display) {
 		(EGLint *)config_attribs, 0);
 	if (!ok) {
 		free(backend);
-		return NULL;
+		wlr_log(L_INFO, "EGL unavailable, falling back to software rendering");
+		return wlr_headless_backend_create_software(display);
+	}
+	// Outputs render into FBOs without any EGL surface bound
+	if (!backend->egl.egl_exts.surfaceless_context) {
+		wlr_egl_finish(&backend->egl);
+		free(backend);
+		wlr_log(L_INFO, "EGL_KHR_surfaceless_context not supported, "
+			"falling back to software rendering");
+		return wlr_headless_backend_create_software(display);
 	}
 
 	backend->renderer = wlr_gles2_renderer_create(&backend->egl);
@@ -112,12 +170,28 @@ struct wlr_backend *wlr_headless_backend_create(struct wl_display *display) {
 		wlr_log(L_ERROR, "Failed to create renderer");
 	}
 
-	backend->display_destroy.notify = handle_display_destroy;
-	wl_display_add_destroy_listener(display, &backend->display_destroy);
-
+	headless_backend_add_display(backend);
 	return &backend->backend;
 }
 
 bool wlr_backend_is_headless(struct wlr_backend *backend) {
 	return backend->impl == &backend_impl;
 }
+
+void wlr_headless_backend_set_unthrottled(struct wlr_backend *wlr_backend,
+		bool unthrottled) {
+	assert(wlr_backend_is_headless(wlr_backend));
+	struct wlr_headless_backend *backend =
+		(struct wlr_headless_backend *)wlr_backend;
+	if (backend->unthrottled == unthrottled) {
+		return;
+	}
+	backend->unthrottled = unthrottled;
+
+	if (backend->started) {
+		struct wlr_headless_output *output;
+		wl_list_for_each(output, &backend->outputs, link) {
+			headless_output_start_frames(output);
+		}
+	}
+}
@@ -1,48 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <assert.h>
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
 #include <wlr/interfaces/wlr_output.h>
+#include <wlr/render/gles2.h>
+#include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/util/log.h>
 #include "backend/headless.h"
 #include "util/signal.h"
 
-static EGLSurface egl_create_surface(struct wlr_egl *egl, unsigned int width,
+static void buffer_finish(struct wlr_headless_backend *backend,
+		struct wlr_headless_buffer *buffer) {
+	if (buffer->image != NULL) {
+		pixman_image_unref(buffer->image);
+	}
+	if (buffer->fbo != 0 || buffer->texture != 0) {
+		wlr_egl_make_current(&backend->egl, EGL_NO_SURFACE, NULL);
+		glDeleteFramebuffers(1, &buffer->fbo);
+		glDeleteTextures(1, &buffer->texture);
+	}
+	memset(buffer, 0, sizeof(*buffer));
+}
+
+static bool buffer_init(struct wlr_headless_backend *backend,
+		struct wlr_headless_buffer *buffer, unsigned int width,
 		unsigned int height) {
-	EGLint attribs[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+	if (backend->software) {
+		buffer->image = pixman_image_create_bits(PIXMAN_x8r8g8b8, width,
+			height, NULL, 0);
+		if (buffer->image == NULL) {
+			wlr_log(L_ERROR, "Failed to create pixman image");
+			return false;
+		}
+		return true;
+	}
+
+	// There is no window system, render into FBOs with a surfaceless context
+	if (!wlr_egl_make_current(&backend->egl, EGL_NO_SURFACE, NULL)) {
+		return false;
+	}
+
+	glGenTextures(1, &buffer->texture);
+	glBindTexture(GL_TEXTURE_2D, buffer->texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+		GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
 
-	EGLSurface surf = eglCreatePbufferSurface(egl->display, egl->config, attribs);
-	if (surf == EGL_NO_SURFACE) {
-		wlr_log(L_ERROR, "Failed to create EGL surface");
-		return EGL_NO_SURFACE;
+	glGenFramebuffers(1, &buffer->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, buffer->fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, buffer->texture, 0);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		wlr_log(L_ERROR, "Failed to create FBO: incomplete framebuffer "
+			"(0x%x)", status);
+		return false;
 	}
-	return surf;
+	return true;
+}
+
+/**
+ * (Re)creates the buffers the output renders into.
+ */
+static bool output_create_buffers(struct wlr_headless_output *output,
+		unsigned int width, unsigned int height, size_t n_buffers) {
+	struct wlr_headless_backend *backend = output->backend;
+
+	if (backend->software) {
+		wlr_pixman_renderer_bind_image(backend->renderer, NULL);
+	}
+	for (size_t i = 0; i < output->n_buffers; ++i) {
+		buffer_finish(backend, &output->buffers[i]);
+	}
+	output->n_buffers = 0;
+	output->back = output->front = NULL;
+
+	bool ok = true;
+	for (size_t i = 0; i < n_buffers; ++i) {
+		if (!buffer_init(backend, &output->buffers[i], width, height)) {
+			buffer_finish(backend, &output->buffers[i]);
+			for (size_t j = 0; j < i; ++j) {
+				buffer_finish(backend, &output->buffers[j]);
+			}
+			ok = false;
+			break;
+		}
+	}
+
+	// The GL calls above went behind the renderer's back
+	if (!backend->software && backend->renderer != NULL &&
+			wlr_egl_make_current(&backend->egl, EGL_NO_SURFACE, NULL)) {
+		wlr_gles2_renderer_reset_state(backend->renderer);
+	}
+	if (!ok) {
+		return false;
+	}
+
+	output->n_buffers = n_buffers;
+	output->back = &output->buffers[0];
+	return true;
+}
+
+static bool buffer_bind(struct wlr_headless_backend *backend,
+		struct wlr_headless_buffer *buffer) {
+	if (backend->software) {
+		wlr_pixman_renderer_bind_image(backend->renderer, buffer->image);
+		return true;
+	}
+
+	if (!wlr_egl_make_current(&backend->egl, EGL_NO_SURFACE, NULL)) {
+		return false;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, buffer->fbo);
+	return true;
 }
 
 static bool output_set_custom_mode(struct wlr_output *wlr_output, int32_t width,
 		int32_t height, int32_t refresh) {
 	struct wlr_headless_output *output =
 		(struct wlr_headless_output *)wlr_output;
-	struct wlr_headless_backend *backend = output->backend;
 
 	if (refresh <= 0) {
 		refresh = HEADLESS_DEFAULT_REFRESH;
 	}
 
-	if (output->egl_surface) {
-		eglDestroySurface(backend->egl.display, output->egl_surface);
-	}
-
-	output->egl_surface = egl_create_surface(&backend->egl, width, height);
-	if (output->egl_surface == EGL_NO_SURFACE) {
-		wlr_log(L_ERROR, "Failed to recreate EGL surface");
+	if (!output_create_buffers(output, width, height, output->n_buffers)) {
+		wlr_log(L_ERROR, "Failed to recreate output buffers");
 		wlr_output_destroy(wlr_output);
 		return false;
 	}
 
-	output->frame_delay = 1000000 / refresh;
+	output->refresh_ns = 1000000000000 / refresh;
 
 	wlr_output_update_custom_mode(&output->wlr_output, width, height, refresh);
+
+	if (output->vblank_source != NULL && output->backend->started) {
+		headless_output_start_frames(output);
+	}
 	return true;
 }
 
@@ -56,13 +162,48 @@ static void output_transform(struct wlr_output *wlr_output,
 static bool output_make_current(struct wlr_output *wlr_output, int *buffer_age) {
 	struct wlr_headless_output *output =
 		(struct wlr_headless_output *)wlr_output;
-	return wlr_egl_make_current(&output->backend->egl, output->egl_surface,
-		buffer_age);
+	struct wlr_headless_backend *backend = output->backend;
+
+	if (!buffer_bind(backend, output->back)) {
+		return false;
+	}
+	if (buffer_age != NULL) {
+		*buffer_age = output->back->age;
+	}
+	return true;
 }
 
+static void output_schedule_idle_frame(struct wlr_headless_output *output);
+
 static bool output_swap_buffers(struct wlr_output *wlr_output,
 		pixman_region32_t *damage) {
-	return true; // No-op
+	struct wlr_headless_output *output =
+		(struct wlr_headless_output *)wlr_output;
+	struct wlr_headless_backend *backend = output->backend;
+
+	if (backend->software) {
+		// Software cursors are drawn after wlr_renderer_end
+		wlr_pixman_renderer_flush(backend->renderer);
+	} else {
+		// Nothing consumes the buffer, but make sure rendering has been
+		// submitted like a real swap would
+		glFlush();
+	}
+
+	for (size_t i = 0; i < output->n_buffers; ++i) {
+		if (output->buffers[i].age > 0) {
+			output->buffers[i].age++;
+		}
+	}
+	output->back->age = 1;
+	output->front = output->back;
+	size_t back = output->back - output->buffers;
+	output->back = &output->buffers[(back + 1) % output->n_buffers];
+
+	if (backend->unthrottled) {
+		output_schedule_idle_frame(output);
+	}
+	return true;
 }
 
 static void output_destroy(struct wlr_output *wlr_output) {
@@ -71,9 +212,22 @@ static void output_destroy(struct wlr_output *wlr_output) {
 
 	wl_list_remove(&output->link);
 
-	wl_event_source_remove(output->frame_timer);
+	if (output->idle_frame != NULL) {
+		wl_event_source_remove(output->idle_frame);
+	}
+	if (output->vblank_source != NULL) {
+		wl_event_source_remove(output->vblank_source);
+	}
+	if (output->vblank_fd >= 0) {
+		close(output->vblank_fd);
+	}
 
-	eglDestroySurface(output->backend->egl.display, output->egl_surface);
+	if (output->backend->software) {
+		wlr_pixman_renderer_bind_image(output->backend->renderer, NULL);
+	}
+	for (size_t i = 0; i < output->n_buffers; ++i) {
+		buffer_finish(output->backend, &output->buffers[i]);
+	}
 	free(output);
 }
 
@@ -89,13 +243,117 @@ bool wlr_output_is_headless(struct wlr_output *wlr_output) {
 	return wlr_output->impl == &output_impl;
 }
 
-static int signal_frame(void *data) {
+bool wlr_headless_output_set_buffer_count(struct wlr_output *wlr_output,
+		size_t n_buffers) {
+	assert(wlr_output_is_headless(wlr_output));
+	struct wlr_headless_output *output =
+		(struct wlr_headless_output *)wlr_output;
+
+	if (n_buffers < 1 || n_buffers > HEADLESS_MAX_BUFFERS) {
+		wlr_log(L_ERROR, "Invalid headless buffer count: %zu", n_buffers);
+		return false;
+	}
+	if (n_buffers == output->n_buffers) {
+		return true;
+	}
+
+	if (!output_create_buffers(output, wlr_output->width, wlr_output->height,
+			n_buffers)) {
+		wlr_log(L_ERROR, "Failed to recreate output buffers");
+		return false;
+	}
+	// The compositor has to redraw everything
+	wlr_output_update_needs_swap(wlr_output);
+	return true;
+}
+
+bool wlr_headless_output_bind_front_buffer(struct wlr_output *wlr_output) {
+	assert(wlr_output_is_headless(wlr_output));
+	struct wlr_headless_output *output =
+		(struct wlr_headless_output *)wlr_output;
+	if (output->front == NULL) {
+		return false;
+	}
+	return buffer_bind(output->backend, output->front);
+}
+
+static int64_t timespec_to_nsec(const struct timespec *a) {
+	return (int64_t)a->tv_sec * 1000000000 + a->tv_nsec;
+}
+
+static void timespec_from_nsec(struct timespec *r, int64_t nsec) {
+	r->tv_sec = nsec / 1000000000;
+	r->tv_nsec = nsec % 1000000000;
+}
+
+static void output_handle_idle_frame(void *data) {
 	struct wlr_headless_output *output = data;
+	output->idle_frame = NULL;
+	if (!output->backend->unthrottled) {
+		return;
+	}
+	output->vblank_seq++;
+	wlr_output_send_present(&output->wlr_output, NULL, output->vblank_seq, 0);
+	wlr_output_send_frame(&output->wlr_output);
+}
+
+static void output_schedule_idle_frame(struct wlr_headless_output *output) {
+	if (output->idle_frame != NULL) {
+		return;
+	}
+	struct wl_event_loop *ev =
+		wl_display_get_event_loop(output->backend->display);
+	output->idle_frame =
+		wl_event_loop_add_idle(ev, output_handle_idle_frame, output);
+}
+
+static int output_handle_vblank(int fd, uint32_t mask, void *data) {
+	struct wlr_headless_output *output = data;
+
+	uint64_t expirations;
+	ssize_t n = read(fd, &expirations, sizeof(expirations));
+	if (n != sizeof(expirations)) {
+		if (n < 0 && errno != EAGAIN) {
+			wlr_log_errno(L_ERROR, "Failed to read vblank timer");
+		}
+		return 0;
+	}
+
+	// Vblanks missed because the event loop was busy are skipped, like a
+	// real output would
+	output->vblank_seq += expirations;
+	struct timespec when;
+	timespec_from_nsec(&when, timespec_to_nsec(&output->vblank_base) +
+		(int64_t)output->vblank_seq * output->refresh_ns);
+
+	wlr_output_send_present(&output->wlr_output, &when, output->vblank_seq,
+		WLR_OUTPUT_PRESENT_VSYNC);
 	wlr_output_send_frame(&output->wlr_output);
-	wl_event_source_timer_update(output->frame_timer, output->frame_delay);
 	return 0;
 }
 
+void headless_output_start_frames(struct wlr_headless_output *output) {
+	struct itimerspec spec = {0};
+
+	if (output->backend->unthrottled) {
+		// Disarm the vblank timer, frames are signalled on swap
+		timerfd_settime(output->vblank_fd, 0, &spec, NULL);
+		output_schedule_idle_frame(output);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &output->vblank_base);
+	output->vblank_seq = 0;
+
+	timespec_from_nsec(&spec.it_interval, output->refresh_ns);
+	timespec_from_nsec(&spec.it_value,
+		timespec_to_nsec(&output->vblank_base) + output->refresh_ns);
+	if (timerfd_settime(output->vblank_fd, TFD_TIMER_ABSTIME, &spec,
+			NULL) != 0) {
+		wlr_log_errno(L_ERROR, "Failed to arm vblank timer");
+	}
+}
+
 struct wlr_output *wlr_headless_add_output(struct wlr_backend *wlr_backend,
 		unsigned int width, unsigned int height) {
 	struct wlr_headless_backend *backend =
@@ -108,24 +366,28 @@ struct wlr_output *wlr_headless_add_output(struct wlr_backend *wlr_backend,
 		return NULL;
 	}
 	output->backend = backend;
+	output->vblank_fd = -1;
 	wlr_output_init(&output->wlr_output, &backend->backend, &output_impl,
 		backend->display);
 	struct wlr_output *wlr_output = &output->wlr_output;
 
-	output->egl_surface = egl_create_surface(&backend->egl, width, height);
-	if (output->egl_surface == EGL_NO_SURFACE) {
-		wlr_log(L_ERROR, "Failed to create EGL surface");
+	if (!output_create_buffers(output, width, height,
+			HEADLESS_DEFAULT_BUFFERS)) {
+		wlr_log(L_ERROR, "Failed to create output buffers");
 		goto error;
 	}
 
-	output_set_custom_mode(wlr_output, width, height, 0);
+	// The buffers are already allocated, don't go through
+	// output_set_custom_mode which would reallocate them
+	output->refresh_ns = 1000000000000 / HEADLESS_DEFAULT_REFRESH;
+	wlr_output_update_custom_mode(wlr_output, width, height,
+		HEADLESS_DEFAULT_REFRESH);
 	strncpy(wlr_output->make, "headless", sizeof(wlr_output->make));
 	strncpy(wlr_output->model, "headless", sizeof(wlr_output->model));
 	snprintf(wlr_output->name, sizeof(wlr_output->name), "HEADLESS-%d",
 		wl_list_length(&backend->outputs) + 1);
 
-	if (!wlr_egl_make_current(&output->backend->egl, output->egl_surface,
-			NULL)) {
+	if (!output_make_current(wlr_output, NULL)) {
 		goto error;
 	}
 
@@ -133,13 +395,24 @@ struct wlr_output *wlr_headless_add_output(struct wlr_backend *wlr_backend,
 	wlr_renderer_clear(backend->renderer, (float[]){ 1.0, 1.0, 1.0, 1.0 });
 	wlr_renderer_end(backend->renderer);
 
+	output->vblank_fd = timerfd_create(CLOCK_MONOTONIC,
+		TFD_CLOEXEC | TFD_NONBLOCK);
+	if (output->vblank_fd < 0) {
+		wlr_log_errno(L_ERROR, "Failed to create vblank timer");
+		goto error;
+	}
 	struct wl_event_loop *ev = wl_display_get_event_loop(backend->display);
-	output->frame_timer = wl_event_loop_add_timer(ev, signal_frame, output);
+	output->vblank_source = wl_event_loop_add_fd(ev, output->vblank_fd,
+		WL_EVENT_READABLE, output_handle_vblank, output);
+	if (output->vblank_source == NULL) {
+		wlr_log(L_ERROR, "Failed to add vblank timer to event loop");
+		goto error;
+	}
 
 	wl_list_insert(&backend->outputs, &output->link);
 
 	if (backend->started) {
-		wl_event_source_timer_update(output->frame_timer, output->frame_delay);
+		headless_output_start_frames(output);
 		wlr_output_update_enabled(wlr_output, true);
 		wlr_signal_emit_safe(&backend->backend.events.new_output, wlr_output);
 	}
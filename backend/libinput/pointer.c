@@ -37,6 +37,7 @@ void handle_pointer_motion(struct libinput_event *event,
 	wlr_event.delta_x = libinput_event_pointer_get_dx(pevent);
 	wlr_event.delta_y = libinput_event_pointer_get_dy(pevent);
 	wlr_signal_emit_safe(&wlr_dev->pointer->events.motion, &wlr_event);
+	wlr_signal_emit_safe(&wlr_dev->pointer->events.frame, wlr_dev->pointer);
 }
 
 void handle_pointer_motion_abs(struct libinput_event *event,
@@ -56,6 +57,7 @@ void handle_pointer_motion_abs(struct libinput_event *event,
 	wlr_event.x = libinput_event_pointer_get_absolute_x_transformed(pevent, 1);
 	wlr_event.y = libinput_event_pointer_get_absolute_y_transformed(pevent, 1);
 	wlr_signal_emit_safe(&wlr_dev->pointer->events.motion_absolute, &wlr_event);
+	wlr_signal_emit_safe(&wlr_dev->pointer->events.frame, wlr_dev->pointer);
 }
 
 void handle_pointer_button(struct libinput_event *event,
@@ -82,6 +84,7 @@ void handle_pointer_button(struct libinput_event *event,
 		break;
 	}
 	wlr_signal_emit_safe(&wlr_dev->pointer->events.button, &wlr_event);
+	wlr_signal_emit_safe(&wlr_dev->pointer->events.frame, wlr_dev->pointer);
 }
 
 void handle_pointer_axis(struct libinput_event *event,
@@ -131,4 +134,6 @@ void handle_pointer_axis(struct libinput_event *event,
 			wlr_signal_emit_safe(&wlr_dev->pointer->events.axis, &wlr_event);
 		}
 	}
+	// Both axes are part of the same frame
+	wlr_signal_emit_safe(&wlr_dev->pointer->events.frame, wlr_dev->pointer);
 }
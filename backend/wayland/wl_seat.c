@@ -47,6 +47,17 @@ static void pointer_handle_leave(void *data, struct wl_pointer *wl_pointer,
 	}
 }
 
+/**
+ * Before version 5, the parent compositor doesn't send frame events: every
+ * event is a frame of its own.
+ */
+static void pointer_emit_legacy_frame(struct wlr_input_device *dev,
+		struct wl_pointer *wl_pointer) {
+	if (wl_pointer_get_version(wl_pointer) < WL_POINTER_FRAME_SINCE_VERSION) {
+		wlr_signal_emit_safe(&dev->pointer->events.frame, dev->pointer);
+	}
+}
+
 static void pointer_handle_motion(void *data, struct wl_pointer *wl_pointer,
 		uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y) {
 	struct wlr_input_device *dev = data;
@@ -84,6 +95,7 @@ static void pointer_handle_motion(void *data, struct wl_pointer *wl_pointer,
 	};
 
 	wlr_signal_emit_safe(&dev->pointer->events.motion_absolute, &wlr_event);
+	pointer_emit_legacy_frame(dev, wl_pointer);
 }
 
 static void pointer_handle_button(void *data, struct wl_pointer *wl_pointer,
@@ -97,6 +109,7 @@ static void pointer_handle_button(void *data, struct wl_pointer *wl_pointer,
 	wlr_event.state = state;
 	wlr_event.time_msec = time;
 	wlr_signal_emit_safe(&dev->pointer->events.button, &wlr_event);
+	pointer_emit_legacy_frame(dev, wl_pointer);
 }
 
 static void pointer_handle_axis(void *data, struct wl_pointer *wl_pointer,
@@ -112,10 +125,13 @@ static void pointer_handle_axis(void *data, struct wl_pointer *wl_pointer,
 	wlr_event.time_msec = time;
 	wlr_event.source = wlr_wl_pointer->axis_source;
 	wlr_signal_emit_safe(&dev->pointer->events.axis, &wlr_event);
+	pointer_emit_legacy_frame(dev, wl_pointer);
 }
 
 static void pointer_handle_frame(void *data, struct wl_pointer *wl_pointer) {
-
+	struct wlr_input_device *dev = data;
+	assert(dev && dev->pointer);
+	wlr_signal_emit_safe(&dev->pointer->events.frame, dev->pointer);
 }
 
 static void pointer_handle_axis_source(void *data, struct wl_pointer *wl_pointer,
@@ -52,6 +52,7 @@ static void x11_handle_pointer_position(struct wlr_x11_output *output,
 		.y = box.y / (double)layout_box.height + oy,
 	};
 	wlr_signal_emit_safe(&x11->pointer.events.motion_absolute, &wlr_event);
+	wlr_signal_emit_safe(&x11->pointer.events.frame, &x11->pointer);
 
 	x11->time = time;
 }
@@ -89,6 +90,7 @@ bool x11_handle_input_event(struct wlr_x11_backend *x11,
 				.delta = delta,
 			};
 			wlr_signal_emit_safe(&x11->pointer.events.axis, &axis);
+			wlr_signal_emit_safe(&x11->pointer.events.frame, &x11->pointer);
 			x11->time = ev->time;
 			break;
 		}
@@ -108,6 +110,7 @@ bool x11_handle_input_event(struct wlr_x11_backend *x11,
 			};
 
 			wlr_signal_emit_safe(&x11->pointer.events.button, &button);
+			wlr_signal_emit_safe(&x11->pointer.events.frame, &x11->pointer);
 		}
 		x11->time = ev->time;
 		return true;
@@ -7,6 +7,7 @@
 
 static int signal_frame(void *data) {
 	struct wlr_x11_output *output = data;
+	wlr_output_send_present(&output->wlr_output, NULL, 0, 0);
 	wlr_output_send_frame(&output->wlr_output);
 	wl_event_source_timer_update(output->frame_timer, output->frame_delay);
 	return 0;
@@ -0,0 +1,162 @@
+#ifndef BENCH_BENCH_H
+#define BENCH_BENCH_H
+
+#include <pixman.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <wayland-server.h>
+#include <wlr/backend.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_damage.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_surface.h>
+
+enum bench_damage {
+	BENCH_DAMAGE_FULL, // clients repaint their whole buffers
+	BENCH_DAMAGE_PARTIAL, // clients repaint a small moving box
+};
+
+/**
+ * A step of the benchmark scenario. Clients switch to the phase's damage
+ * pattern and commit rate when it starts.
+ */
+struct bench_phase {
+	char name[64];
+	enum bench_damage damage;
+	int rate; // commits per second, 0 to commit on frame callbacks
+	int duration; // ms
+	bool measure; // false for the warm-up phase
+};
+
+struct bench_samples {
+	struct wl_array values; // int64_t
+	bool sorted;
+};
+
+struct bench_stats {
+	struct timespec start, end;
+	size_t frames, commits, dropped_commits;
+	size_t full_repaints;
+	struct bench_samples frame_times; // compositor thread CPU time, ns
+	struct bench_samples render_times; // renderer CPU time, ns
+	struct bench_samples latencies; // from commit to present, ns
+};
+
+struct bench_config {
+	int outputs;
+	int output_width, output_height;
+	int windows;
+	int subsurfaces; // per window
+	int window_width, window_height;
+	int buffers; // per output
+	bool software;
+	bool unthrottled;
+	int warmup; // ms
+};
+
+struct bench_state {
+	struct bench_config config;
+
+	struct wl_display *display;
+	struct wl_event_loop *event_loop;
+	struct wlr_backend *backend;
+	struct wlr_renderer *renderer;
+	struct wlr_compositor *compositor;
+	struct wlr_output_layout *layout;
+
+	struct wl_list outputs; // bench_output::link
+	struct wl_list surfaces; // bench_surface::link
+	struct wl_list windows; // bench_surface::window_link, bottom to top
+	struct wl_list clients; // bench_client::link
+	size_t placed_windows;
+
+	struct bench_phase *phases;
+	struct bench_stats *stats; // one per phase
+	size_t phases_len, phase_idx;
+	struct wl_event_source *phase_timer;
+	bool failed;
+
+	struct wl_listener new_output;
+	struct wl_listener new_surface;
+};
+
+struct bench_output {
+	struct bench_state *bench;
+	struct wlr_output *wlr_output;
+	struct wlr_output_damage *damage;
+	struct wl_list link; // bench_state::outputs
+
+	// Commit times of the surfaces sampled by the frame being rendered, and
+	// of the frame waiting to be presented
+	struct wl_array sampled, swapped; // struct timespec
+
+	struct wl_listener frame;
+	struct wl_listener present;
+	struct wl_listener destroy;
+};
+
+struct bench_surface {
+	struct bench_state *bench;
+	struct wlr_surface *wlr_surface;
+	struct wl_list link; // bench_state::surfaces
+
+	// Root surfaces are laid out as windows when they first get a buffer
+	bool placed;
+	int x, y; // layout coordinates
+	struct wlr_output *output; // frame done events are sent by this output
+	struct wl_list window_link; // bench_state::windows
+
+	// Set on commit, until the new content is sampled by an output
+	bool commit_pending;
+	struct timespec commit_time;
+
+	struct wl_listener commit;
+	struct wl_listener destroy;
+};
+
+struct bench_client;
+
+int64_t bench_timespec_to_nsec(const struct timespec *t);
+/**
+ * Returns the stats of the current phase, or NULL if the current phase isn't
+ * measured.
+ */
+struct bench_stats *bench_current_stats(struct bench_state *bench);
+struct bench_phase *bench_current_phase(struct bench_state *bench);
+void bench_fail(struct bench_state *bench);
+
+void bench_server_init(struct bench_state *bench);
+void bench_server_finish(struct bench_state *bench);
+
+/**
+ * Creates an in-process client, connected to the compositor with a socket
+ * pair and dispatched from the compositor's event loop. The client maps one
+ * window with the configured number of subsurfaces.
+ */
+struct bench_client *bench_client_create(struct bench_state *bench);
+/**
+ * Switches all clients to the phase's damage pattern and commit rate.
+ */
+void bench_clients_set_phase(struct bench_state *bench,
+	struct bench_phase *phase);
+void bench_clients_destroy(struct bench_state *bench);
+
+void bench_samples_init(struct bench_samples *samples);
+void bench_samples_finish(struct bench_samples *samples);
+void bench_samples_add(struct bench_samples *samples, int64_t value);
+size_t bench_samples_len(struct bench_samples *samples);
+/**
+ * Returns the nearest-rank percentile of the samples, `p` being between 0
+ * and 100, or -1 if there are no samples.
+ */
+int64_t bench_samples_percentile(struct bench_samples *samples, double p);
+int64_t bench_samples_mean(struct bench_samples *samples);
+
+void bench_stats_init(struct bench_stats *stats);
+void bench_stats_finish(struct bench_stats *stats);
+
+#endif
@@ -0,0 +1,497 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include <wlr/util/log.h>
+#include "bench.h"
+
+#define CLIENT_BUFFERS 2
+
+struct client_buffer {
+	struct wl_buffer *wl_buffer;
+	uint32_t *data;
+	bool busy; // attached, not released by the compositor yet
+};
+
+struct client_surface {
+	struct bench_client *client;
+	struct wl_surface *wl_surface;
+	struct wl_subsurface *wl_subsurface; // NULL for the window
+	int width, height;
+
+	void *pool_data;
+	size_t pool_size;
+	struct client_buffer buffers[CLIENT_BUFFERS];
+};
+
+struct bench_client {
+	struct bench_state *bench;
+	struct wl_list link; // bench_state::clients
+
+	struct wl_client *wl_client; // compositor side of the connection
+	struct wl_listener wl_client_destroy;
+
+	struct wl_display *display;
+	struct wl_event_source *event_source;
+	struct wl_registry *registry;
+	struct wl_compositor *compositor;
+	struct wl_subcompositor *subcompositor;
+	struct wl_shm *shm;
+	struct wl_callback *sync_callback;
+	struct wl_callback *frame_callback;
+	bool ready; // globals have been bound and surfaces created
+
+	struct client_surface window;
+	struct client_surface *subsurfaces;
+	int subsurfaces_len;
+
+	struct bench_phase *phase;
+	struct wl_event_source *commit_timer;
+	uint32_t frame;
+};
+
+static int backingfile(off_t size) {
+	char template[] = "/tmp/wlroots-bench-XXXXXX";
+	int fd = mkstemp(template);
+	if (fd < 0) {
+		return -1;
+	}
+
+	int ret;
+	while ((ret = ftruncate(fd, size)) == EINTR) {
+		// No-op
+	}
+	if (ret < 0) {
+		close(fd);
+		return -1;
+	}
+
+	unlink(template);
+	return fd;
+}
+
+static void buffer_handle_release(void *data, struct wl_buffer *wl_buffer) {
+	struct client_buffer *buffer = data;
+	buffer->busy = false;
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+	.release = buffer_handle_release,
+};
+
+static bool surface_init(struct client_surface *surface,
+		struct bench_client *client, int width, int height,
+		struct client_surface *parent, int x, int y) {
+	surface->client = client;
+	surface->width = width;
+	surface->height = height;
+
+	int stride = width * 4;
+	size_t size = (size_t)stride * height;
+	surface->pool_size = size * CLIENT_BUFFERS;
+
+	int fd = backingfile(surface->pool_size);
+	if (fd < 0) {
+		wlr_log_errno(L_ERROR, "Failed to create shm file");
+		return false;
+	}
+	surface->pool_data = mmap(NULL, surface->pool_size,
+		PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (surface->pool_data == MAP_FAILED) {
+		wlr_log_errno(L_ERROR, "mmap failed");
+		surface->pool_data = NULL;
+		close(fd);
+		return false;
+	}
+
+	struct wl_shm_pool *pool =
+		wl_shm_create_pool(client->shm, fd, surface->pool_size);
+	for (size_t i = 0; i < CLIENT_BUFFERS; ++i) {
+		struct client_buffer *buffer = &surface->buffers[i];
+		buffer->data = (uint32_t *)((char *)surface->pool_data + i * size);
+		buffer->wl_buffer = wl_shm_pool_create_buffer(pool, i * size,
+			width, height, stride, WL_SHM_FORMAT_ARGB8888);
+		wl_buffer_add_listener(buffer->wl_buffer, &buffer_listener, buffer);
+	}
+	wl_shm_pool_destroy(pool);
+	close(fd);
+
+	surface->wl_surface = wl_compositor_create_surface(client->compositor);
+	if (parent != NULL) {
+		surface->wl_subsurface = wl_subcompositor_get_subsurface(
+			client->subcompositor, surface->wl_surface, parent->wl_surface);
+		wl_subsurface_set_position(surface->wl_subsurface, x, y);
+		// Subsurfaces commit at their own pace
+		wl_subsurface_set_desync(surface->wl_subsurface);
+	}
+	return true;
+}
+
+static void surface_finish(struct client_surface *surface) {
+	if (surface->wl_subsurface != NULL) {
+		wl_subsurface_destroy(surface->wl_subsurface);
+	}
+	if (surface->wl_surface != NULL) {
+		wl_surface_destroy(surface->wl_surface);
+	}
+	for (size_t i = 0; i < CLIENT_BUFFERS; ++i) {
+		if (surface->buffers[i].wl_buffer != NULL) {
+			wl_buffer_destroy(surface->buffers[i].wl_buffer);
+		}
+	}
+	if (surface->pool_data != NULL) {
+		munmap(surface->pool_data, surface->pool_size);
+	}
+}
+
+/**
+ * Paints the next frame of the surface according to the damage pattern, and
+ * attaches it. Returns false if all buffers are still in use by the
+ * compositor.
+ */
+static bool surface_draw(struct client_surface *surface,
+		enum bench_damage damage, uint32_t frame) {
+	struct client_buffer *buffer = NULL;
+	for (size_t i = 0; i < CLIENT_BUFFERS; ++i) {
+		if (!surface->buffers[i].busy) {
+			buffer = &surface->buffers[i];
+			break;
+		}
+	}
+	if (buffer == NULL) {
+		return false;
+	}
+
+	int x = 0, y = 0, width = surface->width, height = surface->height;
+	if (damage == BENCH_DAMAGE_PARTIAL) {
+		width = surface->width / 4 > 0 ? surface->width / 4 : 1;
+		height = surface->height / 4 > 0 ? surface->height / 4 : 1;
+		x = frame * 8 % (surface->width - width + 1);
+		y = frame * 4 % (surface->height - height + 1);
+	}
+
+	uint32_t color = 0xFF000000 | ((frame * 0x10305) & 0xFFFFFF);
+	for (int j = y; j < y + height; ++j) {
+		uint32_t *row = buffer->data + (size_t)j * surface->width;
+		for (int i = x; i < x + width; ++i) {
+			row[i] = color;
+		}
+	}
+
+	wl_surface_attach(surface->wl_surface, buffer->wl_buffer, 0, 0);
+	wl_surface_damage(surface->wl_surface, x, y, width, height);
+	buffer->busy = true;
+	return true;
+}
+
+static void client_draw(struct bench_client *client);
+
+static void frame_handle_done(void *data, struct wl_callback *callback,
+		uint32_t time) {
+	struct bench_client *client = data;
+	wl_callback_destroy(callback);
+	client->frame_callback = NULL;
+
+	if (client->phase->rate == 0) {
+		client_draw(client);
+	}
+}
+
+static const struct wl_callback_listener frame_listener = {
+	.done = frame_handle_done,
+};
+
+static void client_draw(struct bench_client *client) {
+	struct bench_stats *stats = bench_current_stats(client->bench);
+	enum bench_damage damage = client->phase->damage;
+	client->frame++;
+
+	for (int i = 0; i < client->subsurfaces_len; ++i) {
+		struct client_surface *surface = &client->subsurfaces[i];
+		if (surface_draw(surface, damage, client->frame)) {
+			wl_surface_commit(surface->wl_surface);
+		} else if (stats != NULL) {
+			stats->dropped_commits++;
+		}
+	}
+
+	if (!surface_draw(&client->window, damage, client->frame) &&
+			stats != NULL) {
+		stats->dropped_commits++;
+	}
+	// Commit anyway to keep frame callbacks going
+	if (client->phase->rate == 0 && client->frame_callback == NULL) {
+		client->frame_callback = wl_surface_frame(client->window.wl_surface);
+		wl_callback_add_listener(client->frame_callback, &frame_listener,
+			client);
+	}
+	wl_surface_commit(client->window.wl_surface);
+
+	wl_display_flush(client->display);
+}
+
+static int commit_interval(struct bench_phase *phase) {
+	// Timers have millisecond precision
+	int ms = 1000 / phase->rate;
+	return ms > 0 ? ms : 1;
+}
+
+static int client_handle_commit_timer(void *data) {
+	struct bench_client *client = data;
+	if (client->phase->rate > 0) {
+		client_draw(client);
+		wl_event_source_timer_update(client->commit_timer,
+			commit_interval(client->phase));
+	}
+	return 0;
+}
+
+static void client_set_phase(struct bench_client *client,
+		struct bench_phase *phase) {
+	client->phase = phase;
+	if (!client->ready) {
+		return;
+	}
+
+	if (phase->rate > 0) {
+		wl_event_source_timer_update(client->commit_timer,
+			commit_interval(phase));
+	} else {
+		wl_event_source_timer_update(client->commit_timer, 0);
+		if (client->frame_callback == NULL) {
+			client_draw(client);
+		}
+	}
+}
+
+static bool client_create_surfaces(struct bench_client *client) {
+	struct bench_config *config = &client->bench->config;
+
+	if (!surface_init(&client->window, client, config->window_width,
+			config->window_height, NULL, 0, 0)) {
+		return false;
+	}
+
+	if (config->subsurfaces == 0) {
+		return true;
+	}
+	client->subsurfaces =
+		calloc(config->subsurfaces, sizeof(struct client_surface));
+	if (client->subsurfaces == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		return false;
+	}
+	client->subsurfaces_len = config->subsurfaces;
+
+	// Tile subsurfaces over the window, 4 by 4
+	int width = config->window_width / 4 > 0 ? config->window_width / 4 : 1;
+	int height = config->window_height / 4 > 0 ? config->window_height / 4 : 1;
+	for (int i = 0; i < client->subsurfaces_len; ++i) {
+		int x = i % 4 * width;
+		int y = i / 4 % 4 * height;
+		if (!surface_init(&client->subsurfaces[i], client, width, height,
+				&client->window, x, y)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void sync_handle_done(void *data, struct wl_callback *callback,
+		uint32_t serial) {
+	struct bench_client *client = data;
+	wl_callback_destroy(callback);
+	client->sync_callback = NULL;
+
+	if (client->compositor == NULL || client->shm == NULL ||
+			(client->bench->config.subsurfaces > 0 &&
+			client->subcompositor == NULL)) {
+		wlr_log(L_ERROR, "Compositor doesn't support required interfaces");
+		bench_fail(client->bench);
+		return;
+	}
+
+	if (!client_create_surfaces(client)) {
+		bench_fail(client->bench);
+		return;
+	}
+
+	client->ready = true;
+	client_set_phase(client, client->phase);
+}
+
+static const struct wl_callback_listener sync_listener = {
+	.done = sync_handle_done,
+};
+
+static void handle_global(void *data, struct wl_registry *registry,
+		uint32_t name, const char *interface, uint32_t version) {
+	struct bench_client *client = data;
+
+	if (strcmp(interface, wl_compositor_interface.name) == 0) {
+		client->compositor = wl_registry_bind(registry, name,
+			&wl_compositor_interface, 1);
+	} else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+		client->subcompositor = wl_registry_bind(registry, name,
+			&wl_subcompositor_interface, 1);
+	} else if (strcmp(interface, wl_shm_interface.name) == 0) {
+		client->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+	}
+}
+
+static void handle_global_remove(void *data, struct wl_registry *registry,
+		uint32_t name) {
+	// Who cares?
+}
+
+static const struct wl_registry_listener registry_listener = {
+	.global = handle_global,
+	.global_remove = handle_global_remove,
+};
+
+static int client_handle_event(int fd, uint32_t mask, void *data) {
+	struct bench_client *client = data;
+
+	if ((mask & WL_EVENT_HANGUP) || (mask & WL_EVENT_ERROR)) {
+		wlr_log(L_ERROR, "Client disconnected");
+		bench_fail(client->bench);
+		return 0;
+	}
+
+	if (wl_display_dispatch(client->display) < 0) {
+		wlr_log_errno(L_ERROR, "Failed to dispatch client events");
+		bench_fail(client->bench);
+		return 0;
+	}
+	return 0;
+}
+
+static void client_destroy(struct bench_client *client);
+
+static void handle_wl_client_destroy(struct wl_listener *listener,
+		void *data) {
+	struct bench_client *client =
+		wl_container_of(listener, client, wl_client_destroy);
+	wl_list_remove(&client->wl_client_destroy.link);
+	client->wl_client = NULL;
+}
+
+struct bench_client *bench_client_create(struct bench_state *bench) {
+	struct bench_client *client = calloc(1, sizeof(struct bench_client));
+	if (client == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		return NULL;
+	}
+	client->bench = bench;
+	client->phase = bench_current_phase(bench);
+
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+		wlr_log_errno(L_ERROR, "socketpair failed");
+		free(client);
+		return NULL;
+	}
+
+	client->wl_client = wl_client_create(bench->display, fds[0]);
+	if (client->wl_client == NULL) {
+		wlr_log(L_ERROR, "Failed to create client");
+		close(fds[0]);
+		close(fds[1]);
+		free(client);
+		return NULL;
+	}
+	client->wl_client_destroy.notify = handle_wl_client_destroy;
+	wl_client_add_destroy_listener(client->wl_client,
+		&client->wl_client_destroy);
+
+	client->display = wl_display_connect_to_fd(fds[1]);
+	if (client->display == NULL) {
+		wlr_log(L_ERROR, "Failed to connect client");
+		close(fds[1]);
+		wl_client_destroy(client->wl_client);
+		free(client);
+		return NULL;
+	}
+
+	client->event_source = wl_event_loop_add_fd(bench->event_loop,
+		wl_display_get_fd(client->display), WL_EVENT_READABLE,
+		client_handle_event, client);
+	client->commit_timer = wl_event_loop_add_timer(bench->event_loop,
+		client_handle_commit_timer, client);
+	if (client->event_source == NULL || client->commit_timer == NULL) {
+		wlr_log(L_ERROR, "Failed to add client to event loop");
+		wl_list_init(&client->link);
+		client_destroy(client);
+		return NULL;
+	}
+
+	// Don't block the event loop with a roundtrip, the compositor runs on it
+	client->registry = wl_display_get_registry(client->display);
+	wl_registry_add_listener(client->registry, &registry_listener, client);
+	client->sync_callback = wl_display_sync(client->display);
+	wl_callback_add_listener(client->sync_callback, &sync_listener, client);
+	wl_display_flush(client->display);
+
+	wl_list_insert(&bench->clients, &client->link);
+	return client;
+}
+
+static void client_destroy(struct bench_client *client) {
+	for (int i = 0; i < client->subsurfaces_len; ++i) {
+		surface_finish(&client->subsurfaces[i]);
+	}
+	free(client->subsurfaces);
+	surface_finish(&client->window);
+
+	if (client->frame_callback != NULL) {
+		wl_callback_destroy(client->frame_callback);
+	}
+	if (client->sync_callback != NULL) {
+		wl_callback_destroy(client->sync_callback);
+	}
+	if (client->compositor != NULL) {
+		wl_compositor_destroy(client->compositor);
+	}
+	if (client->subcompositor != NULL) {
+		wl_subcompositor_destroy(client->subcompositor);
+	}
+	if (client->shm != NULL) {
+		wl_shm_destroy(client->shm);
+	}
+	if (client->registry != NULL) {
+		wl_registry_destroy(client->registry);
+	}
+
+	if (client->commit_timer != NULL) {
+		wl_event_source_remove(client->commit_timer);
+	}
+	if (client->event_source != NULL) {
+		wl_event_source_remove(client->event_source);
+	}
+	wl_display_disconnect(client->display);
+	if (client->wl_client != NULL) {
+		wl_client_destroy(client->wl_client);
+	}
+
+	wl_list_remove(&client->link);
+	free(client);
+}
+
+void bench_clients_set_phase(struct bench_state *bench,
+		struct bench_phase *phase) {
+	struct bench_client *client;
+	wl_list_for_each(client, &bench->clients, link) {
+		client_set_phase(client, phase);
+	}
+}
+
+void bench_clients_destroy(struct bench_state *bench) {
+	struct bench_client *client, *tmp;
+	wl_list_for_each_safe(client, tmp, &bench->clients, link) {
+		client_destroy(client);
+	}
+}
@@ -0,0 +1,361 @@
+#define _POSIX_C_SOURCE 200809L
+#include <getopt.h>
+#include <pixman.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wayland-server.h>
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_matrix.h>
+#include <wlr/util/region.h>
+
+#define OUTPUT_WIDTH 1920
+#define OUTPUT_HEIGHT 1080
+#define INPUT_RECTS 64 // before merging by pixman
+#define INPUT_BOXES 64
+#define REPETITIONS 5
+
+/**
+ * Inputs shared by all benchmarks. Regions are made of many small
+ * overlapping rectangles, like the damage of a busy desktop.
+ */
+struct geometry_inputs {
+	pixman_region32_t fragmented, other, dst;
+	struct wlr_box boxes[INPUT_BOXES];
+	float projection[9];
+};
+
+struct geometry_bench {
+	const char *name;
+	// Runs the operation `iterations` times, returns the number of ops
+	size_t (*run)(struct geometry_inputs *inputs, size_t iterations);
+};
+
+// Keeps the compiler from discarding results
+static volatile int64_t sink;
+
+static uint32_t rand_state = 0x2545F491;
+
+static uint32_t next_rand(void) {
+	// xorshift32, the inputs need to be the same across runs
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+static void random_box(struct wlr_box *box, int min_size, int max_size) {
+	box->width = min_size + next_rand() % (max_size - min_size + 1);
+	box->height = min_size + next_rand() % (max_size - min_size + 1);
+	box->x = next_rand() % (OUTPUT_WIDTH - box->width);
+	box->y = next_rand() % (OUTPUT_HEIGHT - box->height);
+}
+
+static void random_region(pixman_region32_t *region) {
+	pixman_region32_init(region);
+	for (int i = 0; i < INPUT_RECTS; ++i) {
+		struct wlr_box box;
+		random_box(&box, 8, 256);
+		pixman_region32_union_rect(region, region, box.x, box.y,
+			box.width, box.height);
+	}
+}
+
+static void inputs_init(struct geometry_inputs *inputs) {
+	random_region(&inputs->fragmented);
+	random_region(&inputs->other);
+	pixman_region32_init(&inputs->dst);
+	for (int i = 0; i < INPUT_BOXES; ++i) {
+		random_box(&inputs->boxes[i], 16, 512);
+	}
+	wlr_matrix_projection(inputs->projection, OUTPUT_WIDTH, OUTPUT_HEIGHT,
+		WL_OUTPUT_TRANSFORM_NORMAL);
+}
+
+static void inputs_finish(struct geometry_inputs *inputs) {
+	pixman_region32_fini(&inputs->fragmented);
+	pixman_region32_fini(&inputs->other);
+	pixman_region32_fini(&inputs->dst);
+}
+
+static size_t sink_region(pixman_region32_t *region, size_t ops) {
+	sink += pixman_region32_n_rects(region);
+	return ops;
+}
+
+static size_t bench_region_scale(struct geometry_inputs *inputs, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		wlr_region_scale(&inputs->dst, &inputs->fragmented, 1.5);
+	}
+	return sink_region(&inputs->dst, n);
+}
+
+static size_t bench_region_scale_int(struct geometry_inputs *inputs,
+		size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		wlr_region_scale(&inputs->dst, &inputs->fragmented, 2);
+	}
+	return sink_region(&inputs->dst, n);
+}
+
+static size_t bench_region_transform(struct geometry_inputs *inputs,
+		size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		wlr_region_transform(&inputs->dst, &inputs->fragmented,
+			WL_OUTPUT_TRANSFORM_90, OUTPUT_WIDTH, OUTPUT_HEIGHT);
+	}
+	return sink_region(&inputs->dst, n);
+}
+
+static size_t bench_region_transform_flipped(struct geometry_inputs *inputs,
+		size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		wlr_region_transform(&inputs->dst, &inputs->fragmented,
+			WL_OUTPUT_TRANSFORM_FLIPPED_270, OUTPUT_WIDTH, OUTPUT_HEIGHT);
+	}
+	return sink_region(&inputs->dst, n);
+}
+
+static size_t bench_region_expand(struct geometry_inputs *inputs, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		wlr_region_expand(&inputs->dst, &inputs->fragmented, 2);
+	}
+	return sink_region(&inputs->dst, n);
+}
+
+static size_t bench_region_rotated_bounds(struct geometry_inputs *inputs,
+		size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		wlr_region_rotated_bounds(&inputs->dst, &inputs->fragmented, 0.5,
+			OUTPUT_WIDTH / 2, OUTPUT_HEIGHT / 2);
+	}
+	return sink_region(&inputs->dst, n);
+}
+
+static size_t bench_region_simplify(struct geometry_inputs *inputs,
+		size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		wlr_region_simplify(&inputs->dst, &inputs->fragmented, 32, 1.25f);
+	}
+	return sink_region(&inputs->dst, n);
+}
+
+static size_t bench_region_union(struct geometry_inputs *inputs, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		pixman_region32_union(&inputs->dst, &inputs->fragmented,
+			&inputs->other);
+	}
+	return sink_region(&inputs->dst, n);
+}
+
+static size_t bench_region_intersect(struct geometry_inputs *inputs,
+		size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		pixman_region32_intersect(&inputs->dst, &inputs->fragmented,
+			&inputs->other);
+	}
+	return sink_region(&inputs->dst, n);
+}
+
+static size_t bench_box_transform(struct geometry_inputs *inputs, size_t n) {
+	int64_t sum = 0;
+	for (size_t i = 0; i < n; ++i) {
+		for (int j = 0; j < INPUT_BOXES; ++j) {
+			struct wlr_box box;
+			wlr_box_transform(&inputs->boxes[j], j % 8, OUTPUT_WIDTH,
+				OUTPUT_HEIGHT, &box);
+			sum += box.x + box.y;
+		}
+	}
+	sink += sum;
+	return n * INPUT_BOXES;
+}
+
+static size_t bench_box_rotated_bounds(struct geometry_inputs *inputs,
+		size_t n) {
+	int64_t sum = 0;
+	for (size_t i = 0; i < n; ++i) {
+		for (int j = 0; j < INPUT_BOXES; ++j) {
+			struct wlr_box box;
+			wlr_box_rotated_bounds(&inputs->boxes[j], 0.5, &box);
+			sum += box.width;
+		}
+	}
+	sink += sum;
+	return n * INPUT_BOXES;
+}
+
+static size_t bench_box_intersection(struct geometry_inputs *inputs,
+		size_t n) {
+	int64_t sum = 0;
+	for (size_t i = 0; i < n; ++i) {
+		for (int j = 0; j < INPUT_BOXES; ++j) {
+			struct wlr_box box;
+			sum += wlr_box_intersection(&inputs->boxes[j],
+				&inputs->boxes[(j + 1) % INPUT_BOXES], &box);
+		}
+	}
+	sink += sum;
+	return n * INPUT_BOXES;
+}
+
+static size_t bench_matrix_project_box(struct geometry_inputs *inputs,
+		size_t n) {
+	float sum = 0;
+	for (size_t i = 0; i < n; ++i) {
+		for (int j = 0; j < INPUT_BOXES; ++j) {
+			float mat[9];
+			wlr_matrix_project_box(mat, &inputs->boxes[j],
+				WL_OUTPUT_TRANSFORM_NORMAL, 0, inputs->projection);
+			sum += mat[2];
+		}
+	}
+	sink += sum;
+	return n * INPUT_BOXES;
+}
+
+static size_t bench_matrix_project_box_rotated(
+		struct geometry_inputs *inputs, size_t n) {
+	float sum = 0;
+	for (size_t i = 0; i < n; ++i) {
+		for (int j = 0; j < INPUT_BOXES; ++j) {
+			float mat[9];
+			wlr_matrix_project_box(mat, &inputs->boxes[j],
+				WL_OUTPUT_TRANSFORM_90, 0.5, inputs->projection);
+			sum += mat[2];
+		}
+	}
+	sink += sum;
+	return n * INPUT_BOXES;
+}
+
+static const struct geometry_bench benches[] = {
+	{ "region_scale", bench_region_scale },
+	{ "region_scale_int", bench_region_scale_int },
+	{ "region_transform", bench_region_transform },
+	{ "region_transform_flipped", bench_region_transform_flipped },
+	{ "region_expand", bench_region_expand },
+	{ "region_rotated_bounds", bench_region_rotated_bounds },
+	{ "region_simplify", bench_region_simplify },
+	{ "region_union", bench_region_union },
+	{ "region_intersect", bench_region_intersect },
+	{ "box_transform", bench_box_transform },
+	{ "box_rotated_bounds", bench_box_rotated_bounds },
+	{ "box_intersection", bench_box_intersection },
+	{ "matrix_project_box", bench_matrix_project_box },
+	{ "matrix_project_box_rotated", bench_matrix_project_box_rotated },
+};
+
+static int64_t now_nsec(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static int compare_double(const void *_a, const void *_b) {
+	double a = *(const double *)_a, b = *(const double *)_b;
+	return (a > b) - (a < b);
+}
+
+/**
+ * Runs a benchmark for about `target_ms` per repetition and returns the
+ * median time per operation.
+ */
+static double run_bench(const struct geometry_bench *bench,
+		struct geometry_inputs *inputs, int target_ms, size_t *ops) {
+	// Find out how many iterations fit in 1/10th of the target
+	size_t iterations = 1;
+	int64_t elapsed;
+	while (true) {
+		int64_t start = now_nsec();
+		bench->run(inputs, iterations);
+		elapsed = now_nsec() - start;
+		if (elapsed >= (int64_t)target_ms * 100000 ||
+				iterations >= SIZE_MAX / 20) {
+			break;
+		}
+		iterations *= 2;
+	}
+	if (elapsed > 0) {
+		double scale = (double)target_ms * 1000000 / elapsed;
+		iterations = iterations * scale > 1 ? iterations * scale : 1;
+	}
+
+	double results[REPETITIONS];
+	for (int i = 0; i < REPETITIONS; ++i) {
+		int64_t start = now_nsec();
+		*ops = bench->run(inputs, iterations);
+		results[i] = (double)(now_nsec() - start) / *ops;
+	}
+	qsort(results, REPETITIONS, sizeof(double), compare_double);
+	return results[REPETITIONS / 2];
+}
+
+static void usage(const char *name, int ret) {
+	fprintf(stderr,
+		"usage: %s [-t <MS>] [-f <FILTER>]\n"
+		"\n"
+		" -t <MS>        Time spent per repetition of each benchmark\n"
+		"                (default: 100).\n"
+		" -f <FILTER>    Only run benchmarks whose name contains FILTER.\n"
+		" -h             Show this help.\n"
+		"\n"
+		"Results are written to stdout as JSON, in nanoseconds per call.\n",
+		name);
+	exit(ret);
+}
+
+int main(int argc, char *argv[]) {
+	int target_ms = 100;
+	const char *filter = NULL;
+
+	int c;
+	while ((c = getopt(argc, argv, "t:f:h")) != -1) {
+		switch (c) {
+		case 't':
+			target_ms = atoi(optarg);
+			if (target_ms <= 0) {
+				usage(argv[0], 1);
+			}
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		case 'h':
+			usage(argv[0], 0);
+			break;
+		default:
+			usage(argv[0], 1);
+		}
+	}
+
+	struct geometry_inputs inputs;
+	inputs_init(&inputs);
+
+	printf("{\n");
+	printf("\t\"input_rects\": %d,\n",
+		pixman_region32_n_rects(&inputs.fragmented));
+	printf("\t\"benchmarks\": [");
+	bool first = true;
+	for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+		const struct geometry_bench *bench = &benches[i];
+		if (filter != NULL && strstr(bench->name, filter) == NULL) {
+			continue;
+		}
+
+		size_t ops;
+		double ns = run_bench(bench, &inputs, target_ms, &ops);
+		printf("%s\n\t\t{\"name\": \"%s\", \"ns_per_op\": %.2f, "
+			"\"ops\": %zu}", first ? "" : ",", bench->name, ns, ops);
+		fflush(stdout);
+		first = false;
+	}
+	printf("\n\t]\n");
+	printf("}\n");
+
+	inputs_finish(&inputs);
+	return 0;
+}
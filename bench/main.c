@@ -0,0 +1,455 @@
+#define _POSIX_C_SOURCE 200809L
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <wlr/backend/headless.h>
+#include <wlr/render/pixman.h>
+#include <wlr/util/log.h>
+#include "bench.h"
+
+#define BENCH_MAX_PHASES 32
+
+static const struct bench_phase default_phases[] = {
+	{
+		.name = "full",
+		.damage = BENCH_DAMAGE_FULL,
+		.rate = 0,
+		.duration = 5000,
+		.measure = true,
+	},
+	{
+		.name = "partial",
+		.damage = BENCH_DAMAGE_PARTIAL,
+		.rate = 0,
+		.duration = 5000,
+		.measure = true,
+	},
+};
+
+int64_t bench_timespec_to_nsec(const struct timespec *t) {
+	return (int64_t)t->tv_sec * 1000000000 + t->tv_nsec;
+}
+
+struct bench_phase *bench_current_phase(struct bench_state *bench) {
+	if (bench->phase_idx >= bench->phases_len) {
+		return &bench->phases[bench->phases_len - 1];
+	}
+	return &bench->phases[bench->phase_idx];
+}
+
+struct bench_stats *bench_current_stats(struct bench_state *bench) {
+	if (bench->phase_idx >= bench->phases_len ||
+			!bench->phases[bench->phase_idx].measure) {
+		return NULL;
+	}
+	return &bench->stats[bench->phase_idx];
+}
+
+void bench_fail(struct bench_state *bench) {
+	bench->failed = true;
+	wl_display_terminate(bench->display);
+}
+
+static void usage(const char *name, int ret) {
+	fprintf(stderr,
+		"usage: %s [options...]\n"
+		"\n"
+		" -o <N>         Number of outputs (default: 1).\n"
+		" -s <W>x<H>     Output size (default: 1920x1080).\n"
+		" -b <N>         Buffers per output, 1 to 4 (default: 2).\n"
+		" -w <N>         Number of windows, each one is a client\n"
+		"                (default: 16).\n"
+		" -S <N>         Subsurfaces per window (default: 0).\n"
+		" -W <W>x<H>     Window size (default: 256x256).\n"
+		" -p <PHASE>     Adds a phase to the scenario, can be repeated.\n"
+		"                Format: <name>:<full|partial>:<rate>:<seconds>\n"
+		"                where rate is the number of commits per second,\n"
+		"                or 0 to commit on frame callbacks\n"
+		"                (default: full:full:0:5 partial:partial:0:5).\n"
+		" -d <SECONDS>   Warm-up duration (default: 1).\n"
+		" -c             Render on the CPU with pixman.\n"
+		" -u             Don't throttle frames to the refresh rate.\n"
+		" -v             Verbose logging.\n"
+		" -h             Show this help.\n"
+		"\n"
+		"Results are written to stdout as JSON.\n",
+		name);
+	exit(ret);
+}
+
+static bool parse_int(const char *str, int min, int *out) {
+	char *end;
+	long val = strtol(str, &end, 10);
+	if (end == str || *end != '\0' || val < min || val > 1000000) {
+		return false;
+	}
+	*out = val;
+	return true;
+}
+
+static bool parse_size(const char *str, int *width, int *height) {
+	int w, h;
+	char c;
+	if (sscanf(str, "%dx%d%c", &w, &h, &c) != 2 || w <= 0 || h <= 0) {
+		return false;
+	}
+	*width = w;
+	*height = h;
+	return true;
+}
+
+static bool parse_seconds(const char *str, int *ms) {
+	char *end;
+	double seconds = strtod(str, &end);
+	if (end == str || *end != '\0' || seconds < 0 || seconds > 3600) {
+		return false;
+	}
+	*ms = seconds * 1000;
+	return true;
+}
+
+static bool parse_phase(const char *str, struct bench_phase *phase) {
+	// format: {name}:{damage}:{rate}:{seconds}
+	char *buf = strdup(str);
+	if (buf == NULL) {
+		return false;
+	}
+
+	char *name = strtok(buf, ":");
+	char *damage = strtok(NULL, ":");
+	char *rate = strtok(NULL, ":");
+	char *seconds = strtok(NULL, ":");
+	if (name == NULL || damage == NULL || rate == NULL || seconds == NULL ||
+			strtok(NULL, ":") != NULL) {
+		goto invalid_input;
+	}
+
+	// Names are written as-is in the JSON output
+	if (strlen(name) >= sizeof(phase->name) ||
+			strspn(name, "abcdefghijklmnopqrstuvwxyz"
+				"ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-.") != strlen(name)) {
+		goto invalid_input;
+	}
+	strcpy(phase->name, name);
+
+	if (strcmp(damage, "full") == 0) {
+		phase->damage = BENCH_DAMAGE_FULL;
+	} else if (strcmp(damage, "partial") == 0) {
+		phase->damage = BENCH_DAMAGE_PARTIAL;
+	} else {
+		goto invalid_input;
+	}
+
+	if (!parse_int(rate, 0, &phase->rate) ||
+			!parse_seconds(seconds, &phase->duration) ||
+			phase->duration == 0) {
+		goto invalid_input;
+	}
+	phase->measure = true;
+
+	free(buf);
+	return true;
+
+invalid_input:
+	free(buf);
+	return false;
+}
+
+static void phase_start(struct bench_state *bench) {
+	struct bench_phase *phase = bench_current_phase(bench);
+	wlr_log(L_INFO, "Starting phase '%s'", phase->name);
+
+	struct bench_stats *stats = bench_current_stats(bench);
+	if (stats != NULL) {
+		clock_gettime(CLOCK_MONOTONIC, &stats->start);
+	}
+
+	bench_clients_set_phase(bench, phase);
+
+	wl_event_source_timer_update(bench->phase_timer, phase->duration);
+}
+
+static int handle_phase_timer(void *data) {
+	struct bench_state *bench = data;
+
+	struct bench_stats *stats = bench_current_stats(bench);
+	if (stats != NULL) {
+		clock_gettime(CLOCK_MONOTONIC, &stats->end);
+	}
+
+	bench->phase_idx++;
+	if (bench->phase_idx == bench->phases_len) {
+		wl_display_terminate(bench->display);
+		return 0;
+	}
+	phase_start(bench);
+	return 0;
+}
+
+static void print_ms(FILE *f, const char *key, int64_t ns) {
+	if (ns < 0) {
+		fprintf(f, "\"%s\": null", key);
+	} else {
+		fprintf(f, "\"%s\": %.3f", key, ns / 1000000.0);
+	}
+}
+
+static void print_samples(FILE *f, const char *key,
+		struct bench_samples *samples) {
+	fprintf(f, "\t\t\t\"%s\": {\"count\": %zu, ", key,
+		bench_samples_len(samples));
+	print_ms(f, "mean", bench_samples_mean(samples));
+	fprintf(f, ", ");
+	print_ms(f, "p50", bench_samples_percentile(samples, 50));
+	fprintf(f, ", ");
+	print_ms(f, "p99", bench_samples_percentile(samples, 99));
+	fprintf(f, ", ");
+	print_ms(f, "max", bench_samples_percentile(samples, 100));
+	fprintf(f, "}");
+}
+
+static void print_results(FILE *f, struct bench_state *bench) {
+	struct bench_config *config = &bench->config;
+
+	fprintf(f, "{\n");
+	fprintf(f, "\t\"config\": {\n");
+	fprintf(f, "\t\t\"renderer\": \"%s\",\n",
+		wlr_renderer_is_pixman(bench->renderer) ? "pixman" : "gles2");
+	fprintf(f, "\t\t\"unthrottled\": %s,\n",
+		config->unthrottled ? "true" : "false");
+	fprintf(f, "\t\t\"outputs\": %d,\n", config->outputs);
+	fprintf(f, "\t\t\"output_width\": %d,\n", config->output_width);
+	fprintf(f, "\t\t\"output_height\": %d,\n", config->output_height);
+	fprintf(f, "\t\t\"buffers\": %d,\n", config->buffers);
+	fprintf(f, "\t\t\"windows\": %d,\n", config->windows);
+	fprintf(f, "\t\t\"subsurfaces\": %d,\n", config->subsurfaces);
+	fprintf(f, "\t\t\"window_width\": %d,\n", config->window_width);
+	fprintf(f, "\t\t\"window_height\": %d\n", config->window_height);
+	fprintf(f, "\t},\n");
+
+	fprintf(f, "\t\"phases\": [");
+	bool first = true;
+	for (size_t i = 0; i < bench->phases_len; ++i) {
+		struct bench_phase *phase = &bench->phases[i];
+		struct bench_stats *stats = &bench->stats[i];
+		if (!phase->measure) {
+			continue;
+		}
+
+		int64_t duration = bench_timespec_to_nsec(&stats->end) -
+			bench_timespec_to_nsec(&stats->start);
+		double seconds = duration / 1000000000.0;
+		double fps = seconds > 0 ?
+			stats->frames / seconds / config->outputs : 0;
+
+		fprintf(f, "%s\n\t\t{\n", first ? "" : ",");
+		first = false;
+		fprintf(f, "\t\t\t\"name\": \"%s\",\n", phase->name);
+		fprintf(f, "\t\t\t\"damage\": \"%s\",\n",
+			phase->damage == BENCH_DAMAGE_FULL ? "full" : "partial");
+		fprintf(f, "\t\t\t\"rate\": %d,\n", phase->rate);
+		fprintf(f, "\t\t\t");
+		print_ms(f, "duration_ms", duration);
+		fprintf(f, ",\n");
+		fprintf(f, "\t\t\t\"frames\": %zu,\n", stats->frames);
+		fprintf(f, "\t\t\t\"fps\": %.2f,\n", fps);
+		fprintf(f, "\t\t\t\"full_repaints\": %zu,\n", stats->full_repaints);
+		fprintf(f, "\t\t\t\"commits\": %zu,\n", stats->commits);
+		fprintf(f, "\t\t\t\"dropped_commits\": %zu,\n",
+			stats->dropped_commits);
+		print_samples(f, "frame_cpu_time_ms", &stats->frame_times);
+		fprintf(f, ",\n");
+		print_samples(f, "render_cpu_time_ms", &stats->render_times);
+		fprintf(f, ",\n");
+		print_samples(f, "commit_to_present_ms", &stats->latencies);
+		fprintf(f, "\n\t\t}");
+	}
+	fprintf(f, "\n\t]\n");
+	fprintf(f, "}\n");
+}
+
+int main(int argc, char *argv[]) {
+	struct bench_state bench = {
+		.config = {
+			.outputs = 1,
+			.output_width = 1920,
+			.output_height = 1080,
+			.windows = 16,
+			.subsurfaces = 0,
+			.window_width = 256,
+			.window_height = 256,
+			.buffers = 2,
+			.warmup = 1000,
+		},
+	};
+	struct bench_config *config = &bench.config;
+
+	// The first phase is reserved for the warm-up
+	struct bench_phase phases[BENCH_MAX_PHASES + 1] = {0};
+	size_t phases_len = 1;
+	log_importance_t verbosity = L_ERROR;
+
+	int c;
+	while ((c = getopt(argc, argv, "o:s:b:w:S:W:p:d:cuvh")) != -1) {
+		bool ok = true;
+		switch (c) {
+		case 'o':
+			ok = parse_int(optarg, 1, &config->outputs);
+			break;
+		case 's':
+			ok = parse_size(optarg, &config->output_width,
+				&config->output_height);
+			break;
+		case 'b':
+			ok = parse_int(optarg, 1, &config->buffers);
+			break;
+		case 'w':
+			ok = parse_int(optarg, 1, &config->windows);
+			break;
+		case 'S':
+			ok = parse_int(optarg, 0, &config->subsurfaces);
+			break;
+		case 'W':
+			ok = parse_size(optarg, &config->window_width,
+				&config->window_height);
+			break;
+		case 'p':
+			if (phases_len > BENCH_MAX_PHASES) {
+				fprintf(stderr, "Too many phases\n");
+				return 1;
+			}
+			ok = parse_phase(optarg, &phases[phases_len++]);
+			break;
+		case 'd':
+			ok = parse_seconds(optarg, &config->warmup);
+			break;
+		case 'c':
+			config->software = true;
+			break;
+		case 'u':
+			config->unthrottled = true;
+			break;
+		case 'v':
+			verbosity = L_DEBUG;
+			break;
+		case 'h':
+			usage(argv[0], 0);
+			break;
+		default:
+			usage(argv[0], 1);
+		}
+		if (!ok) {
+			fprintf(stderr, "Invalid argument for -%c: %s\n", c, optarg);
+			return 1;
+		}
+	}
+	if (optind < argc) {
+		usage(argv[0], 1);
+	}
+
+	wlr_log_init(verbosity, NULL);
+
+	if (phases_len == 1) {
+		size_t len = sizeof(default_phases) / sizeof(default_phases[0]);
+		memcpy(&phases[1], default_phases, sizeof(default_phases));
+		phases_len += len;
+	}
+
+	bench.phases = phases + 1;
+	bench.phases_len = phases_len - 1;
+	if (config->warmup > 0) {
+		// Warm up with the parameters of the first phase
+		phases[0] = phases[1];
+		strcpy(phases[0].name, "warmup");
+		phases[0].duration = config->warmup;
+		phases[0].measure = false;
+		bench.phases = phases;
+		bench.phases_len = phases_len;
+	}
+
+	bench.stats = calloc(bench.phases_len, sizeof(struct bench_stats));
+	if (bench.stats == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		return 1;
+	}
+	for (size_t i = 0; i < bench.phases_len; ++i) {
+		bench_stats_init(&bench.stats[i]);
+	}
+
+	bench.display = wl_display_create();
+	bench.event_loop = wl_display_get_event_loop(bench.display);
+	wl_list_init(&bench.clients);
+
+	if (config->software) {
+		bench.backend = wlr_headless_backend_create_software(bench.display);
+	} else {
+		bench.backend = wlr_headless_backend_create(bench.display);
+	}
+	if (bench.backend == NULL) {
+		wlr_log(L_ERROR, "Failed to create headless backend");
+		bench.failed = true;
+		goto finish;
+	}
+	wlr_headless_backend_set_unthrottled(bench.backend, config->unthrottled);
+
+	bench.renderer = wlr_backend_get_renderer(bench.backend);
+	wl_display_init_shm(bench.display);
+	bench.compositor = wlr_compositor_create(bench.display, bench.renderer);
+	bench.layout = wlr_output_layout_create();
+	bench_server_init(&bench);
+
+	for (int i = 0; i < config->outputs; ++i) {
+		struct wlr_output *output = wlr_headless_add_output(bench.backend,
+			config->output_width, config->output_height);
+		if (output == NULL ||
+				!wlr_headless_output_set_buffer_count(output,
+					config->buffers)) {
+			wlr_log(L_ERROR, "Failed to create headless output");
+			bench.failed = true;
+			goto finish;
+		}
+	}
+
+	if (!wlr_backend_start(bench.backend)) {
+		wlr_log(L_ERROR, "Failed to start backend");
+		bench.failed = true;
+		goto finish;
+	}
+
+	for (int i = 0; i < config->windows; ++i) {
+		if (bench_client_create(&bench) == NULL) {
+			bench.failed = true;
+			goto finish;
+		}
+	}
+
+	bench.phase_timer =
+		wl_event_loop_add_timer(bench.event_loop, handle_phase_timer, &bench);
+	phase_start(&bench);
+
+	wl_display_run(bench.display);
+
+	if (!bench.failed) {
+		print_results(stdout, &bench);
+	}
+
+finish:
+	bench_clients_destroy(&bench);
+	if (bench.phase_timer != NULL) {
+		wl_event_source_remove(bench.phase_timer);
+	}
+	if (bench.layout != NULL) {
+		bench_server_finish(&bench);
+		wlr_output_layout_destroy(bench.layout);
+	}
+	wl_display_destroy(bench.display);
+
+	for (size_t i = 0; i < bench.phases_len; ++i) {
+		bench_stats_finish(&bench.stats[i]);
+	}
+	free(bench.stats);
+	return bench.failed ? 1 : 0;
+}
@@ -0,0 +1,433 @@
+#define _POSIX_C_SOURCE 199309L
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_matrix.h>
+#include <wlr/util/log.h>
+#include <wlr/util/region.h>
+#include "bench.h"
+
+static void scissor_output(struct bench_output *output, pixman_box32_t *rect) {
+	struct wlr_output *wlr_output = output->wlr_output;
+
+	struct wlr_box box = {
+		.x = rect->x1,
+		.y = rect->y1,
+		.width = rect->x2 - rect->x1,
+		.height = rect->y2 - rect->y1,
+	};
+
+	int ow, oh;
+	wlr_output_transformed_resolution(wlr_output, &ow, &oh);
+
+	// Scissor is in renderer coordinates, ie. upside down
+	enum wl_output_transform transform = wlr_output_transform_compose(
+		wlr_output_transform_invert(wlr_output->transform),
+		WL_OUTPUT_TRANSFORM_FLIPPED_180);
+	wlr_box_transform(&box, transform, ow, oh, &box);
+
+	wlr_renderer_scissor(output->bench->renderer, &box);
+}
+
+/**
+ * Transforms a region in output-local coordinates into renderer coordinates.
+ */
+static void region_to_renderer(struct bench_output *output,
+		pixman_region32_t *region) {
+	struct wlr_output *wlr_output = output->wlr_output;
+	int ow, oh;
+	wlr_output_transformed_resolution(wlr_output, &ow, &oh);
+
+	// Renderer coordinates are upside down
+	enum wl_output_transform transform = wlr_output_transform_compose(
+		wlr_output_transform_invert(wlr_output->transform),
+		WL_OUTPUT_TRANSFORM_FLIPPED_180);
+	wlr_region_transform(region, region, transform, ow, oh);
+}
+
+struct render_data {
+	struct bench_output *output;
+	struct bench_surface *window;
+	pixman_region32_t *damage;
+};
+
+static void render_surface(struct wlr_surface *wlr_surface, int sx, int sy,
+		void *_data) {
+	struct render_data *data = _data;
+	struct bench_output *output = data->output;
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct bench_surface *surface = wlr_surface->data;
+
+	if (!wlr_surface_has_buffer(wlr_surface)) {
+		return;
+	}
+
+	double ox = data->window->x + sx, oy = data->window->y + sy;
+	wlr_output_layout_output_coords(output->bench->layout, wlr_output,
+		&ox, &oy);
+	struct wlr_box box = {
+		.x = ox * wlr_output->scale,
+		.y = oy * wlr_output->scale,
+		.width = wlr_surface->current->width * wlr_output->scale,
+		.height = wlr_surface->current->height * wlr_output->scale,
+	};
+
+	struct wlr_box output_box = {0}, intersection;
+	wlr_output_transformed_resolution(wlr_output, &output_box.width,
+		&output_box.height);
+	if (!wlr_box_intersection(&output_box, &box, &intersection)) {
+		return;
+	}
+
+	// The first output to render the new content reports its latency
+	if (surface->commit_pending) {
+		struct timespec *commit_time =
+			wl_array_add(&output->sampled, sizeof(struct timespec));
+		if (commit_time != NULL) {
+			*commit_time = surface->commit_time;
+		}
+		surface->commit_pending = false;
+	}
+
+	pixman_region32_t damage;
+	pixman_region32_init_rect(&damage, box.x, box.y, box.width, box.height);
+	pixman_region32_intersect(&damage, &damage, data->damage);
+	if (!pixman_region32_not_empty(&damage)) {
+		goto damage_finish;
+	}
+
+	struct wlr_texture *texture = wlr_surface_get_texture(wlr_surface);
+	if (texture == NULL) {
+		goto damage_finish;
+	}
+
+	float matrix[9];
+	enum wl_output_transform transform =
+		wlr_output_transform_invert(wlr_surface->current->transform);
+	wlr_matrix_project_box(matrix, &box, transform, 0,
+		wlr_output->transform_matrix);
+
+	// Draw like rootston does, with the opaque parts unblended
+	pixman_region32_t opaque;
+	pixman_region32_init(&opaque);
+	wlr_region_scale(&opaque, &wlr_surface->current->opaque,
+		wlr_output->scale);
+	if (wlr_output->scale != floorf(wlr_output->scale)) {
+		wlr_region_expand(&opaque, &opaque, -1);
+	}
+	pixman_region32_translate(&opaque, box.x, box.y);
+	pixman_region32_intersect_rect(&opaque, &opaque, box.x, box.y,
+		box.width, box.height);
+
+	region_to_renderer(output, &opaque);
+	region_to_renderer(output, &damage);
+	wlr_render_texture_with_matrix_opaque_region(output->bench->renderer,
+		texture, matrix, 1.0, &damage, &opaque);
+	pixman_region32_fini(&opaque);
+
+damage_finish:
+	pixman_region32_fini(&damage);
+}
+
+static void send_frame_done(struct wlr_surface *surface, int sx, int sy,
+		void *data) {
+	wlr_surface_send_frame_done(surface, data);
+}
+
+static void output_handle_frame(struct wl_listener *listener, void *data) {
+	struct bench_output *output = wl_container_of(listener, output, frame);
+	struct bench_state *bench = output->bench;
+	struct wlr_output *wlr_output = output->wlr_output;
+	struct wlr_renderer *renderer = bench->renderer;
+	struct bench_surface *window;
+
+	struct timespec now, cpu_start;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	// Clients and renderer worker threads run in the same process, only count
+	// the compositor thread
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+
+	bool needs_swap;
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	if (!wlr_output_damage_make_current(output->damage, &needs_swap,
+			&damage)) {
+		goto damage_finish;
+	}
+	if (!needs_swap) {
+		goto frame_done;
+	}
+
+	size_t full_repaints = output->damage->full_repaint_count;
+
+	wlr_renderer_begin(renderer, wlr_output->width, wlr_output->height);
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		scissor_output(output, &rects[i]);
+		wlr_renderer_clear(renderer, (float[]){0.25, 0.25, 0.25, 1});
+	}
+
+	struct render_data render_data = {
+		.output = output,
+		.damage = &damage,
+	};
+	wl_list_for_each(window, &bench->windows, window_link) {
+		render_data.window = window;
+		wlr_surface_for_each_surface(window->wlr_surface, render_surface,
+			&render_data);
+	}
+
+	wlr_renderer_scissor(renderer, NULL);
+	wlr_renderer_end(renderer);
+	int64_t render_time = wlr_renderer_get_stats(renderer)->cpu_time_ns;
+
+	if (!wlr_output_damage_swap_buffers(output->damage, &now, &damage)) {
+		output->sampled.size = 0;
+		goto frame_done;
+	}
+
+	void *swapped = wl_array_add(&output->swapped, output->sampled.size);
+	if (swapped != NULL) {
+		memcpy(swapped, output->sampled.data, output->sampled.size);
+	}
+	output->sampled.size = 0;
+
+	struct bench_stats *stats = bench_current_stats(bench);
+	if (stats != NULL) {
+		struct timespec cpu_end;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+		stats->frames++;
+		stats->full_repaints +=
+			output->damage->full_repaint_count - full_repaints;
+		bench_samples_add(&stats->frame_times,
+			bench_timespec_to_nsec(&cpu_end) -
+			bench_timespec_to_nsec(&cpu_start));
+		bench_samples_add(&stats->render_times, render_time);
+	}
+
+frame_done:
+	wl_list_for_each(window, &bench->windows, window_link) {
+		if (window->output == wlr_output) {
+			wlr_surface_for_each_surface(window->wlr_surface,
+				send_frame_done, &now);
+		}
+	}
+
+damage_finish:
+	pixman_region32_fini(&damage);
+}
+
+static void output_handle_present(struct wl_listener *listener, void *data) {
+	struct bench_output *output = wl_container_of(listener, output, present);
+	struct wlr_output_event_present *event = data;
+
+	struct bench_stats *stats = bench_current_stats(output->bench);
+	if (stats != NULL) {
+		int64_t when = bench_timespec_to_nsec(event->when);
+		struct timespec *commit_time;
+		wl_array_for_each(commit_time, &output->swapped) {
+			bench_samples_add(&stats->latencies,
+				when - bench_timespec_to_nsec(commit_time));
+		}
+	}
+	output->swapped.size = 0;
+}
+
+static void output_handle_destroy(struct wl_listener *listener, void *data) {
+	struct bench_output *output = wl_container_of(listener, output, destroy);
+
+	struct bench_surface *window;
+	wl_list_for_each(window, &output->bench->windows, window_link) {
+		if (window->output == output->wlr_output) {
+			window->output = NULL;
+		}
+	}
+
+	wl_list_remove(&output->link);
+	wl_list_remove(&output->frame.link);
+	wl_list_remove(&output->present.link);
+	wl_list_remove(&output->destroy.link);
+	wl_array_release(&output->sampled);
+	wl_array_release(&output->swapped);
+	free(output);
+}
+
+static void handle_new_output(struct wl_listener *listener, void *data) {
+	struct bench_state *bench =
+		wl_container_of(listener, bench, new_output);
+	struct wlr_output *wlr_output = data;
+
+	struct bench_output *output = calloc(1, sizeof(struct bench_output));
+	if (output == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		bench_fail(bench);
+		return;
+	}
+	output->bench = bench;
+	output->wlr_output = wlr_output;
+	output->damage = wlr_output_damage_create(wlr_output);
+	if (output->damage == NULL) {
+		wlr_log(L_ERROR, "Failed to create output damage");
+		free(output);
+		bench_fail(bench);
+		return;
+	}
+	wl_array_init(&output->sampled);
+	wl_array_init(&output->swapped);
+
+	output->frame.notify = output_handle_frame;
+	wl_signal_add(&output->damage->events.frame, &output->frame);
+	output->present.notify = output_handle_present;
+	wl_signal_add(&wlr_output->events.present, &output->present);
+	output->destroy.notify = output_handle_destroy;
+	wl_signal_add(&wlr_output->events.destroy, &output->destroy);
+
+	wl_list_insert(bench->outputs.prev, &output->link);
+	wlr_output_layout_add_auto(bench->layout, wlr_output);
+}
+
+static void damage_whole(struct bench_state *bench) {
+	struct bench_output *output;
+	wl_list_for_each(output, &bench->outputs, link) {
+		wlr_output_damage_add_whole(output->damage);
+	}
+}
+
+/**
+ * Tiles windows over the output layout. Once the layout is full, windows
+ * wrap around and overlap the previous ones.
+ */
+static void window_place(struct bench_surface *window) {
+	struct bench_state *bench = window->bench;
+	struct wlr_box *layout_box =
+		wlr_output_layout_get_box(bench->layout, NULL);
+
+	int width = bench->config.window_width;
+	int height = bench->config.window_height;
+	int cols = layout_box->width / width;
+	int rows = layout_box->height / height;
+	cols = cols > 0 ? cols : 1;
+	rows = rows > 0 ? rows : 1;
+
+	int i = bench->placed_windows++;
+	int wrap = i / (cols * rows);
+	window->x = layout_box->x + (i % cols) * width + wrap * 16;
+	window->y = layout_box->y + (i / cols % rows) * height + wrap * 16;
+
+	window->output = wlr_output_layout_output_at(bench->layout,
+		window->x + width / 2, window->y + height / 2);
+	if (window->output == NULL) {
+		window->output = wlr_output_layout_output_at(bench->layout,
+			window->x, window->y);
+	}
+
+	window->placed = true;
+	wl_list_insert(bench->windows.prev, &window->window_link);
+	damage_whole(bench);
+}
+
+static void surface_handle_commit(struct wl_listener *listener, void *data) {
+	struct bench_surface *surface =
+		wl_container_of(listener, surface, commit);
+	struct bench_state *bench = surface->bench;
+	struct wlr_surface *wlr_surface = surface->wlr_surface;
+
+	clock_gettime(CLOCK_MONOTONIC, &surface->commit_time);
+	surface->commit_pending = true;
+
+	struct bench_stats *stats = bench_current_stats(bench);
+	if (stats != NULL) {
+		stats->commits++;
+	}
+
+	if (!surface->placed && !wlr_surface_is_subsurface(wlr_surface) &&
+			wlr_surface_has_buffer(wlr_surface)) {
+		window_place(surface);
+		return;
+	}
+
+	// Find the position of the surface in the window
+	struct wlr_surface *root = wlr_surface;
+	int sx = 0, sy = 0;
+	while (wlr_surface_is_subsurface(root)) {
+		struct wlr_subsurface *subsurface =
+			wlr_subsurface_from_surface(root);
+		sx += root->current->subsurface_position.x;
+		sy += root->current->subsurface_position.y;
+		root = subsurface->parent;
+	}
+	struct bench_surface *window = root->data;
+	if (window == NULL || !window->placed) {
+		return;
+	}
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	struct bench_output *output;
+	wl_list_for_each(output, &bench->outputs, link) {
+		double ox = window->x + sx, oy = window->y + sy;
+		wlr_output_layout_output_coords(bench->layout, output->wlr_output,
+			&ox, &oy);
+		pixman_region32_copy(&damage, &wlr_surface->current->surface_damage);
+		pixman_region32_translate(&damage, ox, oy);
+		wlr_output_damage_add(output->damage, &damage);
+	}
+	pixman_region32_fini(&damage);
+}
+
+static void surface_handle_destroy(struct wl_listener *listener, void *data) {
+	struct bench_surface *surface =
+		wl_container_of(listener, surface, destroy);
+	if (surface->placed) {
+		wl_list_remove(&surface->window_link);
+		damage_whole(surface->bench);
+	}
+	surface->wlr_surface->data = NULL;
+	wl_list_remove(&surface->link);
+	wl_list_remove(&surface->commit.link);
+	wl_list_remove(&surface->destroy.link);
+	free(surface);
+}
+
+static void handle_new_surface(struct wl_listener *listener, void *data) {
+	struct bench_state *bench =
+		wl_container_of(listener, bench, new_surface);
+	struct wlr_surface *wlr_surface = data;
+
+	struct bench_surface *surface = calloc(1, sizeof(struct bench_surface));
+	if (surface == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		bench_fail(bench);
+		return;
+	}
+	surface->bench = bench;
+	surface->wlr_surface = wlr_surface;
+	wlr_surface->data = surface;
+
+	surface->commit.notify = surface_handle_commit;
+	wl_signal_add(&wlr_surface->events.commit, &surface->commit);
+	surface->destroy.notify = surface_handle_destroy;
+	wl_signal_add(&wlr_surface->events.destroy, &surface->destroy);
+
+	wl_list_insert(&bench->surfaces, &surface->link);
+}
+
+void bench_server_init(struct bench_state *bench) {
+	wl_list_init(&bench->outputs);
+	wl_list_init(&bench->surfaces);
+	wl_list_init(&bench->windows);
+
+	bench->new_output.notify = handle_new_output;
+	wl_signal_add(&bench->backend->events.new_output, &bench->new_output);
+	bench->new_surface.notify = handle_new_surface;
+	wl_signal_add(&bench->compositor->events.new_surface, &bench->new_surface);
+}
+
+void bench_server_finish(struct bench_state *bench) {
+	wl_list_remove(&bench->new_output.link);
+	wl_list_remove(&bench->new_surface.link);
+}
@@ -0,0 +1,79 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+void bench_samples_init(struct bench_samples *samples) {
+	wl_array_init(&samples->values);
+	samples->sorted = true;
+}
+
+void bench_samples_finish(struct bench_samples *samples) {
+	wl_array_release(&samples->values);
+}
+
+void bench_samples_add(struct bench_samples *samples, int64_t value) {
+	int64_t *v = wl_array_add(&samples->values, sizeof(int64_t));
+	if (v == NULL) {
+		return;
+	}
+	*v = value;
+	samples->sorted = false;
+}
+
+size_t bench_samples_len(struct bench_samples *samples) {
+	return samples->values.size / sizeof(int64_t);
+}
+
+static int compare_samples(const void *_a, const void *_b) {
+	int64_t a = *(const int64_t *)_a, b = *(const int64_t *)_b;
+	return (a > b) - (a < b);
+}
+
+int64_t bench_samples_percentile(struct bench_samples *samples, double p) {
+	size_t len = bench_samples_len(samples);
+	if (len == 0) {
+		return -1;
+	}
+
+	int64_t *values = samples->values.data;
+	if (!samples->sorted) {
+		qsort(values, len, sizeof(int64_t), compare_samples);
+		samples->sorted = true;
+	}
+
+	size_t rank = (size_t)ceil(p / 100 * len);
+	if (rank < 1) {
+		rank = 1;
+	} else if (rank > len) {
+		rank = len;
+	}
+	return values[rank - 1];
+}
+
+int64_t bench_samples_mean(struct bench_samples *samples) {
+	size_t len = bench_samples_len(samples);
+	if (len == 0) {
+		return -1;
+	}
+
+	int64_t sum = 0;
+	int64_t *v;
+	wl_array_for_each(v, &samples->values) {
+		sum += *v;
+	}
+	return sum / (int64_t)len;
+}
+
+void bench_stats_init(struct bench_stats *stats) {
+	memset(stats, 0, sizeof(*stats));
+	bench_samples_init(&stats->frame_times);
+	bench_samples_init(&stats->render_times);
+	bench_samples_init(&stats->latencies);
+}
+
+void bench_stats_finish(struct bench_stats *stats) {
+	bench_samples_finish(&stats->frame_times);
+	bench_samples_finish(&stats->render_times);
+	bench_samples_finish(&stats->latencies);
+}
@@ -1,20 +1,35 @@
 #ifndef BACKEND_HEADLESS_H
 #define BACKEND_HEADLESS_H
 
+#include <GLES2/gl2.h>
+#include <pixman.h>
+#include <stdint.h>
+#include <time.h>
 #include <wlr/backend/headless.h>
 #include <wlr/backend/interface.h>
 
 #define HEADLESS_DEFAULT_REFRESH (60 * 1000) // 60 Hz
+#define HEADLESS_DEFAULT_BUFFERS 2
+#define HEADLESS_MAX_BUFFERS 4
 
 struct wlr_headless_backend {
 	struct wlr_backend backend;
-	struct wlr_egl egl;
+	struct wlr_egl egl; // only initialized if software is false
+	bool software; // outputs render into pixman images
 	struct wlr_renderer *renderer;
 	struct wl_display *display;
 	struct wl_list outputs;
 	struct wl_list input_devices;
 	struct wl_listener display_destroy;
 	bool started;
+	// Signal frames as soon as buffers are swapped instead of at vblank
+	bool unthrottled;
+};
+
+struct wlr_headless_buffer {
+	GLuint fbo, texture; // EGL rendering only
+	pixman_image_t *image; // software rendering only
+	int age; // 0 if the contents are undefined
 };
 
 struct wlr_headless_output {
@@ -23,9 +38,20 @@ struct wlr_headless_output {
 	struct wlr_headless_backend *backend;
 	struct wl_list link;
 
-	void *egl_surface;
-	struct wl_event_source *frame_timer;
-	int frame_delay; // ms
+	// Outputs cycle through a ring of buffers like a real swapchain
+	struct wlr_headless_buffer buffers[HEADLESS_MAX_BUFFERS];
+	size_t n_buffers;
+	struct wlr_headless_buffer *back; // rendered into
+	struct wlr_headless_buffer *front; // last presented, may be NULL
+
+	// Virtual vblanks are driven by a timerfd with absolute deadlines, so
+	// that they don't drift
+	int vblank_fd;
+	struct wl_event_source *vblank_source;
+	struct timespec vblank_base; // time of vblank zero
+	uint64_t vblank_seq;
+	int64_t refresh_ns;
+	struct wl_event_source *idle_frame; // unthrottled mode only
 };
 
 struct wlr_headless_input_device {
@@ -34,4 +60,10 @@ struct wlr_headless_input_device {
 	struct wlr_headless_backend *backend;
 };
 
+/**
+ * (Re)starts the output's virtual vblanks from the current time, or signals
+ * the next frame right away in unthrottled mode.
+ */
+void headless_output_start_frames(struct wlr_headless_output *output);
+
 #endif
@@ -25,6 +25,9 @@ struct gles2_pixel_format {
 	bool has_alpha;
 };
 
+#define GLES2_READBACK_BUFFERS 3
+#define GLES2_TIMER_QUERIES 4
+
 struct wlr_gles2_renderer {
 	struct wlr_renderer wlr_renderer;
 
@@ -38,6 +41,61 @@ struct wlr_gles2_renderer {
 		GLuint tex_rgbx;
 		GLuint tex_ext;
 	} shaders;
+
+	struct {
+		GLuint quad; // static unit quad
+		GLuint stream; // ring buffer for batched geometry
+		size_t stream_size, stream_offset;
+	} buffers;
+
+	uint32_t viewport_width, viewport_height;
+
+	// Cached GL state, used to skip redundant calls. A zero name means the
+	// binding is unknown.
+	struct {
+		GLuint program;
+		GLuint array_buffer;
+		GLuint tex_2d, tex_ext;
+		bool blend, blend_valid;
+		bool scissor, scissor_valid;
+	} state;
+
+	// Scratch buffer for batched vertices
+	struct {
+		GLfloat *data;
+		size_t cap;
+	} verts;
+
+	// Scratch buffer for pixel readback
+	struct {
+		void *data;
+		size_t cap;
+	} pixels;
+
+	// Pixel pack buffers for asynchronous readback
+	struct {
+		bool supported;
+		GLenum usage;
+		GLuint buffers[GLES2_READBACK_BUFFERS];
+		size_t sizes[GLES2_READBACK_BUFFERS];
+		bool busy[GLES2_READBACK_BUFFERS];
+	} readback;
+
+	// GPU timer queries, one per frame
+	struct {
+		bool supported;
+		GLuint queries[GLES2_TIMER_QUERIES];
+		uint64_t frames[GLES2_TIMER_QUERIES]; // zero if unused
+		int64_t times[GLES2_TIMER_QUERIES]; // -1 if not read back yet
+		size_t next;
+		bool active;
+	} timer;
+};
+
+struct wlr_gles2_readback {
+	struct wlr_renderer_readback wlr_readback;
+	const struct gles2_pixel_format *fmt;
+	size_t index; // into wlr_gles2_renderer.readback
 };
 
 enum wlr_gles2_texture_type {
@@ -69,12 +127,38 @@ struct wlr_gles2_texture {
 const struct gles2_pixel_format *gles2_format_from_wl(enum wl_shm_format fmt);
 const enum wl_shm_format *gles2_formats(size_t *len);
 
+struct wlr_gles2_texture *gles2_get_texture(
+	struct wlr_texture *wlr_texture);
 struct wlr_gles2_texture *gles2_get_texture_in_context(
 	struct wlr_texture *wlr_texture);
 
+/**
+ * Binds a texture to texture unit 0, skipping the call if it's already bound.
+ * `renderer` can be NULL.
+ */
+void gles2_bind_texture(struct wlr_gles2_renderer *renderer, GLenum target,
+	GLuint tex);
+/**
+ * Drops a texture about to be deleted from the renderer state cache.
+ */
+void gles2_forget_texture(struct wlr_gles2_renderer *renderer, GLuint tex);
+
+// Set if debug groups should be pushed, see WLR_GLES2_DEBUG_MARKERS
+extern bool gles2_debug_markers;
+
 void gles2_push_marker(const char *file, const char *func);
 void gles2_pop_marker(void);
-#define GLES2_DEBUG_PUSH gles2_push_marker(wlr_strip_path(__FILE__), __func__)
-#define GLES2_DEBUG_POP gles2_pop_marker()
+#define GLES2_DEBUG_PUSH \
+	do { \
+		if (gles2_debug_markers) { \
+			gles2_push_marker(wlr_strip_path(__FILE__), __func__); \
+		} \
+	} while (0)
+#define GLES2_DEBUG_POP \
+	do { \
+		if (gles2_debug_markers) { \
+			gles2_pop_marker(); \
+		} \
+	} while (0)
 
 #endif
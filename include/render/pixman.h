@@ -0,0 +1,95 @@
+#ifndef RENDER_PIXMAN_H
+#define RENDER_PIXMAN_H
+
+#include <pixman.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-util.h>
+#include <wlr/render/interface.h>
+#include <wlr/render/pixman.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_box.h>
+
+struct pixman_pixel_format {
+	uint32_t wl_format;
+	pixman_format_code_t pixman_format;
+	int bpp;
+	bool has_alpha;
+};
+
+const struct pixman_pixel_format *pixman_format_from_wl(
+	enum wl_shm_format fmt);
+const enum wl_shm_format *pixman_formats(size_t *len);
+
+struct pixman_thread_pool;
+
+/**
+ * Creates a pool of worker threads. The calling thread also takes part in
+ * running jobs, so a pool of zero workers runs everything inline.
+ */
+struct pixman_thread_pool *pixman_thread_pool_create(size_t workers);
+void pixman_thread_pool_destroy(struct pixman_thread_pool *pool);
+size_t pixman_thread_pool_size(struct pixman_thread_pool *pool);
+/**
+ * Runs `func` once for each index in [0, len) and waits for all of them to
+ * complete. Jobs may run concurrently and in any order.
+ */
+void pixman_thread_pool_run(struct pixman_thread_pool *pool, size_t len,
+	void (*func)(size_t index, void *data), void *data);
+
+enum wlr_pixman_command_type {
+	WLR_PIXMAN_COMMAND_FILL,
+	WLR_PIXMAN_COMMAND_FILL_REGION,
+	WLR_PIXMAN_COMMAND_COMPOSITE,
+};
+
+/**
+ * A recorded rendering operation. Commands are executed on flush, one tile of
+ * the target at a time, in recording order.
+ */
+struct wlr_pixman_command {
+	enum wlr_pixman_command_type type;
+	pixman_op_t op;
+	pixman_box32_t box; // affected area, in image coordinates
+	pixman_color_t color; // fill color, premultiplied
+
+	// WLR_PIXMAN_COMMAND_FILL_REGION only
+	pixman_region32_t *region;
+
+	// WLR_PIXMAN_COMMAND_COMPOSITE only
+	pixman_image_t *src; // referenced until the command is executed
+	pixman_transform_t transform; // destination to source
+	pixman_filter_t filter;
+	pixman_repeat_t repeat;
+	uint16_t alpha;
+};
+
+struct wlr_pixman_renderer {
+	struct wlr_renderer wlr_renderer;
+
+	pixman_image_t *image;
+	uint32_t viewport_width, viewport_height;
+
+	bool has_scissor;
+	struct wlr_box scissor; // in renderer coordinates
+
+	struct wl_array commands; // struct wlr_pixman_command
+	struct pixman_thread_pool *pool;
+};
+
+struct wlr_pixman_texture {
+	struct wlr_texture wlr_texture;
+
+	pixman_image_t *image;
+	int width, height;
+	bool has_alpha;
+};
+
+struct wlr_pixman_texture *pixman_get_texture(
+	struct wlr_texture *wlr_texture);
+struct wlr_texture *pixman_texture_from_pixels(enum wl_shm_format wl_fmt,
+	uint32_t stride, uint32_t width, uint32_t height, const void *data);
+
+#endif
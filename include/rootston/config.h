@@ -3,6 +3,7 @@
 
 #include <wlr/types/wlr_input_device.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_seat.h>
 
 #define ROOTS_CONFIG_DEFAULT_SEAT_NAME "seat0"
 
@@ -12,6 +13,7 @@ struct roots_output_config {
 	enum wl_output_transform transform;
 	int x, y;
 	float scale;
+	int max_render_time; // ms, or WLR_OUTPUT_MAX_RENDER_TIME_AUTO
 	struct wl_list link;
 	struct {
 		int width, height;
@@ -55,6 +57,7 @@ struct roots_cursor_config {
 	struct wlr_box *mapped_box;
 	char *theme;
 	char *default_image;
+	enum wlr_seat_pointer_frame_mode pointer_frames;
 	struct wl_list link;
 };
 
@@ -12,6 +12,7 @@
 #include <wlr/types/wlr_list.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_presentation_time.h>
 #include <wlr/types/wlr_primary_selection.h>
 #include <wlr/types/wlr_screenshooter.h>
 #include <wlr/types/wlr_wl_shell.h>
@@ -26,8 +27,26 @@
 #include "rootston/output.h"
 #include "rootston/view.h"
 
+#define ROOTS_VIEW_INDEX_CELL_SIZE 256
+#define ROOTS_VIEW_INDEX_BUCKETS 256
+// Interval at which hidden views get frame done events
+#define ROOTS_FRAME_DONE_FALLBACK_MS 1000
+
+/**
+ * A spatial hash of mapped views, keyed on the layout-space bounds of the
+ * areas accepting input. The layout is split in square cells, and each view
+ * is added to the buckets of all the cells it overlaps.
+ */
+struct roots_view_index {
+	struct wl_array buckets[ROOTS_VIEW_INDEX_BUCKETS]; // struct roots_view *
+	struct wl_array candidates; // struct roots_view *, scratch for lookups
+};
+
 struct roots_desktop {
 	struct wl_list views; // roots_view::link
+	struct roots_view_index view_index;
+	uint64_t stack_serial;
+	struct wl_event_source *frame_done_timer;
 
 	struct wl_list outputs; // roots_output::link
 	struct timespec last_frame;
@@ -51,6 +70,7 @@ struct roots_desktop {
 	struct wlr_input_inhibit_manager *input_inhibit;
 	struct wlr_linux_dmabuf *linux_dmabuf;
 	struct wlr_layer_shell *layer_shell;
+	struct wlr_presentation *presentation;
 
 	struct wl_listener new_output;
 	struct wl_listener layout_change;
@@ -88,6 +108,10 @@ void view_apply_damage(struct roots_view *view);
 void view_damage_whole(struct roots_view *view);
 void view_update_position(struct roots_view *view, double x, double y);
 void view_update_size(struct roots_view *view, uint32_t width, uint32_t height);
+void view_update_index(struct roots_view *view);
+void view_update_outputs(struct roots_view *view);
+void view_send_frame_done(struct roots_view *view, struct timespec *when);
+void view_raise(struct roots_view *view);
 void view_initial_focus(struct roots_view *view);
 void view_map(struct roots_view *view, struct wlr_surface *surface);
 void view_unmap(struct roots_view *view);
@@ -15,6 +15,9 @@ struct roots_output {
 
 	struct roots_view *fullscreen_view;
 	struct wl_list layers[4]; // layer_surface::link
+	// struct roots_view *, mapped views intersecting the output, sorted by
+	// stacking order before rendering
+	struct wl_array views;
 
 	struct timespec last_frame;
 	struct wlr_output_damage *damage;
@@ -33,6 +36,7 @@ void handle_new_output(struct wl_listener *listener, void *data);
 struct roots_view;
 struct roots_drag_icon;
 
+void output_update_view(struct roots_output *output, struct roots_view *view);
 void output_damage_whole(struct roots_output *output);
 void output_damage_whole_view(struct roots_output *output,
 	struct roots_view *view);
@@ -1,6 +1,7 @@
 #ifndef ROOTSTON_VIEW_H
 #define ROOTSTON_VIEW_H
 #include <stdbool.h>
+#include <time.h>
 #include <wlr/config.h>
 #include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_surface.h>
@@ -82,6 +83,16 @@ enum roots_view_type {
 struct roots_view {
 	struct roots_desktop *desktop;
 	struct wl_list link; // roots_desktop::views
+	uint64_t stack_serial; // higher is closer to the top of the stack
+
+	bool indexed; // whether the view is in roots_desktop::view_index
+	struct wlr_box index_box; // layout-space bounds of the input areas
+
+	// Output sending frame done events to the view, to send them only once
+	// per frame
+	struct roots_output *primary_output;
+	int n_outputs; // number of outputs intersecting the view
+	struct timespec last_frame_done;
 
 	double x, y;
 	uint32_t width, height;
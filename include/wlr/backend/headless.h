@@ -11,12 +11,34 @@
  */
 struct wlr_backend *wlr_headless_backend_create(struct wl_display *display);
 /**
- * Create a new headless output backed by an in-memory EGL framebuffer. You can
- * read pixels from this framebuffer via wlr_renderer_read_pixels but it is
- * otherwise not displayed.
+ * Creates a headless backend rendering on the CPU with the pixman renderer,
+ * which doesn't require any GPU or EGL implementation.
+ * wlr_headless_backend_create falls back to this if EGL can't be initialized.
+ */
+struct wlr_backend *wlr_headless_backend_create_software(
+	struct wl_display *display);
+/**
+ * Create a new headless output backed by a ring of in-memory framebuffers
+ * (textures attached to FBOs, or pixman images for software backends). You
+ * can read pixels from these framebuffers via wlr_renderer_read_pixels but
+ * they are otherwise not displayed.
  */
 struct wlr_output *wlr_headless_add_output(struct wlr_backend *backend,
 	unsigned int width, unsigned int height);
+/**
+ * Sets how many buffers the output cycles through, between 1 and 4. Two
+ * buffers are used by default. Buffer ages are reported like on real
+ * hardware, so damage tracking behaves the same. The contents of the buffers
+ * are lost.
+ */
+bool wlr_headless_output_set_buffer_count(struct wlr_output *output,
+	size_t n_buffers);
+/**
+ * Binds the buffer presented by the last swap for reading, so that
+ * wlr_renderer_read_pixels returns what is "on screen". Returns false if no
+ * buffer has been presented yet.
+ */
+bool wlr_headless_output_bind_front_buffer(struct wlr_output *output);
 /**
  * Creates a new input device. The caller is responsible for manually raising
  * any event signals on the new input device if it wants to simulate input
@@ -24,6 +46,14 @@ struct wlr_output *wlr_headless_add_output(struct wlr_backend *backend,
  */
 struct wlr_input_device *wlr_headless_add_input_device(
 	struct wlr_backend *backend, enum wlr_input_device_type type);
+/**
+ * In unthrottled mode, outputs signal a new frame as soon as the previous one
+ * has been swapped instead of waiting for the next virtual vblank. This is
+ * useful to measure compositor throughput. Unthrottled mode can also be
+ * enabled by setting WLR_HEADLESS_UNTHROTTLED=1.
+ */
+void wlr_headless_backend_set_unthrottled(struct wlr_backend *backend,
+	bool unthrottled);
 bool wlr_backend_is_headless(struct wlr_backend *backend);
 bool wlr_input_device_is_headless(struct wlr_input_device *device);
 bool wlr_output_is_headless(struct wlr_output *output);
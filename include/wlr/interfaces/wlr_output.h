@@ -33,6 +33,16 @@ void wlr_output_update_custom_mode(struct wlr_output *output, int32_t width,
 	int32_t height, int32_t refresh);
 void wlr_output_update_enabled(struct wlr_output *output, bool enabled);
 void wlr_output_update_needs_swap(struct wlr_output *output);
+/**
+ * Sends a `frame` event. It may be delayed until the render deadline, see
+ * wlr_output_set_max_render_time.
+ */
 void wlr_output_send_frame(struct wlr_output *output);
+/**
+ * Sends a `present` event, when a frame is displayed. If the time isn't known,
+ * set `when` to NULL. Backends should call this before wlr_output_send_frame.
+ */
+void wlr_output_send_present(struct wlr_output *output, struct timespec *when,
+	unsigned seq, uint32_t flags);
 
 #endif
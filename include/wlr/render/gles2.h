@@ -6,7 +6,19 @@
 
 struct wlr_egl;
 
+/**
+ * Creates a GLES2 renderer. It caches GL state (bound program, buffers and
+ * textures, blending and scissoring) and assumes it's the only user of its EGL
+ * context: code issuing its own GL calls on the context must call
+ * wlr_gles2_renderer_reset_state before the renderer is used again.
+ */
 struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl);
+/**
+ * Restores the GL state the renderer relies on and invalidates its cache, after
+ * GL calls made outside of the renderer. The renderer's EGL context must be
+ * current.
+ */
+void wlr_gles2_renderer_reset_state(struct wlr_renderer *renderer);
 
 struct wlr_texture *wlr_gles2_texture_from_pixels(struct wlr_egl *egl,
 	enum wl_shm_format wl_fmt, uint32_t stride, uint32_t width, uint32_t height,
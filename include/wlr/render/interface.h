@@ -3,7 +3,9 @@
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
+#include <pixman.h>
 #include <stdbool.h>
+#include <time.h>
 #include <wayland-server-protocol.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/render/wlr_texture.h>
@@ -15,6 +17,10 @@ struct wlr_renderer_impl;
 
 struct wlr_renderer {
 	const struct wlr_renderer_impl *impl;
+
+	// Updated by the wlr_renderer and wlr_texture functions
+	struct wlr_render_stats stats;
+	struct timespec begin_time;
 };
 
 struct wlr_renderer_impl {
@@ -26,6 +32,12 @@ struct wlr_renderer_impl {
 	bool (*render_texture_with_matrix)(struct wlr_renderer *renderer,
 		struct wlr_texture *texture, const float matrix[static 9],
 		float alpha);
+	bool (*render_texture_with_matrix_region)(struct wlr_renderer *renderer,
+		struct wlr_texture *texture, const float matrix[static 9],
+		float alpha, pixman_region32_t *region);
+	bool (*render_opaque_texture_with_matrix_region)(
+		struct wlr_renderer *renderer, struct wlr_texture *texture,
+		const float matrix[static 9], pixman_region32_t *region);
 	void (*render_quad_with_matrix)(struct wlr_renderer *renderer,
 		const float color[static 4], const float matrix[static 9]);
 	void (*render_ellipse_with_matrix)(struct wlr_renderer *renderer,
@@ -45,6 +57,14 @@ struct wlr_renderer_impl {
 		uint32_t stride, uint32_t width, uint32_t height,
 		uint32_t src_x, uint32_t src_y, uint32_t dst_x, uint32_t dst_y,
 		void *data);
+	struct wlr_renderer_readback *(*readback_start)(
+		struct wlr_renderer *renderer, enum wl_shm_format fmt,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y);
+	bool (*readback_finish)(struct wlr_renderer *renderer,
+		struct wlr_renderer_readback *readback, uint32_t stride,
+		uint32_t dst_x, uint32_t dst_y, void *data);
+	void (*readback_destroy)(struct wlr_renderer *renderer,
+		struct wlr_renderer_readback *readback);
 	bool (*format_supported)(struct wlr_renderer *renderer,
 		enum wl_shm_format fmt);
 	struct wlr_texture *(*texture_from_pixels)(struct wlr_renderer *renderer,
@@ -54,12 +74,23 @@ struct wlr_renderer_impl {
 		struct wl_resource *data);
 	struct wlr_texture *(*texture_from_dmabuf)(struct wlr_renderer *renderer,
 		struct wlr_dmabuf_buffer_attribs *attribs);
+	int64_t (*get_gpu_time)(struct wlr_renderer *renderer, uint64_t frame);
 	void (*destroy)(struct wlr_renderer *renderer);
 };
 
 void wlr_renderer_init(struct wlr_renderer *renderer,
 	const struct wlr_renderer_impl *impl);
 
+struct wlr_renderer_readback {
+	enum wl_shm_format fmt;
+	uint32_t width, height;
+
+	// Only set if the readback has been emulated with a synchronous
+	// read_pixels, rows are stored top to bottom
+	void *pixels;
+	uint32_t stride;
+};
+
 struct wlr_texture_impl {
 	void (*get_size)(struct wlr_texture *texture, int *width, int *height);
 	bool (*write_pixels)(struct wlr_texture *texture,
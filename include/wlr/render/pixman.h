@@ -0,0 +1,31 @@
+#ifndef WLR_RENDER_PIXMAN_H
+#define WLR_RENDER_PIXMAN_H
+
+#include <pixman.h>
+#include <stdbool.h>
+#include <wlr/render/wlr_renderer.h>
+
+/**
+ * Creates a software renderer drawing into pixman images. Rendering
+ * operations are recorded and composited in parallel when flushed.
+ */
+struct wlr_renderer *wlr_pixman_renderer_create(void);
+
+bool wlr_renderer_is_pixman(struct wlr_renderer *renderer);
+
+/**
+ * Sets the image subsequent rendering operations draw into. Pending
+ * operations on the previously bound image are flushed first. The image must
+ * use a 32bpp format and must outlive its binding.
+ */
+void wlr_pixman_renderer_bind_image(struct wlr_renderer *renderer,
+	pixman_image_t *image);
+
+/**
+ * Executes all pending rendering operations on the bound image. This is done
+ * automatically by wlr_renderer_end, but operations issued outside of a
+ * begin/end pair (e.g. software cursors) need an explicit flush.
+ */
+void wlr_pixman_renderer_flush(struct wlr_renderer *renderer);
+
+#endif
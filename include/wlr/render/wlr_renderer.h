@@ -1,6 +1,7 @@
 #ifndef WLR_RENDER_WLR_RENDERER_H
 #define WLR_RENDER_WLR_RENDERER_H
 
+#include <pixman.h>
 #include <stdint.h>
 #include <wayland-server-protocol.h>
 #include <wlr/render/wlr_texture.h>
@@ -9,9 +10,37 @@
 struct wlr_output;
 
 struct wlr_renderer;
+struct wlr_renderer_readback;
+
+/**
+ * Statistics about the work done by a renderer for a frame, ie. since the
+ * last call to wlr_renderer_begin.
+ */
+struct wlr_render_stats {
+	uint64_t frame; // sequence number of the frame
+	size_t draw_calls;
+	size_t rects; // scissor boxes and region rectangles drawn
+	size_t uploaded_bytes; // pixel data uploaded to textures
+	size_t imported_textures; // wl_drm and dmabuf imports
+	int64_t cpu_time_ns; // time between begin and end, -1 if not ended yet
+	int64_t gpu_time_ns; // -1 if unknown
+};
 
 void wlr_renderer_begin(struct wlr_renderer *r, int width, int height);
 void wlr_renderer_end(struct wlr_renderer *r);
+/**
+ * Gets the statistics of the current frame, or the last one if the renderer
+ * is not rendering. The GPU time is never set, see
+ * wlr_renderer_get_gpu_time.
+ */
+const struct wlr_render_stats *wlr_renderer_get_stats(struct wlr_renderer *r);
+/**
+ * Gets the time the GPU spent on a frame, in nanoseconds. `frame` is the
+ * sequence number from its stats. This doesn't block: -1 is returned if the
+ * renderer doesn't support timer queries, if the frame is still being
+ * rendered or if it is too old.
+ */
+int64_t wlr_renderer_get_gpu_time(struct wlr_renderer *r, uint64_t frame);
 void wlr_renderer_clear(struct wlr_renderer *r, const float color[static 4]);
 /**
  * Defines a scissor box. Only pixels that lie within the scissor box can be
@@ -29,6 +58,25 @@ bool wlr_render_texture(struct wlr_renderer *r, struct wlr_texture *texture,
  */
 bool wlr_render_texture_with_matrix(struct wlr_renderer *r,
 	struct wlr_texture *texture, const float matrix[static 9], float alpha);
+/**
+ * Renders the requested texture using the provided matrix, only touching the
+ * pixels inside `region`. The region is in renderer coordinates, like the
+ * scissor box. This is equivalent to scissoring each rectangle of the region
+ * and rendering the texture, but renderers can batch all rectangles in a
+ * single draw call. The scissor box is left disabled afterwards.
+ */
+bool wlr_render_texture_with_matrix_region(struct wlr_renderer *r,
+	struct wlr_texture *texture, const float matrix[static 9], float alpha,
+	pixman_region32_t *region);
+/**
+ * Same as wlr_render_texture_with_matrix_region, but the parts of `region`
+ * inside `opaque` are known to be fully opaque. Renderers can draw them
+ * without blending, which saves memory bandwidth. Both regions are in renderer
+ * coordinates.
+ */
+bool wlr_render_texture_with_matrix_opaque_region(struct wlr_renderer *r,
+	struct wlr_texture *texture, const float matrix[static 9], float alpha,
+	pixman_region32_t *region, pixman_region32_t *opaque);
 /**
  * Renders a solid rectangle in the specified color.
  */
@@ -87,6 +135,27 @@ bool wlr_renderer_check_import_dmabuf(struct wlr_renderer *renderer,
 bool wlr_renderer_read_pixels(struct wlr_renderer *r, enum wl_shm_format fmt,
 	uint32_t stride, uint32_t width, uint32_t height,
 	uint32_t src_x, uint32_t src_y, uint32_t dst_x, uint32_t dst_y, void *data);
+/**
+ * Starts reading out pixels of the currently bound surface without waiting
+ * for rendering to complete. The pixels are retrieved later with
+ * wlr_renderer_readback_finish, ideally one frame later so that the GPU has
+ * caught up in the meantime. Returns NULL on error.
+ */
+struct wlr_renderer_readback *wlr_renderer_readback_start(
+	struct wlr_renderer *r, enum wl_shm_format fmt, uint32_t width,
+	uint32_t height, uint32_t src_x, uint32_t src_y);
+/**
+ * Copies the pixels of a readback into data and destroys the readback.
+ * `stride` is in bytes. Blocks if the GPU hasn't finished rendering yet.
+ */
+bool wlr_renderer_readback_finish(struct wlr_renderer *r,
+	struct wlr_renderer_readback *readback, uint32_t stride, uint32_t dst_x,
+	uint32_t dst_y, void *data);
+/**
+ * Destroys a readback without retrieving its pixels.
+ */
+void wlr_renderer_readback_destroy(struct wlr_renderer *r,
+	struct wlr_renderer_readback *readback);
 /**
  * Checks if a format is supported.
  */
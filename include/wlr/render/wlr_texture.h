@@ -12,6 +12,9 @@ struct wlr_texture_impl;
 
 struct wlr_texture {
 	const struct wlr_texture_impl *impl;
+	// Renderer that created this texture, NULL if the texture wasn't created
+	// through a renderer
+	struct wlr_renderer *renderer;
 };
 
 /**
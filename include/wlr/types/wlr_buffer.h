@@ -0,0 +1,38 @@
+#ifndef WLR_TYPES_WLR_BUFFER_H
+#define WLR_TYPES_WLR_BUFFER_H
+
+#include <stddef.h>
+#include <wayland-server.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+
+/**
+ * A client buffer imported into a renderer. The import is cached for the
+ * lifetime of the wl_buffer resource, so that clients cycling through the
+ * same few buffers only pay for it once.
+ */
+struct wlr_buffer {
+	struct wl_resource *resource; // NULL if the client destroyed it
+	struct wlr_renderer *renderer;
+	struct wlr_texture *texture;
+
+	size_t n_refs;
+
+	struct wl_listener resource_destroy;
+};
+
+/**
+ * Gets the imported buffer for a dmabuf or wl_drm buffer resource, importing
+ * it if it's not in the cache yet. Returns a new reference, or NULL if the
+ * buffer cannot be imported. shm buffers are not supported.
+ */
+struct wlr_buffer *wlr_buffer_get(struct wlr_renderer *renderer,
+	struct wl_resource *resource);
+struct wlr_buffer *wlr_buffer_ref(struct wlr_buffer *buffer);
+/**
+ * Drops a reference to the buffer. The texture is destroyed along with the
+ * last reference.
+ */
+void wlr_buffer_unref(struct wlr_buffer *buffer);
+
+#endif
@@ -6,6 +6,8 @@
 #include <time.h>
 #include <wayland-server.h>
 #include <wayland-util.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/util/arena.h>
 
 struct wlr_output_mode {
 	uint32_t flags; // enum wl_output_mode
@@ -38,6 +40,31 @@ struct wlr_output_cursor {
 
 struct wlr_output_impl;
 
+#define WLR_OUTPUT_MAX_RENDER_TIME_AUTO -1
+
+/**
+ * Presentation flags, with the same values as the presentation-time protocol.
+ */
+enum wlr_output_present_flag {
+	// The presentation was synchronized to the vertical retrace
+	WLR_OUTPUT_PRESENT_VSYNC = 0x1,
+	// The presentation timestamp was generated by the hardware
+	WLR_OUTPUT_PRESENT_HW_CLOCK = 0x2,
+	// The hardware signaled the completion of the presentation
+	WLR_OUTPUT_PRESENT_HW_COMPLETION = 0x4,
+	// The buffer was scanned out directly, without a copy
+	WLR_OUTPUT_PRESENT_ZERO_COPY = 0x8,
+};
+
+struct wlr_output_event_present {
+	struct wlr_output *output;
+	// Time the frame was displayed, in the CLOCK_MONOTONIC domain
+	struct timespec *when;
+	unsigned seq; // vertical retrace counter, zero if unknown
+	int refresh; // nanoseconds between retraces, zero if unknown
+	uint32_t flags; // enum wlr_output_present_flag
+};
+
 /**
  * A compositor output region. This typically corresponds to a monitor that
  * displays part of the compositor space.
@@ -77,11 +104,27 @@ struct wlr_output {
 	pixman_region32_t damage;
 	bool frame_pending;
 	float transform_matrix[9];
+	// Scratch memory for the frame being rendered, reset when buffers are
+	// swapped
+	struct wlr_arena frame_arena;
+
+	// Frame scheduling, see wlr_output_set_max_render_time
+	int max_render_time; // ms, or WLR_OUTPUT_MAX_RENDER_TIME_AUTO
+	int64_t render_time_estimate_ns; // measured, -1 if unknown
+	struct timespec last_vblank; // zero if unknown, see the present event
+	struct wl_event_source *frame_timer;
+	bool frame_deferred; // the frame event waits for frame_timer
+
+	// Rendering statistics of the last frame. Updated when buffers are
+	// swapped, the GPU time is filled in by the next `frame` event if the
+	// renderer supports it.
+	struct wlr_render_stats render_stats;
 
 	struct {
 		struct wl_signal frame;
 		struct wl_signal needs_swap;
 		struct wl_signal swap_buffers;
+		struct wl_signal present; // wlr_output_event_present
 		struct wl_signal enable;
 		struct wl_signal mode;
 		struct wl_signal scale;
@@ -159,6 +202,17 @@ bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
  * it is a no-op.
  */
 void wlr_output_schedule_frame(struct wlr_output *output);
+/**
+ * Sets the time needed to render a frame, in milliseconds. The `frame` event
+ * is delayed until this long before the next vblank, so that rendering picks
+ * up the most recent client and input state. This requires the backend to
+ * send vsync'ed `present` events, the `frame` event is sent as soon as
+ * possible otherwise.
+ *
+ * Zero disables the delay (the default). WLR_OUTPUT_MAX_RENDER_TIME_AUTO uses
+ * the render times measured on previous frames, plus some margin.
+ */
+void wlr_output_set_max_render_time(struct wlr_output *output, int ms);
 void wlr_output_set_gamma(struct wlr_output *output,
 	uint32_t size, uint16_t *r, uint16_t *g, uint16_t *b);
 uint32_t wlr_output_get_gamma_size(struct wlr_output *output);
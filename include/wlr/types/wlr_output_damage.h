@@ -9,9 +9,20 @@
 /**
  * Damage tracking requires to keep track of previous frames' damage. To allow
  * damage tracking to work with triple buffering, a history of two frames is
- * required.
+ * required. This is the initial length of the history, it grows when the
+ * backend hands out older buffers.
  */
 #define WLR_OUTPUT_DAMAGE_PREVIOUS_LEN 2
+/**
+ * Default limit for the length of the damage history.
+ */
+#define WLR_OUTPUT_DAMAGE_MAX_PREVIOUS_LEN 8
+/**
+ * Default policy used to simplify accumulated damage, see
+ * wlr_region_simplify.
+ */
+#define WLR_OUTPUT_DAMAGE_MAX_RECTS 32
+#define WLR_OUTPUT_DAMAGE_MAX_OVERDRAW 1.25f
 
 /**
  * Tracks damage for an output.
@@ -25,10 +36,20 @@ struct wlr_output_damage {
 	struct wlr_output *output;
 
 	pixman_region32_t current; // in output-local coordinates
+	// policy used to simplify current damage, can be changed
+	int max_rects;
+	float max_overdraw;
 
-	// circular queue for previous damage
-	pixman_region32_t previous[WLR_OUTPUT_DAMAGE_PREVIOUS_LEN];
+	// circular queue for previous damage, the most recent frame is at
+	// previous_idx
+	pixman_region32_t *previous;
+	size_t previous_len, max_previous_len;
 	size_t previous_idx;
+	size_t previous_valid; // number of frames actually recorded
+
+	// number of frames rendered, and how many of them had to be repainted
+	// entirely because the buffer age was unknown or older than the history
+	size_t frame_count, full_repaint_count;
 
 	struct {
 		struct wl_signal frame;
@@ -45,6 +66,13 @@ struct wlr_output_damage {
 
 struct wlr_output_damage *wlr_output_damage_create(struct wlr_output *output);
 void wlr_output_damage_destroy(struct wlr_output_damage *output_damage);
+/**
+ * Sets the maximum length of the damage history. The history grows up to this
+ * length when the backend hands out buffers older than it can handle, which
+ * would otherwise cause full repaints. Returns false on allocation failure.
+ */
+bool wlr_output_damage_set_max_previous_len(
+	struct wlr_output_damage *output_damage, size_t max_len);
 /**
  * Makes the output rendering context current. `needs_swap` is set to true if
  * `wlr_output_damage_swap_buffers` needs to be called. The region of the output
@@ -15,6 +15,8 @@ struct wlr_pointer {
 		struct wl_signal motion_absolute;
 		struct wl_signal button;
 		struct wl_signal axis;
+		// Emitted after a set of events that happened at the same time
+		struct wl_signal frame;
 	} events;
 
 	void *data;
@@ -0,0 +1,62 @@
+#ifndef WLR_TYPES_WLR_PRESENTATION_TIME_H
+#define WLR_TYPES_WLR_PRESENTATION_TIME_H
+
+#include <stdbool.h>
+#include <time.h>
+#include <wayland-server.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_surface.h>
+
+/**
+ * Implements the presentation-time protocol, which tells clients when their
+ * frames are displayed.
+ *
+ * Compositors must call wlr_presentation_surface_sampled_on_output when they
+ * render a surface. Feedback is then sent when the output presents the frame
+ * containing it.
+ */
+struct wlr_presentation {
+	struct wl_global *global;
+	struct wl_list resources; // wl_resource_get_link
+	struct wl_list feedbacks; // wlr_presentation_feedback::link
+	clockid_t clock;
+
+	struct {
+		struct wl_signal destroy;
+	} events;
+
+	struct wl_listener display_destroy;
+};
+
+struct wlr_presentation_feedback {
+	struct wl_resource *resource;
+	struct wlr_presentation *presentation;
+	struct wlr_surface *surface;
+	struct wl_list link; // wlr_presentation::feedbacks
+
+	// Applies to the current surface content once the surface is committed
+	bool committed;
+
+	// Set when the surface content is sampled by an output, feedback is sent
+	// on the output's first presentation after buffers have been swapped
+	struct wlr_output *output;
+	bool output_swapped;
+
+	struct wl_listener surface_commit;
+	struct wl_listener surface_destroy;
+	struct wl_listener output_swap_buffers;
+	struct wl_listener output_present;
+	struct wl_listener output_destroy;
+};
+
+struct wlr_presentation *wlr_presentation_create(struct wl_display *display);
+void wlr_presentation_destroy(struct wlr_presentation *presentation);
+/**
+ * Marks the current content of the surface as sampled by the output, ie.
+ * rendered in the output's next frame.
+ */
+void wlr_presentation_surface_sampled_on_output(
+	struct wlr_presentation *presentation, struct wlr_surface *surface,
+	struct wlr_output *output);
+
+#endif
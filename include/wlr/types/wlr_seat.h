@@ -62,6 +62,8 @@ struct wlr_pointer_grab_interface {
 			uint32_t button, uint32_t state);
 	void (*axis)(struct wlr_seat_pointer_grab *grab, uint32_t time,
 			enum wlr_axis_orientation orientation, double value);
+	// Optional, wlr_seat_pointer_send_frame is called if NULL
+	void (*frame)(struct wlr_seat_pointer_grab *grab);
 	void (*cancel)(struct wlr_seat_pointer_grab *grab);
 };
 
@@ -124,6 +126,21 @@ struct wlr_seat_pointer_grab {
 	void *data;
 };
 
+/**
+ * How pointer events sent to clients are grouped into frames, see
+ * `wlr_seat_pointer_set_frame_mode()`.
+ */
+enum wlr_seat_pointer_frame_mode {
+	// Every event is followed by a frame event
+	WLR_SEAT_POINTER_FRAME_EACH_EVENT,
+	// Frame events are sent at the hardware frame boundaries reported by
+	// `wlr_seat_pointer_notify_frame()`
+	WLR_SEAT_POINTER_FRAME_HARDWARE,
+	// Motion and axis events are accumulated and sent in a single frame by
+	// `wlr_seat_pointer_flush()`
+	WLR_SEAT_POINTER_FRAME_COALESCE,
+};
+
 struct wlr_seat_pointer_state {
 	struct wlr_seat *seat;
 	struct wlr_seat_client *focused_client;
@@ -137,6 +154,21 @@ struct wlr_seat_pointer_state {
 	uint32_t grab_serial;
 	uint32_t grab_time;
 
+	enum wlr_seat_pointer_frame_mode frame_mode;
+	// Events have been sent to the focused client since the last frame
+	bool frame_pending;
+
+	// Events accumulated in WLR_SEAT_POINTER_FRAME_COALESCE mode
+	bool motion_pending;
+	uint32_t motion_time;
+	double motion_sx, motion_sy;
+	struct {
+		bool pending, stop;
+		uint32_t time;
+		double value;
+	} axis[2]; // indexed by enum wlr_axis_orientation
+	struct wl_event_source *flush_timer;
+
 	struct wl_listener surface_destroy;
 	struct wl_listener resource_destroy;
 };
@@ -305,6 +337,37 @@ uint32_t wlr_seat_pointer_send_button(struct wlr_seat *wlr_seat, uint32_t time,
 void wlr_seat_pointer_send_axis(struct wlr_seat *wlr_seat, uint32_t time,
 		enum wlr_axis_orientation orientation, double value);
 
+/**
+ * Send a frame event to the surface with pointer focus, if events have been
+ * sent to it since the last one. Compositors should use
+ * `wlr_seat_pointer_notify_frame()` to send frame events to respect pointer
+ * grabs.
+ */
+void wlr_seat_pointer_send_frame(struct wlr_seat *wlr_seat);
+
+/**
+ * Set how pointer events are grouped into frames. By default, every event is
+ * followed by a frame event.
+ *
+ * In WLR_SEAT_POINTER_FRAME_HARDWARE mode, frames follow the hardware frames
+ * reported with `wlr_seat_pointer_notify_frame()`.
+ *
+ * In WLR_SEAT_POINTER_FRAME_COALESCE mode, motion and axis events are
+ * accumulated: only the last position and the sum of axis values are sent,
+ * by `wlr_seat_pointer_flush()`. Compositors should call it once per output
+ * refresh, eg. when outputs send the frame event. Accumulated events are also
+ * sent before any other pointer event, to preserve ordering, and after a short
+ * timeout if the compositor doesn't flush them.
+ */
+void wlr_seat_pointer_set_frame_mode(struct wlr_seat *wlr_seat,
+		enum wlr_seat_pointer_frame_mode mode);
+
+/**
+ * Send the accumulated pointer events to the surface with pointer focus,
+ * followed by a frame event.
+ */
+void wlr_seat_pointer_flush(struct wlr_seat *wlr_seat);
+
 /**
  * Start a grab of the pointer of this seat. The grabber is responsible for
  * handling all pointer events until the grab ends.
@@ -346,6 +409,12 @@ uint32_t wlr_seat_pointer_notify_button(struct wlr_seat *wlr_seat,
 void wlr_seat_pointer_notify_axis(struct wlr_seat *wlr_seat, uint32_t time,
 		enum wlr_axis_orientation orientation, double value);
 
+/**
+ * Notify the seat of the end of a hardware pointer frame, ie. a set of events
+ * that happened at the same time.
+ */
+void wlr_seat_pointer_notify_frame(struct wlr_seat *wlr_seat);
+
 /**
  * Whether or not the pointer has a grab other than the default grab.
  */
@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <time.h>
 #include <wayland-server.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_output.h>
 
 struct wlr_frame_callback {
@@ -67,6 +68,11 @@ struct wlr_surface {
 	struct wl_resource *resource;
 	struct wlr_renderer *renderer;
 	struct wlr_texture *texture;
+	// owns the texture of imported buffers, NULL for shm buffers
+	struct wlr_buffer *buffer;
+	// shm buffer damage not uploaded to the texture yet, in buffer
+	// coordinates
+	pixman_region32_t upload_damage;
 	struct wlr_surface_state *current, *pending;
 	const char *role; // the lifetime-bound role or null
 
@@ -119,6 +125,14 @@ int wlr_surface_set_role(struct wlr_surface *surface, const char *role,
  */
 bool wlr_surface_has_buffer(struct wlr_surface *surface);
 
+/**
+ * Get the texture of the surface's current buffer, or NULL if it has none.
+ * shm buffers are uploaded lazily, the first time the texture is needed after
+ * a commit. Call this right before sampling the texture rather than accessing
+ * the texture field directly.
+ */
+struct wlr_texture *wlr_surface_get_texture(struct wlr_surface *surface);
+
 /**
  * Create the subsurface implementation for this surface.
  */
@@ -0,0 +1,35 @@
+#ifndef WLR_UTIL_ARENA_H
+#define WLR_UTIL_ARENA_H
+
+#include <stddef.h>
+
+struct wlr_arena_chunk;
+
+/**
+ * A bump allocator for short-lived scratch memory, eg. temporaries that only
+ * live for the duration of a frame. Allocations are never freed individually,
+ * they all become invalid at once when the arena is reset.
+ *
+ * After a reset, the arena keeps a single chunk large enough for everything
+ * that was allocated since the previous reset, so that a steady workload
+ * doesn't hit the heap at all.
+ */
+struct wlr_arena {
+	struct wlr_arena_chunk *chunk; // most recent chunk
+	size_t used; // bytes used in the most recent chunk
+	size_t allocated; // bytes allocated since the last reset
+};
+
+void wlr_arena_init(struct wlr_arena *arena);
+void wlr_arena_finish(struct wlr_arena *arena);
+/**
+ * Allocates `size` bytes, suitably aligned for any type. Returns NULL if the
+ * system is out of memory.
+ */
+void *wlr_arena_alloc(struct wlr_arena *arena, size_t size);
+/**
+ * Invalidates all allocations made from the arena.
+ */
+void wlr_arena_reset(struct wlr_arena *arena);
+
+#endif
@@ -4,6 +4,8 @@
 #include <pixman.h>
 #include <wayland-server.h>
 
+struct wlr_arena;
+
 /**
  * Scales a region, ie. multiplies all its coordinates by `scale`.
  *
@@ -19,9 +21,18 @@ void wlr_region_scale(pixman_region32_t *dst, pixman_region32_t *src,
 void wlr_region_transform(pixman_region32_t *dst, pixman_region32_t *src,
 	enum wl_output_transform transform, int width, int height);
 
+/**
+ * Same as wlr_region_transform, but scratch rectangles that don't fit on the
+ * stack are allocated from `arena` instead of the heap. The resulting region
+ * is a regular heap-allocated pixman region.
+ */
+void wlr_region_transform_arena(pixman_region32_t *dst,
+	pixman_region32_t *src, enum wl_output_transform transform,
+	int width, int height, struct wlr_arena *arena);
+
 /**
  * Expands the region of `distance`. If `distance` is negative, it shrinks the
- * region.
+ * region, rectangles that are too small to be shrunk are removed.
  */
 void wlr_region_expand(pixman_region32_t *dst, pixman_region32_t *src,
 	int distance);
@@ -33,4 +44,17 @@ void wlr_region_expand(pixman_region32_t *dst, pixman_region32_t *src,
 void wlr_region_rotated_bounds(pixman_region32_t *dst, pixman_region32_t *src,
 	float rotation, int ox, int oy);
 
+/**
+ * Simplifies a region into fewer, larger rectangles. The result always
+ * contains the original region.
+ *
+ * If the bounding box of the region is at most `max_overdraw` times as large
+ * as the region itself, the region is replaced by its bounding box. Otherwise,
+ * if the region has more than `max_rects` rectangles, each band of rectangles
+ * is collapsed into one and neighbouring bands are merged until there are at
+ * most `max_rects` of them. A `max_rects` of zero disables the latter.
+ */
+void wlr_region_simplify(pixman_region32_t *dst, pixman_region32_t *src,
+	int max_rects, float max_overdraw);
+
 #endif
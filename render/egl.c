@@ -180,6 +180,8 @@ bool wlr_egl_init(struct wlr_egl *egl, EGLenum platform, void *remote_display,
 
 	egl->egl_exts.bind_wayland_display =
 		check_egl_ext(egl->exts_str, "EGL_WL_bind_wayland_display");
+	egl->egl_exts.surfaceless_context =
+		check_egl_ext(egl->exts_str, "EGL_KHR_surfaceless_context");
 	print_dmabuf_formats(egl);
 
 	return true;
@@ -259,7 +261,13 @@ int wlr_egl_get_buffer_age(struct wlr_egl *egl, EGLSurface surface) {
 
 bool wlr_egl_make_current(struct wlr_egl *egl, EGLSurface surface,
 		int *buffer_age) {
-	if (!eglMakeCurrent(egl->display, surface, surface, egl->context)) {
+	// Querying the current context and surface doesn't involve the driver, so
+	// this is much cheaper than a redundant eglMakeCurrent
+	bool is_current = eglGetCurrentContext() == egl->context &&
+		eglGetCurrentSurface(EGL_DRAW) == surface &&
+		eglGetCurrentSurface(EGL_READ) == surface;
+	if (!is_current &&
+			!eglMakeCurrent(egl->display, surface, surface, egl->context)) {
 		wlr_log(L_ERROR, "eglMakeCurrent failed");
 		return false;
 	}
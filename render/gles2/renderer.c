@@ -4,16 +4,21 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wayland-server-protocol.h>
 #include <wayland-util.h>
 #include <wlr/render/egl.h>
 #include <wlr/render/interface.h>
 #include <wlr/render/wlr_renderer.h>
-#include <wlr/types/wlr_matrix.h>
 #include <wlr/util/log.h>
 #include "glapi.h"
 #include "render/gles2.h"
 
+// GLES3 token, not defined by the GLES2 headers
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
+#endif
+
 static const struct wlr_renderer_impl renderer_impl;
 
 static struct wlr_gles2_renderer *gles2_get_renderer(
@@ -29,17 +34,127 @@ static struct wlr_gles2_renderer *gles2_get_renderer_in_context(
 	return renderer;
 }
 
+static void gles2_use_program(struct wlr_gles2_renderer *renderer,
+		GLuint prog) {
+	if (renderer->state.program != prog) {
+		glUseProgram(prog);
+		renderer->state.program = prog;
+	}
+}
+
+static void gles2_set_blend(struct wlr_gles2_renderer *renderer, bool blend) {
+	if (renderer->state.blend_valid && renderer->state.blend == blend) {
+		return;
+	}
+	if (blend) {
+		glEnable(GL_BLEND);
+	} else {
+		glDisable(GL_BLEND);
+	}
+	renderer->state.blend = blend;
+	renderer->state.blend_valid = true;
+}
+
+static void gles2_set_scissor_test(struct wlr_gles2_renderer *renderer,
+		bool scissor) {
+	if (renderer->state.scissor_valid && renderer->state.scissor == scissor) {
+		return;
+	}
+	if (scissor) {
+		glEnable(GL_SCISSOR_TEST);
+	} else {
+		glDisable(GL_SCISSOR_TEST);
+	}
+	renderer->state.scissor = scissor;
+	renderer->state.scissor_valid = true;
+}
+
+static void gles2_bind_array_buffer(struct wlr_gles2_renderer *renderer,
+		GLuint buffer) {
+	if (renderer->state.array_buffer != buffer) {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		renderer->state.array_buffer = buffer;
+	}
+}
+
+void gles2_bind_texture(struct wlr_gles2_renderer *renderer, GLenum target,
+		GLuint tex) {
+	if (renderer == NULL) {
+		glBindTexture(target, tex);
+		return;
+	}
+
+	GLuint *bound = target == GL_TEXTURE_EXTERNAL_OES ?
+		&renderer->state.tex_ext : &renderer->state.tex_2d;
+	if (*bound != tex) {
+		glBindTexture(target, tex);
+		*bound = tex;
+	}
+}
+
+void gles2_forget_texture(struct wlr_gles2_renderer *renderer, GLuint tex) {
+	// Deleting a bound texture reverts the binding to zero, and the name may
+	// be reused by a new texture
+	if (renderer == NULL) {
+		return;
+	}
+	if (renderer->state.tex_2d == tex) {
+		renderer->state.tex_2d = 0;
+	}
+	if (renderer->state.tex_ext == tex) {
+		renderer->state.tex_ext = 0;
+	}
+}
+
+/**
+ * Sets up the GL state the renderer relies on and forgets the cached state,
+ * see wlr_gles2_renderer_reset_state.
+ */
+static void gles2_reset_state(struct wlr_gles2_renderer *renderer) {
+	// All our shaders use both attributes, they stay enabled
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	// We only ever sample from texture unit 0
+	glActiveTexture(GL_TEXTURE0);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	// Zero names are never cached, the next draw rebinds everything including
+	// the attribute pointers
+	renderer->state.program = 0;
+	renderer->state.array_buffer = 0;
+	renderer->state.tex_2d = 0;
+	renderer->state.tex_ext = 0;
+	renderer->state.blend_valid = false;
+	renderer->state.scissor_valid = false;
+}
+
+void wlr_gles2_renderer_reset_state(struct wlr_renderer *wlr_renderer) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+
+	GLES2_DEBUG_PUSH;
+	gles2_reset_state(renderer);
+	GLES2_DEBUG_POP;
+}
+
 static void gles2_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 		uint32_t height) {
-	gles2_get_renderer_in_context(wlr_renderer);
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
 
 	GLES2_DEBUG_PUSH;
 
-	glViewport(0, 0, width, height);
+	if (renderer->timer.supported && !renderer->timer.active) {
+		size_t i = renderer->timer.next;
+		glBeginQueryEXT(GL_TIME_ELAPSED_EXT, renderer->timer.queries[i]);
+		renderer->timer.frames[i] = wlr_renderer->stats.frame;
+		renderer->timer.times[i] = -1;
+		renderer->timer.active = true;
+	}
 
-	// enable transparency
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glViewport(0, 0, width, height);
+	renderer->viewport_width = width;
+	renderer->viewport_height = height;
 
 	// XXX: maybe we should save output projection and remove some of the need
 	// for users to sling matricies themselves
@@ -48,8 +163,15 @@ static void gles2_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
 }
 
 static void gles2_end(struct wlr_renderer *wlr_renderer) {
-	gles2_get_renderer_in_context(wlr_renderer);
-	// no-op
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+
+	if (renderer->timer.active) {
+		glEndQueryEXT(GL_TIME_ELAPSED_EXT);
+		renderer->timer.next =
+			(renderer->timer.next + 1) % GLES2_TIMER_QUERIES;
+		renderer->timer.active = false;
+	}
 }
 
 static void gles2_clear(struct wlr_renderer *wlr_renderer,
@@ -64,58 +186,81 @@ static void gles2_clear(struct wlr_renderer *wlr_renderer,
 
 static void gles2_scissor(struct wlr_renderer *wlr_renderer,
 		struct wlr_box *box) {
-	gles2_get_renderer_in_context(wlr_renderer);
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
 
 	GLES2_DEBUG_PUSH;
 	if (box != NULL) {
 		glScissor(box->x, box->y, box->width, box->height);
-		glEnable(GL_SCISSOR_TEST);
+		gles2_set_scissor_test(renderer, true);
 	} else {
-		glDisable(GL_SCISSOR_TEST);
+		gles2_set_scissor_test(renderer, false);
 	}
 	GLES2_DEBUG_POP;
 }
 
-static void draw_quad() {
-	GLfloat verts[] = {
-		1, 0, // top right
-		0, 0, // top left
-		1, 1, // bottom right
-		0, 1, // bottom left
-	};
-	GLfloat texcoord[] = {
-		1, 0, // top right
-		0, 0, // top left
-		1, 1, // bottom right
-		0, 1, // bottom left
-	};
-
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, texcoord);
+static void draw_quad(struct wlr_gles2_renderer *renderer) {
+	// Attribute pointers keep referring to the unit quad until we draw from
+	// the stream buffer
+	if (renderer->state.array_buffer != renderer->buffers.quad) {
+		gles2_bind_array_buffer(renderer, renderer->buffers.quad);
 
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
+		// Vertex positions and texture coordinates are the same
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	}
 
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
 
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
+/**
+ * Uploads vertices to the streaming vertex buffer and leaves it bound. Returns
+ * the byte offset of the data in the buffer.
+ */
+static GLintptr stream_verts(struct wlr_gles2_renderer *renderer,
+		const GLfloat *data, size_t len) {
+	size_t size = len * sizeof(GLfloat);
+
+	gles2_bind_array_buffer(renderer, renderer->buffers.stream);
+
+	if (size > renderer->buffers.stream_size) {
+		size_t stream_size = renderer->buffers.stream_size;
+		while (stream_size < size) {
+			stream_size *= 2;
+		}
+		renderer->buffers.stream_size = stream_size;
+		renderer->buffers.stream_offset = 0;
+		glBufferData(GL_ARRAY_BUFFER, stream_size, NULL, GL_STREAM_DRAW);
+	} else if (renderer->buffers.stream_offset + size >
+			renderer->buffers.stream_size) {
+		// Orphan the buffer when we reach its end, so that we don't have to
+		// wait for pending draws still reading from it
+		renderer->buffers.stream_offset = 0;
+		glBufferData(GL_ARRAY_BUFFER, renderer->buffers.stream_size, NULL,
+			GL_STREAM_DRAW);
+	}
+
+	GLintptr offset = renderer->buffers.stream_offset;
+	glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+	renderer->buffers.stream_offset += size;
+	return offset;
 }
 
-static bool gles2_render_texture_with_matrix(struct wlr_renderer *wlr_renderer,
-		struct wlr_texture *wlr_texture, const float matrix[static 9],
-		float alpha) {
-	struct wlr_gles2_renderer *renderer =
-		gles2_get_renderer_in_context(wlr_renderer);
-	struct wlr_gles2_texture *texture =
-		gles2_get_texture_in_context(wlr_texture);
+/**
+ * Sets up the program, texture and blending state to draw a texture. If
+ * `opaque` is set, the texture is drawn as if it had no alpha channel.
+ */
+static void gles2_use_texture_program(struct wlr_gles2_renderer *renderer,
+		struct wlr_gles2_texture *texture, const float matrix[static 9],
+		float alpha, bool opaque) {
+	bool has_alpha = texture->has_alpha && !opaque;
 
 	GLuint prog = 0;
 	GLenum target = 0;
 	switch (texture->type) {
 	case WLR_GLES2_TEXTURE_GLTEX:
 	case WLR_GLES2_TEXTURE_WL_DRM_GL:
-		prog = texture->has_alpha ? renderer->shaders.tex_rgba :
+		prog = has_alpha ? renderer->shaders.tex_rgba :
 			renderer->shaders.tex_rgbx;
 		target = GL_TEXTURE_2D;
 		break;
@@ -126,49 +271,198 @@ static bool gles2_render_texture_with_matrix(struct wlr_renderer *wlr_renderer,
 		break;
 	}
 
+	// Texture unit 0 is always active and filters are set when the texture
+	// is created
+	GLuint tex_id = texture->type == WLR_GLES2_TEXTURE_GLTEX ?
+		texture->gl_tex : texture->image_tex;
+	gles2_bind_texture(renderer, target, tex_id);
+
+	gles2_use_program(renderer, prog);
+	// Blending is only needed if the result can be translucent, it's
+	// expensive on bandwidth-limited GPUs
+	gles2_set_blend(renderer, has_alpha || alpha < 1.0f);
+
 	// OpenGL ES 2 requires the glUniformMatrix3fv transpose parameter to be set
-	// to GL_FALSE
-	float transposition[9];
-	wlr_matrix_transpose(transposition, matrix);
+	// to GL_FALSE, the shaders multiply by the row-major matrix on the right
+	glUniformMatrix3fv(0, 1, GL_FALSE, matrix);
+	glUniform1i(1, texture->inverted_y);
+	glUniform1f(3, alpha);
+}
+
+static bool gles2_render_texture_with_matrix(struct wlr_renderer *wlr_renderer,
+		struct wlr_texture *wlr_texture, const float matrix[static 9],
+		float alpha) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+	struct wlr_gles2_texture *texture =
+		gles2_get_texture_in_context(wlr_texture);
 
 	GLES2_DEBUG_PUSH;
+	gles2_use_texture_program(renderer, texture, matrix, alpha, false);
+	draw_quad(renderer);
+	GLES2_DEBUG_POP;
+	return true;
+}
 
-	GLuint tex_id = texture->type == WLR_GLES2_TEXTURE_GLTEX ?
-		texture->gl_tex : texture->image_tex;
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(target, tex_id);
+struct clip_vertex {
+	float pos[2]; // in renderer coordinates
+	float texcoord[2];
+};
 
-	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+/**
+ * Clips a convex polygon against the half-plane `sign * (pos[axis] - bound)
+ * >= 0`. `out` must be able to hold `len + 1` vertices. Texture coordinates are
+ * interpolated linearly, which is exact since the quad is an affine mapping of
+ * the unit square.
+ */
+static size_t clip_polygon(struct clip_vertex *out,
+		const struct clip_vertex *in, size_t len, int axis, float bound,
+		float sign) {
+	size_t out_len = 0;
+	for (size_t i = 0; i < len; ++i) {
+		const struct clip_vertex *cur = &in[i];
+		const struct clip_vertex *next = &in[(i + 1) % len];
+		float cur_dist = sign * (cur->pos[axis] - bound);
+		float next_dist = sign * (next->pos[axis] - bound);
+
+		if (cur_dist >= 0) {
+			out[out_len++] = *cur;
+		}
+		if ((cur_dist >= 0) != (next_dist >= 0)) {
+			float t = cur_dist / (cur_dist - next_dist);
+			struct clip_vertex *v = &out[out_len++];
+			for (int j = 0; j < 2; ++j) {
+				v->pos[j] = cur->pos[j] + t * (next->pos[j] - cur->pos[j]);
+				v->texcoord[j] = cur->texcoord[j] +
+					t * (next->texcoord[j] - cur->texcoord[j]);
+			}
+		}
+	}
+	return out_len;
+}
 
-	glUseProgram(prog);
+static GLfloat *gles2_reserve_verts(struct wlr_gles2_renderer *renderer,
+		size_t len) {
+	if (len > renderer->verts.cap) {
+		size_t cap = renderer->verts.cap ? renderer->verts.cap : 256;
+		while (cap < len) {
+			cap *= 2;
+		}
+		GLfloat *data = realloc(renderer->verts.data, cap * sizeof(GLfloat));
+		if (data == NULL) {
+			wlr_log_errno(L_ERROR, "Allocation failed");
+			return NULL;
+		}
+		renderer->verts.data = data;
+		renderer->verts.cap = cap;
+	}
+	return renderer->verts.data;
+}
 
-	glUniformMatrix3fv(0, 1, GL_FALSE, transposition);
-	glUniform1i(1, texture->inverted_y);
-	glUniform1f(3, alpha);
+static bool render_texture_region(struct wlr_gles2_renderer *renderer,
+		struct wlr_gles2_texture *texture, const float matrix[static 9],
+		float alpha, pixman_region32_t *region, bool opaque) {
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+	if (nrects == 0) {
+		return true;
+	}
+
+	// Corners of the textured quad in renderer coordinates. The matrix maps
+	// the unit square to normalized device coordinates.
+	struct clip_vertex quad[4] = {
+		{ .texcoord = { 0, 0 } },
+		{ .texcoord = { 1, 0 } },
+		{ .texcoord = { 1, 1 } },
+		{ .texcoord = { 0, 1 } },
+	};
+	for (size_t i = 0; i < 4; ++i) {
+		float u = quad[i].texcoord[0], v = quad[i].texcoord[1];
+		float x = matrix[0] * u + matrix[1] * v + matrix[2];
+		float y = matrix[3] * u + matrix[4] * v + matrix[5];
+		quad[i].pos[0] = (x + 1) * renderer->viewport_width / 2;
+		quad[i].pos[1] = (y + 1) * renderer->viewport_height / 2;
+	}
 
-	draw_quad();
+	// A quad clipped by a rectangle has at most 8 vertices, ie. 6 triangles
+	GLfloat *verts = gles2_reserve_verts(renderer, nrects * 6 * 3 * 2);
+	if (verts == NULL) {
+		return false;
+	}
+
+	size_t nverts = 0;
+	for (int i = 0; i < nrects; ++i) {
+		struct clip_vertex a[8], b[8];
+		size_t len = clip_polygon(a, quad, 4, 0, rects[i].x1, 1);
+		len = clip_polygon(b, a, len, 0, rects[i].x2, -1);
+		len = clip_polygon(a, b, len, 1, rects[i].y1, 1);
+		len = clip_polygon(b, a, len, 1, rects[i].y2, -1);
+
+		// The matrix maps texture coordinates back to the clipped positions,
+		// so we only need to upload texture coordinates
+		for (size_t j = 1; j + 1 < len; ++j) {
+			const struct clip_vertex *tri[] = { &b[0], &b[j], &b[j + 1] };
+			for (size_t k = 0; k < 3; ++k) {
+				verts[nverts * 2] = tri[k]->texcoord[0];
+				verts[nverts * 2 + 1] = tri[k]->texcoord[1];
+				++nverts;
+			}
+		}
+	}
+
+	GLES2_DEBUG_PUSH;
+
+	gles2_set_scissor_test(renderer, false);
+
+	if (nverts > 0) {
+		gles2_use_texture_program(renderer, texture, matrix, alpha, opaque);
+
+		GLintptr offset = stream_verts(renderer, verts, nverts * 2);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void *)offset);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void *)offset);
+
+		glDrawArrays(GL_TRIANGLES, 0, nverts);
+	}
 
 	GLES2_DEBUG_POP;
 	return true;
 }
 
+static bool gles2_render_texture_with_matrix_region(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const float matrix[static 9], float alpha, pixman_region32_t *region) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+	struct wlr_gles2_texture *texture =
+		gles2_get_texture_in_context(wlr_texture);
+	return render_texture_region(renderer, texture, matrix, alpha, region,
+		false);
+}
+
+static bool gles2_render_opaque_texture_with_matrix_region(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const float matrix[static 9], pixman_region32_t *region) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+	struct wlr_gles2_texture *texture =
+		gles2_get_texture_in_context(wlr_texture);
+	return render_texture_region(renderer, texture, matrix, 1.0f, region,
+		true);
+}
 
 static void gles2_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
 		const float color[static 4], const float matrix[static 9]) {
 	struct wlr_gles2_renderer *renderer =
 		gles2_get_renderer_in_context(wlr_renderer);
 
-	// OpenGL ES 2 requires the glUniformMatrix3fv transpose parameter to be set
-	// to GL_FALSE
-	float transposition[9];
-	wlr_matrix_transpose(transposition, matrix);
-
 	GLES2_DEBUG_PUSH;
-	glUseProgram(renderer->shaders.quad);
-	glUniformMatrix3fv(0, 1, GL_FALSE, transposition);
+	gles2_use_program(renderer, renderer->shaders.quad);
+	gles2_set_blend(renderer, color[3] < 1.0f);
+	// OpenGL ES 2 requires the glUniformMatrix3fv transpose parameter to be set
+	// to GL_FALSE, the shaders multiply by the row-major matrix on the right
+	glUniformMatrix3fv(0, 1, GL_FALSE, matrix);
 	glUniform4f(1, color[0], color[1], color[2], color[3]);
-	draw_quad();
+	draw_quad(renderer);
 	GLES2_DEBUG_POP;
 }
 
@@ -177,16 +471,15 @@ static void gles2_render_ellipse_with_matrix(struct wlr_renderer *wlr_renderer,
 	struct wlr_gles2_renderer *renderer =
 		gles2_get_renderer_in_context(wlr_renderer);
 
-	// OpenGL ES 2 requires the glUniformMatrix3fv transpose parameter to be set
-	// to GL_FALSE
-	float transposition[9];
-	wlr_matrix_transpose(transposition, matrix);
-
 	GLES2_DEBUG_PUSH;
-	glUseProgram(renderer->shaders.ellipse);
-	glUniformMatrix3fv(0, 1, GL_FALSE, transposition);
+	gles2_use_program(renderer, renderer->shaders.ellipse);
+	// The shader discards fragments outside of the ellipse
+	gles2_set_blend(renderer, color[3] < 1.0f);
+	// OpenGL ES 2 requires the glUniformMatrix3fv transpose parameter to be set
+	// to GL_FALSE, the shaders multiply by the row-major matrix on the right
+	glUniformMatrix3fv(0, 1, GL_FALSE, matrix);
 	glUniform4f(1, color[0], color[1], color[2], color[3]);
-	draw_quad();
+	draw_quad(renderer);
 	GLES2_DEBUG_POP;
 }
 
@@ -240,11 +533,51 @@ static bool gles2_check_import_dmabuf(struct wlr_renderer *wlr_renderer,
 	return wlr_egl_check_import_dmabuf(renderer->egl, dmabuf);
 }
 
+static void *gles2_reserve_pixels(struct wlr_gles2_renderer *renderer,
+		size_t size) {
+	if (size > renderer->pixels.cap) {
+		void *data = realloc(renderer->pixels.data, size);
+		if (data == NULL) {
+			wlr_log_errno(L_ERROR, "Allocation failed");
+			return NULL;
+		}
+		renderer->pixels.data = data;
+		renderer->pixels.cap = size;
+	}
+	return renderer->pixels.data;
+}
+
+/**
+ * Copies `height` rows of `row_len` bytes from bottom-to-top GL order into a
+ * top-to-bottom buffer. memcpy is already vectorized, so copying whole rows
+ * is as fast as it gets.
+ */
+static void copy_rows_flipped(unsigned char *dst, uint32_t dst_stride,
+		const unsigned char *src, uint32_t src_stride, size_t row_len,
+		uint32_t height) {
+	for (uint32_t i = 0; i < height; ++i) {
+		memcpy(dst + (size_t)i * dst_stride,
+			src + (size_t)(height - i - 1) * src_stride, row_len);
+	}
+}
+
+static void flip_rows(unsigned char *data, uint32_t stride, size_t row_len,
+		uint32_t height, unsigned char *tmp) {
+	for (uint32_t i = 0; i < height / 2; ++i) {
+		unsigned char *top = data + (size_t)i * stride;
+		unsigned char *bottom = data + (size_t)(height - i - 1) * stride;
+		memcpy(tmp, top, row_len);
+		memcpy(top, bottom, row_len);
+		memcpy(bottom, tmp, row_len);
+	}
+}
+
 static bool gles2_read_pixels(struct wlr_renderer *wlr_renderer,
 		enum wl_shm_format wl_fmt, uint32_t stride, uint32_t width,
 		uint32_t height, uint32_t src_x, uint32_t src_y, uint32_t dst_x,
 		uint32_t dst_y, void *data) {
-	gles2_get_renderer_in_context(wlr_renderer);
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
 
 	const struct gles2_pixel_format *fmt = gles2_format_from_wl(wl_fmt);
 	if (fmt == NULL) {
@@ -252,17 +585,35 @@ static bool gles2_read_pixels(struct wlr_renderer *wlr_renderer,
 		return false;
 	}
 
-	GLES2_DEBUG_PUSH;
+	// GLES2 doesn't support GL_PACK_ROW_LENGTH, so read the whole area in one
+	// go and fix up the row order and stride afterwards. glReadPixels waits
+	// for pending drawing to complete.
+	size_t row_len = (size_t)width * fmt->bpp / 8;
+	unsigned char *dst =
+		(unsigned char *)data + (size_t)dst_y * stride + dst_x * fmt->bpp / 8;
 
-	// Make sure any pending drawing is finished before we try to read it
-	glFinish();
+	GLES2_DEBUG_PUSH;
 
-	// Unfortunately GLES2 doesn't support GL_PACK_*, so we have to read
-	// the lines out row by row
-	unsigned char *p = data + dst_y * stride;
-	for (size_t i = src_y; i < src_y + height; ++i) {
-		glReadPixels(src_x, src_y + height - i - 1, width, 1, fmt->gl_format,
-			fmt->gl_type, p + i * stride + dst_x * fmt->bpp / 8);
+	if (stride == row_len) {
+		// The destination is tightly packed, read straight into it and flip
+		// in place
+		unsigned char *tmp = gles2_reserve_pixels(renderer, row_len);
+		if (tmp == NULL) {
+			GLES2_DEBUG_POP;
+			return false;
+		}
+		glReadPixels(src_x, src_y, width, height, fmt->gl_format,
+			fmt->gl_type, dst);
+		flip_rows(dst, stride, row_len, height, tmp);
+	} else {
+		unsigned char *tmp = gles2_reserve_pixels(renderer, row_len * height);
+		if (tmp == NULL) {
+			GLES2_DEBUG_POP;
+			return false;
+		}
+		glReadPixels(src_x, src_y, width, height, fmt->gl_format,
+			fmt->gl_type, tmp);
+		copy_rows_flipped(dst, stride, tmp, row_len, row_len, height);
 	}
 
 	GLES2_DEBUG_POP;
@@ -270,6 +621,128 @@ static bool gles2_read_pixels(struct wlr_renderer *wlr_renderer,
 	return true;
 }
 
+static struct wlr_gles2_readback *gles2_get_readback(
+		struct wlr_renderer_readback *wlr_readback) {
+	return (struct wlr_gles2_readback *)wlr_readback;
+}
+
+static struct wlr_renderer_readback *gles2_readback_start(
+		struct wlr_renderer *wlr_renderer, enum wl_shm_format wl_fmt,
+		uint32_t width, uint32_t height, uint32_t src_x, uint32_t src_y) {
+	struct wlr_gles2_renderer *renderer =
+		gles2_get_renderer_in_context(wlr_renderer);
+	if (!renderer->readback.supported) {
+		return NULL;
+	}
+
+	const struct gles2_pixel_format *fmt = gles2_format_from_wl(wl_fmt);
+	if (fmt == NULL) {
+		wlr_log(L_ERROR, "Cannot read pixels: unsupported pixel format");
+		return NULL;
+	}
+
+	size_t index = 0;
+	while (index < GLES2_READBACK_BUFFERS && renderer->readback.busy[index]) {
+		++index;
+	}
+	if (index == GLES2_READBACK_BUFFERS) {
+		wlr_log(L_DEBUG, "All readback buffers are busy");
+		return NULL;
+	}
+
+	struct wlr_gles2_readback *readback =
+		calloc(1, sizeof(struct wlr_gles2_readback));
+	if (readback == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		return NULL;
+	}
+	readback->wlr_readback.fmt = wl_fmt;
+	readback->wlr_readback.width = width;
+	readback->wlr_readback.height = height;
+	readback->fmt = fmt;
+	readback->index = index;
+
+	GLES2_DEBUG_PUSH;
+
+	size_t size = (size_t)width * height * fmt->bpp / 8;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER_NV, renderer->readback.buffers[index]);
+	if (renderer->readback.sizes[index] < size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER_NV, size, NULL,
+			renderer->readback.usage);
+		renderer->readback.sizes[index] = size;
+	}
+	// With a pack buffer bound this only queues the copy
+	glReadPixels(src_x, src_y, width, height, fmt->gl_format, fmt->gl_type,
+		NULL);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER_NV, 0);
+
+	GLES2_DEBUG_POP;
+
+	renderer->readback.busy[index] = true;
+	return &readback->wlr_readback;
+}
+
+static void gles2_make_context_current(struct wlr_gles2_renderer *renderer) {
+	// Buffer objects don't care about the current surface
+	if (!wlr_egl_is_current(renderer->egl)) {
+		wlr_egl_make_current(renderer->egl, EGL_NO_SURFACE, NULL);
+	}
+}
+
+static bool gles2_readback_finish(struct wlr_renderer *wlr_renderer,
+		struct wlr_renderer_readback *wlr_readback, uint32_t stride,
+		uint32_t dst_x, uint32_t dst_y, void *data) {
+	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
+	struct wlr_gles2_readback *readback = gles2_get_readback(wlr_readback);
+	const struct gles2_pixel_format *fmt = readback->fmt;
+
+	gles2_make_context_current(renderer);
+
+	GLES2_DEBUG_PUSH;
+
+	size_t row_len = (size_t)wlr_readback->width * fmt->bpp / 8;
+	size_t size = row_len * wlr_readback->height;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER_NV,
+		renderer->readback.buffers[readback->index]);
+	// Blocks until the copy has completed
+	const unsigned char *src = glMapBufferRangeEXT(GL_PIXEL_PACK_BUFFER_NV, 0,
+		size, GL_MAP_READ_BIT_EXT);
+	if (src != NULL) {
+		unsigned char *dst = (unsigned char *)data + (size_t)dst_y * stride +
+			dst_x * fmt->bpp / 8;
+		copy_rows_flipped(dst, stride, src, row_len, row_len,
+			wlr_readback->height);
+		glUnmapBufferOES(GL_PIXEL_PACK_BUFFER_NV);
+	} else {
+		wlr_log(L_ERROR, "Failed to map readback buffer");
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER_NV, 0);
+
+	GLES2_DEBUG_POP;
+
+	return src != NULL;
+}
+
+static void gles2_readback_destroy(struct wlr_renderer *wlr_renderer,
+		struct wlr_renderer_readback *wlr_readback) {
+	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
+	struct wlr_gles2_readback *readback = gles2_get_readback(wlr_readback);
+	// The buffer is kept around for the next readback
+	renderer->readback.busy[readback->index] = false;
+	free(readback);
+}
+
+/**
+ * Creating a texture binds it, so the cached texture bindings are invalidated.
+ * The texture is tied to the renderer by wlr_texture.renderer.
+ */
+static struct wlr_texture *gles2_texture_from_renderer(
+		struct wlr_gles2_renderer *renderer, struct wlr_texture *wlr_texture) {
+	renderer->state.tex_2d = 0;
+	renderer->state.tex_ext = 0;
+	return wlr_texture;
+}
+
 static bool gles2_format_supported(struct wlr_renderer *wlr_renderer,
 		enum wl_shm_format wl_fmt) {
 	return gles2_format_from_wl(wl_fmt) != NULL;
@@ -279,21 +752,71 @@ static struct wlr_texture *gles2_texture_from_pixels(
 		struct wlr_renderer *wlr_renderer, enum wl_shm_format wl_fmt,
 		uint32_t stride, uint32_t width, uint32_t height, const void *data) {
 	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
-	return wlr_gles2_texture_from_pixels(renderer->egl, wl_fmt, stride, width,
-		height, data);
+	return gles2_texture_from_renderer(renderer,
+		wlr_gles2_texture_from_pixels(renderer->egl, wl_fmt, stride, width,
+			height, data));
 }
 
 static struct wlr_texture *gles2_texture_from_wl_drm(
 		struct wlr_renderer *wlr_renderer, struct wl_resource *data) {
 	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
-	return wlr_gles2_texture_from_wl_drm(renderer->egl, data);
+	return gles2_texture_from_renderer(renderer,
+		wlr_gles2_texture_from_wl_drm(renderer->egl, data));
 }
 
 static struct wlr_texture *gles2_texture_from_dmabuf(
 		struct wlr_renderer *wlr_renderer,
 		struct wlr_dmabuf_buffer_attribs *attribs) {
 	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
-	return wlr_gles2_texture_from_dmabuf(renderer->egl, attribs);
+	return gles2_texture_from_renderer(renderer,
+		wlr_gles2_texture_from_dmabuf(renderer->egl, attribs));
+}
+
+static int64_t gles2_get_gpu_time(struct wlr_renderer *wlr_renderer,
+		uint64_t frame) {
+	struct wlr_gles2_renderer *renderer = gles2_get_renderer(wlr_renderer);
+	if (!renderer->timer.supported || frame == 0) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < GLES2_TIMER_QUERIES; ++i) {
+		if (renderer->timer.frames[i] != frame) {
+			continue;
+		}
+		if (renderer->timer.times[i] >= 0) {
+			return renderer->timer.times[i];
+		}
+		if (renderer->timer.active && renderer->timer.next == i) {
+			// Still recording
+			return -1;
+		}
+
+		gles2_make_context_current(renderer);
+
+		// Never wait for the result
+		GLuint query = renderer->timer.queries[i];
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuivEXT(query, GL_QUERY_RESULT_AVAILABLE_EXT,
+			&available);
+		if (!available) {
+			return -1;
+		}
+
+		GLint disjoint = GL_FALSE;
+		glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64vEXT(query, GL_QUERY_RESULT_EXT, &elapsed);
+		if (disjoint) {
+			// The GPU clock changed or was reset, the result is meaningless
+			renderer->timer.frames[i] = 0;
+			return -1;
+		}
+
+		renderer->timer.times[i] = elapsed;
+		return renderer->timer.times[i];
+	}
+
+	return -1;
 }
 
 static void gles2_destroy(struct wlr_renderer *wlr_renderer) {
@@ -307,6 +830,19 @@ static void gles2_destroy(struct wlr_renderer *wlr_renderer) {
 	glDeleteProgram(renderer->shaders.tex_rgba);
 	glDeleteProgram(renderer->shaders.tex_rgbx);
 	glDeleteProgram(renderer->shaders.tex_ext);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glUseProgram(0);
+	glDisableVertexAttribArray(0);
+	glDisableVertexAttribArray(1);
+	glDeleteBuffers(1, &renderer->buffers.quad);
+	glDeleteBuffers(1, &renderer->buffers.stream);
+	if (renderer->readback.supported) {
+		glDeleteBuffers(GLES2_READBACK_BUFFERS, renderer->readback.buffers);
+	}
+	if (renderer->timer.supported) {
+		glDeleteQueriesEXT(GLES2_TIMER_QUERIES, renderer->timer.queries);
+	}
 	GLES2_DEBUG_POP;
 
 	if (glDebugMessageCallbackKHR) {
@@ -314,6 +850,8 @@ static void gles2_destroy(struct wlr_renderer *wlr_renderer) {
 		glDebugMessageCallbackKHR(NULL, NULL);
 	}
 
+	free(renderer->verts.data);
+	free(renderer->pixels.data);
 	free(renderer);
 }
 
@@ -324,6 +862,10 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.clear = gles2_clear,
 	.scissor = gles2_scissor,
 	.render_texture_with_matrix = gles2_render_texture_with_matrix,
+	.render_texture_with_matrix_region =
+		gles2_render_texture_with_matrix_region,
+	.render_opaque_texture_with_matrix_region =
+		gles2_render_opaque_texture_with_matrix_region,
 	.render_quad_with_matrix = gles2_render_quad_with_matrix,
 	.render_ellipse_with_matrix = gles2_render_ellipse_with_matrix,
 	.formats = gles2_renderer_formats,
@@ -333,20 +875,25 @@ static const struct wlr_renderer_impl renderer_impl = {
 	.get_dmabuf_modifiers = gles2_get_dmabuf_modifiers,
 	.check_import_dmabuf = gles2_check_import_dmabuf,
 	.read_pixels = gles2_read_pixels,
+	.readback_start = gles2_readback_start,
+	.readback_finish = gles2_readback_finish,
+	.readback_destroy = gles2_readback_destroy,
 	.format_supported = gles2_format_supported,
 	.texture_from_pixels = gles2_texture_from_pixels,
 	.texture_from_wl_drm = gles2_texture_from_wl_drm,
 	.texture_from_dmabuf = gles2_texture_from_dmabuf,
+	.get_gpu_time = gles2_get_gpu_time,
 };
 
+bool gles2_debug_markers = false;
+
 void gles2_push_marker(const char *file, const char *func) {
 	if (!glPushDebugGroupKHR) {
 		return;
 	}
 
-	int len = snprintf(NULL, 0, "%s:%s", file, func) + 1;
-	char str[len];
-	snprintf(str, len, "%s:%s", file, func);
+	char str[256];
+	snprintf(str, sizeof(str), "%s:%s", file, func);
 	glPushDebugGroupKHR(GL_DEBUG_SOURCE_APPLICATION_KHR, 1, -1, str);
 }
 
@@ -433,6 +980,24 @@ error:
 	return 0;
 }
 
+static bool check_gl_ext(const char *exts, const char *ext) {
+	size_t extlen = strlen(ext);
+	const char *end = exts + strlen(exts);
+
+	while (exts < end) {
+		if (*exts == ' ') {
+			exts++;
+			continue;
+		}
+		size_t n = strcspn(exts, " ");
+		if (n == extlen && strncmp(ext, exts, n) == 0) {
+			return true;
+		}
+		exts += n;
+	}
+	return false;
+}
+
 extern const GLchar quad_vertex_src[];
 extern const GLchar quad_fragment_src[];
 extern const GLchar ellipse_fragment_src[];
@@ -461,9 +1026,17 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 	wlr_log(L_INFO, "GL vendor: %s", glGetString(GL_VENDOR));
 	wlr_log(L_INFO, "Supported GLES2 extensions: %s", renderer->exts_str);
 
+	// Debug groups and synchronous debug output slow down every draw call,
+	// only use them if asked to
+	const char *markers = getenv("WLR_GLES2_DEBUG_MARKERS");
+	gles2_debug_markers = markers != NULL && strcmp(markers, "1") == 0 &&
+		glPushDebugGroupKHR && glPopDebugGroupKHR;
+
 	if (glDebugMessageCallbackKHR && glDebugMessageControlKHR) {
 		glEnable(GL_DEBUG_OUTPUT_KHR);
-		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS_KHR);
+		if (gles2_debug_markers) {
+			glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS_KHR);
+		}
 		glDebugMessageCallbackKHR(gles2_log, NULL);
 
 		// Silence unwanted message types
@@ -502,6 +1075,50 @@ struct wlr_renderer *wlr_gles2_renderer_create(struct wlr_egl *egl) {
 		}
 	}
 
+	// Vertex positions and texture coordinates of the unit quad
+	static const GLfloat quad_verts[] = {
+		1, 0, // top right
+		0, 0, // top left
+		1, 1, // bottom right
+		0, 1, // bottom left
+	};
+
+	glGenBuffers(1, &renderer->buffers.quad);
+	glBindBuffer(GL_ARRAY_BUFFER, renderer->buffers.quad);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad_verts), quad_verts,
+		GL_STATIC_DRAW);
+
+	renderer->buffers.stream_size = 64 * 1024;
+	glGenBuffers(1, &renderer->buffers.stream);
+	glBindBuffer(GL_ARRAY_BUFFER, renderer->buffers.stream);
+	glBufferData(GL_ARRAY_BUFFER, renderer->buffers.stream_size, NULL,
+		GL_STREAM_DRAW);
+
+	// Reading into pack buffers requires NV_pixel_buffer_object or GLES3,
+	// mapping them requires EXT_map_buffer_range
+	const char *version = (const char *)glGetString(GL_VERSION);
+	bool gles3 = strncmp(version, "OpenGL ES 3", strlen("OpenGL ES 3")) == 0;
+	renderer->readback.supported =
+		(gles3 || check_gl_ext(renderer->exts_str,
+			"GL_NV_pixel_buffer_object")) &&
+		check_gl_ext(renderer->exts_str, "GL_EXT_map_buffer_range") &&
+		glMapBufferRangeEXT && glUnmapBufferOES;
+	if (renderer->readback.supported) {
+		// GL_STREAM_READ only exists in GLES3
+		renderer->readback.usage = gles3 ? GL_STREAM_READ : GL_STREAM_DRAW;
+		glGenBuffers(GLES2_READBACK_BUFFERS, renderer->readback.buffers);
+	}
+
+	renderer->timer.supported =
+		check_gl_ext(renderer->exts_str, "GL_EXT_disjoint_timer_query") &&
+		glGenQueriesEXT && glDeleteQueriesEXT && glBeginQueryEXT &&
+		glEndQueryEXT && glGetQueryObjectuivEXT && glGetQueryObjectui64vEXT;
+	if (renderer->timer.supported) {
+		glGenQueriesEXT(GLES2_TIMER_QUERIES, renderer->timer.queries);
+	}
+
+	gles2_reset_state(renderer);
+
 	GLES2_DEBUG_POP;
 
 	return &renderer->wlr_renderer;
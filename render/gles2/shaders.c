@@ -11,7 +11,7 @@ const GLchar quad_vertex_src[] =
 "varying vec2 v_texcoord;\n"
 "\n"
 "void main() {\n"
-"	gl_Position = vec4(proj * vec3(pos, 1.0), 1.0);\n"
+"	gl_Position = vec4(vec3(pos, 1.0) * proj, 1.0);\n"
 "	v_color = color;\n"
 "	v_texcoord = texcoord;\n"
 "}\n";
@@ -48,7 +48,7 @@ const GLchar tex_vertex_src[] =
 "varying vec2 v_texcoord;\n"
 "\n"
 "void main() {\n"
-"	gl_Position = vec4(proj * vec3(pos, 1.0), 1.0);\n"
+"	gl_Position = vec4(vec3(pos, 1.0) * proj, 1.0);\n"
 "	if (invert_y) {\n"
 "		v_texcoord = vec2(texcoord.s, 1.0 - texcoord.t);\n"
 "	} else {\n"
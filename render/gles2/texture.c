@@ -16,7 +16,7 @@
 
 static const struct wlr_texture_impl texture_impl;
 
-static struct wlr_gles2_texture *gles2_get_texture(
+struct wlr_gles2_texture *gles2_get_texture(
 		struct wlr_texture *wlr_texture) {
 	assert(wlr_texture->impl == &texture_impl);
 	return (struct wlr_gles2_texture *)wlr_texture;
@@ -29,6 +29,16 @@ struct wlr_gles2_texture *gles2_get_texture_in_context(
 	return texture;
 }
 
+/**
+ * Returns the renderer owning the texture's state cache, NULL if the texture
+ * wasn't created through a renderer.
+ */
+static struct wlr_gles2_renderer *gles2_texture_get_renderer(
+		struct wlr_gles2_texture *texture) {
+	// Textures are only created by renderers of their own kind
+	return (struct wlr_gles2_renderer *)texture->wlr_texture.renderer;
+}
+
 static void gles2_texture_get_size(struct wlr_texture *wlr_texture, int *width,
 		int *height) {
 	struct wlr_gles2_texture *texture = gles2_get_texture(wlr_texture);
@@ -57,7 +67,7 @@ static bool gles2_texture_write_pixels(struct wlr_texture *wlr_texture,
 	// TODO: what if the unpack subimage extension isn't supported?
 	GLES2_DEBUG_PUSH;
 
-	glBindTexture(GL_TEXTURE_2D, texture->gl_tex);
+	gles2_bind_texture(gles2_texture_get_renderer(texture), GL_TEXTURE_2D, texture->gl_tex);
 
 	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, stride / (fmt->bpp / 8));
 	glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, src_x);
@@ -86,6 +96,7 @@ static void gles2_texture_destroy(struct wlr_texture *wlr_texture) {
 	GLES2_DEBUG_PUSH;
 
 	if (texture->image_tex) {
+		gles2_forget_texture(gles2_texture_get_renderer(texture), texture->image_tex);
 		glDeleteTextures(1, &texture->image_tex);
 	}
 	if (texture->image) {
@@ -94,6 +105,7 @@ static void gles2_texture_destroy(struct wlr_texture *wlr_texture) {
 	}
 
 	if (texture->type == WLR_GLES2_TEXTURE_GLTEX) {
+		gles2_forget_texture(gles2_texture_get_renderer(texture), texture->gl_tex);
 		glDeleteTextures(1, &texture->gl_tex);
 	}
 
@@ -102,6 +114,15 @@ static void gles2_texture_destroy(struct wlr_texture *wlr_texture) {
 	free(texture);
 }
 
+/**
+ * Sets the filters of the texture bound to `target`. Filters are per-texture
+ * state, so there's no need to set them again before each draw.
+ */
+static void set_texture_filters(GLenum target) {
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
 static const struct wlr_texture_impl texture_impl = {
 	.get_size = gles2_texture_get_size,
 	.write_pixels = gles2_texture_write_pixels,
@@ -136,6 +157,7 @@ struct wlr_texture *wlr_gles2_texture_from_pixels(struct wlr_egl *egl,
 
 	glGenTextures(1, &texture->gl_tex);
 	glBindTexture(GL_TEXTURE_2D, texture->gl_tex);
+	set_texture_filters(GL_TEXTURE_2D);
 
 	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, stride / (fmt->bpp / 8));
 	glTexImage2D(GL_TEXTURE_2D, 0, fmt->gl_format, width, height, 0,
@@ -196,11 +218,49 @@ struct wlr_texture *wlr_gles2_texture_from_wl_drm(struct wlr_egl *egl,
 	glGenTextures(1, &texture->image_tex);
 	glBindTexture(target, texture->image_tex);
 	glEGLImageTargetTexture2DOES(target, texture->image);
+	set_texture_filters(target);
 
 	GLES2_DEBUG_POP;
 	return &texture->wlr_texture;
 }
 
+#ifndef DRM_FORMAT_BIG_ENDIAN
+# define DRM_FORMAT_BIG_ENDIAN 0x80000000
+#endif
+// Unlike the other formats, the DRM fourcc codes of ARGB8888 and XRGB8888
+// don't match their wl_shm values
+#define DRM_FORMAT_XRGB8888 0x34325258 // 'XR24'
+
+static bool dmabuf_format_has_alpha(uint32_t format) {
+	switch (format & ~DRM_FORMAT_BIG_ENDIAN) {
+	case DRM_FORMAT_XRGB8888:
+	case WL_SHM_FORMAT_XBGR8888:
+	case WL_SHM_FORMAT_RGBX8888:
+	case WL_SHM_FORMAT_BGRX8888:
+	case WL_SHM_FORMAT_XRGB4444:
+	case WL_SHM_FORMAT_XBGR4444:
+	case WL_SHM_FORMAT_RGBX4444:
+	case WL_SHM_FORMAT_BGRX4444:
+	case WL_SHM_FORMAT_XRGB1555:
+	case WL_SHM_FORMAT_XBGR1555:
+	case WL_SHM_FORMAT_RGBX5551:
+	case WL_SHM_FORMAT_BGRX5551:
+	case WL_SHM_FORMAT_XRGB2101010:
+	case WL_SHM_FORMAT_XBGR2101010:
+	case WL_SHM_FORMAT_RGBX1010102:
+	case WL_SHM_FORMAT_BGRX1010102:
+	case WL_SHM_FORMAT_RGB565:
+	case WL_SHM_FORMAT_BGR565:
+	case WL_SHM_FORMAT_RGB888:
+	case WL_SHM_FORMAT_BGR888:
+	case WL_SHM_FORMAT_RGB332:
+	case WL_SHM_FORMAT_BGR233:
+		return false;
+	default:
+		return true;
+	}
+}
+
 struct wlr_texture *wlr_gles2_texture_from_dmabuf(struct wlr_egl *egl,
 		struct wlr_dmabuf_buffer_attribs *attribs) {
 	assert(wlr_egl_is_current(egl));
@@ -226,7 +286,7 @@ struct wlr_texture *wlr_gles2_texture_from_dmabuf(struct wlr_egl *egl,
 	texture->width = attribs->width;
 	texture->height = attribs->height;
 	texture->type = WLR_GLES2_TEXTURE_DMABUF;
-	texture->has_alpha = true;
+	texture->has_alpha = dmabuf_format_has_alpha(attribs->format);
 	texture->inverted_y =
 		(attribs->flags & WLR_DMABUF_BUFFER_ATTRIBS_FLAGS_Y_INVERT) != 0;
 
@@ -241,6 +301,7 @@ struct wlr_texture *wlr_gles2_texture_from_dmabuf(struct wlr_egl *egl,
 	glGenTextures(1, &texture->image_tex);
 	glBindTexture(GL_TEXTURE_EXTERNAL_OES, texture->image_tex);
 	glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, texture->image);
+	set_texture_filters(GL_TEXTURE_EXTERNAL_OES);
 
 	GLES2_DEBUG_POP;
 	return &texture->wlr_texture;
@@ -0,0 +1,55 @@
+#include <pixman.h>
+#include "render/pixman.h"
+
+/*
+ * Both wayland and pixman describe formats in native-endian 32-bit words, so
+ * WL_SHM_FORMAT_ARGB8888 maps directly to PIXMAN_a8r8g8b8.
+ */
+static const struct pixman_pixel_format formats[] = {
+	{
+		.wl_format = WL_SHM_FORMAT_ARGB8888,
+		.pixman_format = PIXMAN_a8r8g8b8,
+		.bpp = 32,
+		.has_alpha = true,
+	},
+	{
+		.wl_format = WL_SHM_FORMAT_XRGB8888,
+		.pixman_format = PIXMAN_x8r8g8b8,
+		.bpp = 32,
+		.has_alpha = false,
+	},
+	{
+		.wl_format = WL_SHM_FORMAT_XBGR8888,
+		.pixman_format = PIXMAN_x8b8g8r8,
+		.bpp = 32,
+		.has_alpha = false,
+	},
+	{
+		.wl_format = WL_SHM_FORMAT_ABGR8888,
+		.pixman_format = PIXMAN_a8b8g8r8,
+		.bpp = 32,
+		.has_alpha = true,
+	},
+};
+
+static const enum wl_shm_format wl_formats[] = {
+	WL_SHM_FORMAT_ARGB8888,
+	WL_SHM_FORMAT_XRGB8888,
+	WL_SHM_FORMAT_ABGR8888,
+	WL_SHM_FORMAT_XBGR8888,
+};
+
+const struct pixman_pixel_format *pixman_format_from_wl(
+		enum wl_shm_format fmt) {
+	for (size_t i = 0; i < sizeof(formats) / sizeof(*formats); ++i) {
+		if (formats[i].wl_format == fmt) {
+			return &formats[i];
+		}
+	}
+	return NULL;
+}
+
+const enum wl_shm_format *pixman_formats(size_t *len) {
+	*len = sizeof(wl_formats) / sizeof(wl_formats[0]);
+	return wl_formats;
+}
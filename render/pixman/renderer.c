@@ -0,0 +1,695 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <math.h>
+#include <pixman.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wayland-server-protocol.h>
+#include <wayland-util.h>
+#include <wlr/render/interface.h>
+#include <wlr/render/pixman.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/util/log.h>
+#include "render/pixman.h"
+
+// Don't split the damaged area into bands thinner than this, per-tile setup
+// would dominate
+#define MIN_TILE_HEIGHT 32
+// Tiles per thread, more tiles even out uneven per-tile costs
+#define TILES_PER_THREAD 4
+#define MAX_WORKERS 7
+
+static const struct wlr_renderer_impl renderer_impl;
+
+static struct wlr_pixman_renderer *pixman_get_renderer(
+		struct wlr_renderer *wlr_renderer) {
+	assert(wlr_renderer->impl == &renderer_impl);
+	return (struct wlr_pixman_renderer *)wlr_renderer;
+}
+
+bool wlr_renderer_is_pixman(struct wlr_renderer *wlr_renderer) {
+	return wlr_renderer->impl == &renderer_impl;
+}
+
+static bool intersect_box(pixman_box32_t *dest, const pixman_box32_t *a,
+		const pixman_box32_t *b) {
+	dest->x1 = a->x1 > b->x1 ? a->x1 : b->x1;
+	dest->y1 = a->y1 > b->y1 ? a->y1 : b->y1;
+	dest->x2 = a->x2 < b->x2 ? a->x2 : b->x2;
+	dest->y2 = a->y2 < b->y2 ? a->y2 : b->y2;
+	return dest->x1 < dest->x2 && dest->y1 < dest->y2;
+}
+
+/**
+ * Restricts a box in image coordinates to the bound image and the scissor
+ * box. Returns false if nothing is left.
+ */
+static bool clip_box(struct wlr_pixman_renderer *renderer,
+		pixman_box32_t *box) {
+	int height = pixman_image_get_height(renderer->image);
+	pixman_box32_t bounds = {
+		.x1 = 0,
+		.y1 = 0,
+		.x2 = pixman_image_get_width(renderer->image),
+		.y2 = height,
+	};
+	if (!intersect_box(box, box, &bounds)) {
+		return false;
+	}
+
+	if (renderer->has_scissor) {
+		// The scissor box has its origin at the bottom-left corner
+		struct wlr_box *s = &renderer->scissor;
+		pixman_box32_t scissor = {
+			.x1 = s->x,
+			.y1 = height - (s->y + s->height),
+			.x2 = s->x + s->width,
+			.y2 = height - s->y,
+		};
+		return intersect_box(box, box, &scissor);
+	}
+	return true;
+}
+
+/**
+ * Computes the affine map from normalized device coordinates to image
+ * pixels. Rows are stored top to bottom, whereas renderer coordinates have
+ * their origin at the bottom-left corner.
+ */
+static void ndc_to_image(struct wlr_pixman_renderer *renderer,
+		double mat[static 6]) {
+	double vw = renderer->viewport_width, vh = renderer->viewport_height;
+	double height = pixman_image_get_height(renderer->image);
+	mat[0] = vw / 2;
+	mat[1] = 0;
+	mat[2] = vw / 2;
+	mat[3] = 0;
+	mat[4] = -vh / 2;
+	mat[5] = height - vh / 2;
+}
+
+/**
+ * Computes the affine map from source pixels of a `width`x`height` image to
+ * destination image pixels, given a matrix projecting the unit square to
+ * normalized device coordinates.
+ */
+static void source_to_image(struct wlr_pixman_renderer *renderer,
+		const float matrix[static 9], int width, int height,
+		double mat[static 6]) {
+	double ndc[6];
+	ndc_to_image(renderer, ndc);
+	mat[0] = ndc[0] * matrix[0] / width;
+	mat[1] = ndc[0] * matrix[1] / height;
+	mat[2] = ndc[0] * matrix[2] + ndc[2];
+	mat[3] = ndc[4] * matrix[3] / width;
+	mat[4] = ndc[4] * matrix[4] / height;
+	mat[5] = ndc[4] * matrix[5] + ndc[5];
+}
+
+static bool invert_affine(double inv[static 6], const double mat[static 6]) {
+	double det = mat[0] * mat[4] - mat[1] * mat[3];
+	if (fabs(det) < 1e-12) {
+		return false;
+	}
+	inv[0] = mat[4] / det;
+	inv[1] = -mat[1] / det;
+	inv[2] = (mat[1] * mat[5] - mat[4] * mat[2]) / det;
+	inv[3] = -mat[3] / det;
+	inv[4] = mat[0] / det;
+	inv[5] = (mat[3] * mat[2] - mat[0] * mat[5]) / det;
+	return true;
+}
+
+static bool is_nearly(double a, double b) {
+	return fabs(a - b) < 1e-4;
+}
+
+static bool is_axis_aligned(const double mat[static 6]) {
+	return (mat[1] == 0 && mat[3] == 0) || (mat[0] == 0 && mat[4] == 0);
+}
+
+/**
+ * Computes the destination pixels covered by the `width`x`height` source
+ * rectangle mapped through `mat`. Axis-aligned rectangles follow the
+ * pixel-center rule so that adjacent rectangles neither overlap nor leave
+ * gaps, other shapes get their bounding box.
+ */
+static void get_bounds(const double mat[static 6], int width, int height,
+		pixman_box32_t *box) {
+	double min_x = INFINITY, min_y = INFINITY;
+	double max_x = -INFINITY, max_y = -INFINITY;
+	const double corners[4][2] = {
+		{ 0, 0 }, { width, 0 }, { 0, height }, { width, height },
+	};
+	for (size_t i = 0; i < 4; ++i) {
+		double x = mat[0] * corners[i][0] + mat[1] * corners[i][1] + mat[2];
+		double y = mat[3] * corners[i][0] + mat[4] * corners[i][1] + mat[5];
+		min_x = fmin(min_x, x);
+		min_y = fmin(min_y, y);
+		max_x = fmax(max_x, x);
+		max_y = fmax(max_y, y);
+	}
+
+	if (is_axis_aligned(mat)) {
+		box->x1 = lround(min_x);
+		box->y1 = lround(min_y);
+		box->x2 = lround(max_x);
+		box->y2 = lround(max_y);
+	} else {
+		box->x1 = floor(min_x);
+		box->y1 = floor(min_y);
+		box->x2 = ceil(max_x);
+		box->y2 = ceil(max_y);
+	}
+}
+
+static uint16_t float_to_u16(float f) {
+	if (f <= 0) {
+		return 0;
+	} else if (f >= 1) {
+		return 0xFFFF;
+	}
+	return f * 0xFFFF + 0.5f;
+}
+
+static pixman_color_t color_from_float(const float color[static 4],
+		bool premultiply) {
+	float alpha = premultiply ? color[3] : 1;
+	return (pixman_color_t){
+		.red = float_to_u16(color[0] * alpha),
+		.green = float_to_u16(color[1] * alpha),
+		.blue = float_to_u16(color[2] * alpha),
+		.alpha = float_to_u16(color[3]),
+	};
+}
+
+static struct wlr_pixman_command *push_command(
+		struct wlr_pixman_renderer *renderer,
+		enum wlr_pixman_command_type type, const pixman_box32_t *box) {
+	struct wlr_pixman_command *cmd = wl_array_add(&renderer->commands,
+		sizeof(struct wlr_pixman_command));
+	if (cmd == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		return NULL;
+	}
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->type = type;
+	cmd->box = *box;
+	return cmd;
+}
+
+static void push_composite(struct wlr_pixman_renderer *renderer,
+		pixman_image_t *src, bool has_alpha, const double mat[static 6],
+		pixman_filter_t filter, float alpha) {
+	int width = pixman_image_get_width(src);
+	int height = pixman_image_get_height(src);
+
+	double inv[6];
+	if (!invert_affine(inv, mat)) {
+		return;
+	}
+
+	pixman_box32_t box;
+	get_bounds(mat, width, height, &box);
+	if (!clip_box(renderer, &box)) {
+		return;
+	}
+
+	struct wlr_pixman_command *cmd =
+		push_command(renderer, WLR_PIXMAN_COMMAND_COMPOSITE, &box);
+	if (cmd == NULL) {
+		return;
+	}
+
+	bool axis_aligned = is_axis_aligned(mat);
+	cmd->src = pixman_image_ref(src);
+	cmd->alpha = float_to_u16(alpha);
+	cmd->filter = filter;
+	// The box covers exactly the quad when it's axis-aligned, padding avoids
+	// fading the edges with bilinear filtering
+	cmd->repeat = axis_aligned ? PIXMAN_REPEAT_PAD : PIXMAN_REPEAT_NONE;
+	cmd->op = !has_alpha && cmd->alpha == 0xFFFF && axis_aligned ?
+		PIXMAN_OP_SRC : PIXMAN_OP_OVER;
+
+	for (size_t i = 0; i < 2; ++i) {
+		for (size_t j = 0; j < 3; ++j) {
+			cmd->transform.matrix[i][j] =
+				pixman_double_to_fixed(inv[i * 3 + j]);
+		}
+	}
+	cmd->transform.matrix[2][0] = 0;
+	cmd->transform.matrix[2][1] = 0;
+	cmd->transform.matrix[2][2] = pixman_fixed_1;
+}
+
+static void pixman_begin(struct wlr_renderer *wlr_renderer, uint32_t width,
+		uint32_t height) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	renderer->viewport_width = width;
+	renderer->viewport_height = height;
+}
+
+static void pixman_end(struct wlr_renderer *wlr_renderer) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	wlr_pixman_renderer_flush(&renderer->wlr_renderer);
+}
+
+static void pixman_clear(struct wlr_renderer *wlr_renderer,
+		const float color[static 4]) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	if (renderer->image == NULL) {
+		return;
+	}
+
+	pixman_box32_t box = { INT32_MIN, INT32_MIN, INT32_MAX, INT32_MAX };
+	if (!clip_box(renderer, &box)) {
+		return;
+	}
+
+	struct wlr_pixman_command *cmd =
+		push_command(renderer, WLR_PIXMAN_COMMAND_FILL, &box);
+	if (cmd == NULL) {
+		return;
+	}
+	// Like glClear, store the color as-is
+	cmd->op = PIXMAN_OP_SRC;
+	cmd->color = color_from_float(color, false);
+}
+
+static void pixman_scissor(struct wlr_renderer *wlr_renderer,
+		struct wlr_box *box) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	if (box != NULL) {
+		renderer->scissor = *box;
+		renderer->has_scissor = true;
+	} else {
+		renderer->has_scissor = false;
+	}
+}
+
+static bool pixman_render_texture_with_matrix(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
+		const float matrix[static 9], float alpha) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	struct wlr_pixman_texture *texture = pixman_get_texture(wlr_texture);
+	if (renderer->image == NULL) {
+		wlr_log(L_ERROR, "No image bound to the pixman renderer");
+		return false;
+	}
+
+	double mat[6];
+	source_to_image(renderer, matrix, texture->width, texture->height, mat);
+
+	// Skip filtering if texels map one-to-one to whole pixels. Snap the
+	// matrix so that pixman picks its untransformed fast paths.
+	pixman_filter_t filter = PIXMAN_FILTER_BILINEAR;
+	if (is_nearly(mat[0], 1) && mat[1] == 0 && mat[3] == 0 &&
+			is_nearly(mat[4], 1) && is_nearly(mat[2], round(mat[2])) &&
+			is_nearly(mat[5], round(mat[5]))) {
+		mat[0] = mat[4] = 1;
+		mat[2] = round(mat[2]);
+		mat[5] = round(mat[5]);
+		filter = PIXMAN_FILTER_NEAREST;
+	}
+
+	push_composite(renderer, texture->image, texture->has_alpha, mat, filter,
+		alpha);
+	return true;
+}
+
+static void pixman_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], const float matrix[static 9]) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	if (renderer->image == NULL) {
+		return;
+	}
+
+	double mat[6];
+	source_to_image(renderer, matrix, 1, 1, mat);
+	pixman_color_t pixel = color_from_float(color, true);
+
+	if (is_axis_aligned(mat)) {
+		pixman_box32_t box;
+		get_bounds(mat, 1, 1, &box);
+		if (!clip_box(renderer, &box)) {
+			return;
+		}
+		struct wlr_pixman_command *cmd =
+			push_command(renderer, WLR_PIXMAN_COMMAND_FILL, &box);
+		if (cmd == NULL) {
+			return;
+		}
+		cmd->op = pixel.alpha == 0xFFFF ? PIXMAN_OP_SRC : PIXMAN_OP_OVER;
+		cmd->color = pixel;
+		return;
+	}
+
+	// Rotated quads sample a single pixel without repeat, anything outside
+	// of it is transparent
+	pixman_image_t *src =
+		pixman_image_create_bits(PIXMAN_a8r8g8b8, 1, 1, NULL, 0);
+	if (src == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		return;
+	}
+	pixman_box32_t unit = { 0, 0, 1, 1 };
+	pixman_image_fill_boxes(PIXMAN_OP_SRC, src, &pixel, 1, &unit);
+	push_composite(renderer, src, true, mat, PIXMAN_FILTER_NEAREST, 1);
+	pixman_image_unref(src);
+}
+
+static void pixman_render_ellipse_with_matrix(
+		struct wlr_renderer *wlr_renderer, const float color[static 4],
+		const float matrix[static 9]) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	if (renderer->image == NULL) {
+		return;
+	}
+
+	double mat[6], inv[6];
+	source_to_image(renderer, matrix, 1, 1, mat);
+	if (!invert_affine(inv, mat)) {
+		return;
+	}
+
+	pixman_box32_t box;
+	get_bounds(mat, 1, 1, &box);
+	if (!clip_box(renderer, &box)) {
+		return;
+	}
+
+	// Collect the covered spans of each row, testing pixel centers against
+	// the unit circle
+	struct wl_array spans;
+	wl_array_init(&spans);
+	for (int32_t y = box.y1; y < box.y2; ++y) {
+		int32_t start = -1;
+		for (int32_t x = box.x1; x <= box.x2; ++x) {
+			bool inside = false;
+			if (x < box.x2) {
+				double u = inv[0] * (x + 0.5) + inv[1] * (y + 0.5) + inv[2];
+				double v = inv[3] * (x + 0.5) + inv[4] * (y + 0.5) + inv[5];
+				inside = (u - 0.5) * (u - 0.5) + (v - 0.5) * (v - 0.5) <= 0.25;
+			}
+			if (inside && start < 0) {
+				start = x;
+			} else if (!inside && start >= 0) {
+				pixman_box32_t *span = wl_array_add(&spans, sizeof(*span));
+				if (span != NULL) {
+					*span = (pixman_box32_t){ start, y, x, y + 1 };
+				}
+				start = -1;
+			}
+		}
+	}
+
+	pixman_region32_t *region = calloc(1, sizeof(pixman_region32_t));
+	if (region == NULL) {
+		wl_array_release(&spans);
+		return;
+	}
+	pixman_region32_init_rects(region, spans.data,
+		spans.size / sizeof(pixman_box32_t));
+	wl_array_release(&spans);
+
+	struct wlr_pixman_command *cmd = NULL;
+	if (pixman_region32_not_empty(region)) {
+		cmd = push_command(renderer, WLR_PIXMAN_COMMAND_FILL_REGION,
+			pixman_region32_extents(region));
+	}
+	if (cmd == NULL) {
+		pixman_region32_fini(region);
+		free(region);
+		return;
+	}
+	cmd->op = PIXMAN_OP_OVER;
+	cmd->color = color_from_float(color, true);
+	cmd->region = region;
+}
+
+static const enum wl_shm_format *pixman_renderer_formats(
+		struct wlr_renderer *wlr_renderer, size_t *len) {
+	return pixman_formats(len);
+}
+
+static bool pixman_read_pixels(struct wlr_renderer *wlr_renderer,
+		enum wl_shm_format wl_fmt, uint32_t stride, uint32_t width,
+		uint32_t height, uint32_t src_x, uint32_t src_y, uint32_t dst_x,
+		uint32_t dst_y, void *data) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	if (renderer->image == NULL) {
+		wlr_log(L_ERROR, "Cannot read pixels: no image bound");
+		return false;
+	}
+
+	const struct pixman_pixel_format *fmt = pixman_format_from_wl(wl_fmt);
+	if (fmt == NULL) {
+		wlr_log(L_ERROR, "Cannot read pixels: unsupported pixel format");
+		return false;
+	}
+
+	wlr_pixman_renderer_flush(&renderer->wlr_renderer);
+
+	pixman_image_t *dst = pixman_image_create_bits_no_clear(
+		fmt->pixman_format, dst_x + width, dst_y + height, data, stride);
+	if (dst == NULL) {
+		wlr_log(L_ERROR, "Cannot read pixels: failed to wrap buffer");
+		return false;
+	}
+
+	// src_y is relative to the bottom, rows are returned top to bottom
+	int image_height = pixman_image_get_height(renderer->image);
+	pixman_image_composite32(PIXMAN_OP_SRC, renderer->image, NULL, dst,
+		src_x, image_height - src_y - height, 0, 0, dst_x, dst_y,
+		width, height);
+
+	pixman_image_unref(dst);
+	return true;
+}
+
+static bool pixman_format_supported(struct wlr_renderer *wlr_renderer,
+		enum wl_shm_format wl_fmt) {
+	return pixman_format_from_wl(wl_fmt) != NULL;
+}
+
+static struct wlr_texture *pixman_renderer_texture_from_pixels(
+		struct wlr_renderer *wlr_renderer, enum wl_shm_format wl_fmt,
+		uint32_t stride, uint32_t width, uint32_t height, const void *data) {
+	return pixman_texture_from_pixels(wl_fmt, stride, width, height, data);
+}
+
+static void release_commands(struct wlr_pixman_renderer *renderer) {
+	struct wlr_pixman_command *cmd;
+	wl_array_for_each(cmd, &renderer->commands) {
+		if (cmd->src != NULL) {
+			pixman_image_unref(cmd->src);
+		}
+		if (cmd->region != NULL) {
+			pixman_region32_fini(cmd->region);
+			free(cmd->region);
+		}
+	}
+	renderer->commands.size = 0;
+}
+
+static void pixman_destroy(struct wlr_renderer *wlr_renderer) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+
+	// The bound image may already be gone, drop pending commands
+	release_commands(renderer);
+	wl_array_release(&renderer->commands);
+	pixman_thread_pool_destroy(renderer->pool);
+	free(renderer);
+}
+
+static const struct wlr_renderer_impl renderer_impl = {
+	.destroy = pixman_destroy,
+	.begin = pixman_begin,
+	.end = pixman_end,
+	.clear = pixman_clear,
+	.scissor = pixman_scissor,
+	.render_texture_with_matrix = pixman_render_texture_with_matrix,
+	.render_quad_with_matrix = pixman_render_quad_with_matrix,
+	.render_ellipse_with_matrix = pixman_render_ellipse_with_matrix,
+	.formats = pixman_renderer_formats,
+	.read_pixels = pixman_read_pixels,
+	.format_supported = pixman_format_supported,
+	.texture_from_pixels = pixman_renderer_texture_from_pixels,
+};
+
+struct tile_job {
+	struct wlr_pixman_renderer *renderer;
+	struct wlr_pixman_command *commands;
+	size_t commands_len;
+	pixman_box32_t extents;
+	int32_t tile_height;
+};
+
+static void composite_box(struct wlr_pixman_command *cmd, pixman_image_t *dst,
+		const pixman_box32_t *box) {
+	// Transform, filter and repeat are image state, so each tile needs its
+	// own view of the source
+	pixman_image_t *src = pixman_image_create_bits_no_clear(
+		pixman_image_get_format(cmd->src), pixman_image_get_width(cmd->src),
+		pixman_image_get_height(cmd->src), pixman_image_get_data(cmd->src),
+		pixman_image_get_stride(cmd->src));
+	if (src == NULL) {
+		return;
+	}
+	pixman_image_set_transform(src, &cmd->transform);
+	pixman_image_set_filter(src, cmd->filter, NULL, 0);
+	pixman_image_set_repeat(src, cmd->repeat);
+
+	pixman_image_t *mask = NULL;
+	if (cmd->alpha != 0xFFFF) {
+		pixman_color_t alpha = { .alpha = cmd->alpha };
+		mask = pixman_image_create_solid_fill(&alpha);
+	}
+
+	// The transform is expressed in destination coordinates
+	pixman_image_composite32(cmd->op, src, mask, dst, box->x1, box->y1, 0, 0,
+		box->x1, box->y1, box->x2 - box->x1, box->y2 - box->y1);
+
+	if (mask != NULL) {
+		pixman_image_unref(mask);
+	}
+	pixman_image_unref(src);
+}
+
+static void render_tile(size_t index, void *data) {
+	struct tile_job *job = data;
+	pixman_image_t *image = job->renderer->image;
+
+	pixman_box32_t tile = job->extents;
+	tile.y1 += index * job->tile_height;
+	if (tile.y2 > tile.y1 + job->tile_height) {
+		tile.y2 = tile.y1 + job->tile_height;
+	}
+
+	// Images aren't safe to share across threads, wrap the target instead
+	pixman_image_t *dst = pixman_image_create_bits_no_clear(
+		pixman_image_get_format(image), pixman_image_get_width(image),
+		pixman_image_get_height(image), pixman_image_get_data(image),
+		pixman_image_get_stride(image));
+	if (dst == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < job->commands_len; ++i) {
+		struct wlr_pixman_command *cmd = &job->commands[i];
+		pixman_box32_t box;
+		if (!intersect_box(&box, &cmd->box, &tile)) {
+			continue;
+		}
+
+		switch (cmd->type) {
+		case WLR_PIXMAN_COMMAND_FILL:
+			pixman_image_fill_boxes(cmd->op, dst, &cmd->color, 1, &box);
+			break;
+		case WLR_PIXMAN_COMMAND_FILL_REGION:;
+			pixman_region32_t clipped;
+			pixman_region32_init(&clipped);
+			pixman_region32_intersect_rect(&clipped, cmd->region, box.x1,
+				box.y1, box.x2 - box.x1, box.y2 - box.y1);
+			int rects_len;
+			pixman_box32_t *rects =
+				pixman_region32_rectangles(&clipped, &rects_len);
+			pixman_image_fill_boxes(cmd->op, dst, &cmd->color, rects_len,
+				rects);
+			pixman_region32_fini(&clipped);
+			break;
+		case WLR_PIXMAN_COMMAND_COMPOSITE:
+			composite_box(cmd, dst, &box);
+			break;
+		}
+	}
+
+	pixman_image_unref(dst);
+}
+
+void wlr_pixman_renderer_flush(struct wlr_renderer *wlr_renderer) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+
+	size_t commands_len =
+		renderer->commands.size / sizeof(struct wlr_pixman_command);
+	if (commands_len == 0 || renderer->image == NULL) {
+		release_commands(renderer);
+		return;
+	}
+
+	struct wlr_pixman_command *commands = renderer->commands.data;
+	struct tile_job job = {
+		.renderer = renderer,
+		.commands = commands,
+		.commands_len = commands_len,
+		.extents = commands[0].box,
+	};
+	for (size_t i = 1; i < commands_len; ++i) {
+		pixman_box32_t *box = &commands[i].box;
+		job.extents.x1 = box->x1 < job.extents.x1 ? box->x1 : job.extents.x1;
+		job.extents.y1 = box->y1 < job.extents.y1 ? box->y1 : job.extents.y1;
+		job.extents.x2 = box->x2 > job.extents.x2 ? box->x2 : job.extents.x2;
+		job.extents.y2 = box->y2 > job.extents.y2 ? box->y2 : job.extents.y2;
+	}
+
+	// Split the damaged area into horizontal bands, which keeps each tile
+	// contiguous in memory. Commands are replayed in order within a tile,
+	// and tiles don't overlap, so they can be rendered concurrently.
+	int32_t height = job.extents.y2 - job.extents.y1;
+	size_t tiles_len = pixman_thread_pool_size(renderer->pool) *
+		TILES_PER_THREAD;
+	job.tile_height = (height + tiles_len - 1) / tiles_len;
+	if (job.tile_height < MIN_TILE_HEIGHT) {
+		job.tile_height = MIN_TILE_HEIGHT;
+	}
+	tiles_len = (height + job.tile_height - 1) / job.tile_height;
+
+	pixman_thread_pool_run(renderer->pool, tiles_len, render_tile, &job);
+
+	release_commands(renderer);
+}
+
+void wlr_pixman_renderer_bind_image(struct wlr_renderer *wlr_renderer,
+		pixman_image_t *image) {
+	struct wlr_pixman_renderer *renderer = pixman_get_renderer(wlr_renderer);
+	if (renderer->image == image) {
+		return;
+	}
+
+	wlr_pixman_renderer_flush(&renderer->wlr_renderer);
+	renderer->image = image;
+	if (image != NULL) {
+		renderer->viewport_width = pixman_image_get_width(image);
+		renderer->viewport_height = pixman_image_get_height(image);
+	}
+}
+
+struct wlr_renderer *wlr_pixman_renderer_create(void) {
+	struct wlr_pixman_renderer *renderer =
+		calloc(1, sizeof(struct wlr_pixman_renderer));
+	if (renderer == NULL) {
+		return NULL;
+	}
+	wlr_renderer_init(&renderer->wlr_renderer, &renderer_impl);
+	wl_array_init(&renderer->commands);
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t workers = cpus > 1 ? cpus - 1 : 0;
+	if (workers > MAX_WORKERS) {
+		workers = MAX_WORKERS;
+	}
+	renderer->pool = pixman_thread_pool_create(workers);
+	if (renderer->pool == NULL) {
+		wlr_log(L_ERROR, "Failed to create thread pool");
+		wl_array_release(&renderer->commands);
+		free(renderer);
+		return NULL;
+	}
+
+	wlr_log(L_INFO, "Created pixman renderer with %zu threads",
+		pixman_thread_pool_size(renderer->pool));
+
+	return &renderer->wlr_renderer;
+}
@@ -0,0 +1,109 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <pixman.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <wayland-server-protocol.h>
+#include <wlr/render/interface.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/util/log.h>
+#include "render/pixman.h"
+
+static const struct wlr_texture_impl texture_impl;
+
+struct wlr_pixman_texture *pixman_get_texture(
+		struct wlr_texture *wlr_texture) {
+	assert(wlr_texture->impl == &texture_impl);
+	return (struct wlr_pixman_texture *)wlr_texture;
+}
+
+static void pixman_texture_get_size(struct wlr_texture *wlr_texture,
+		int *width, int *height) {
+	struct wlr_pixman_texture *texture = pixman_get_texture(wlr_texture);
+	*width = texture->width;
+	*height = texture->height;
+}
+
+static bool pixman_texture_write_pixels(struct wlr_texture *wlr_texture,
+		enum wl_shm_format wl_fmt, uint32_t stride, uint32_t width,
+		uint32_t height, uint32_t src_x, uint32_t src_y, uint32_t dst_x,
+		uint32_t dst_y, const void *data) {
+	struct wlr_pixman_texture *texture = pixman_get_texture(wlr_texture);
+
+	const struct pixman_pixel_format *fmt = pixman_format_from_wl(wl_fmt);
+	if (fmt == NULL) {
+		wlr_log(L_ERROR, "Unsupported pixel format %"PRIu32, wl_fmt);
+		return false;
+	}
+
+	// Wrap the source data without copying it, pixman converts between
+	// formats if needed
+	pixman_image_t *src = pixman_image_create_bits_no_clear(fmt->pixman_format,
+		src_x + width, src_y + height, (uint32_t *)data, stride);
+	if (src == NULL) {
+		wlr_log(L_ERROR, "Failed to wrap pixel data");
+		return false;
+	}
+
+	pixman_image_composite32(PIXMAN_OP_SRC, src, NULL, texture->image,
+		src_x, src_y, 0, 0, dst_x, dst_y, width, height);
+
+	pixman_image_unref(src);
+	return true;
+}
+
+static void pixman_texture_destroy(struct wlr_texture *wlr_texture) {
+	if (wlr_texture == NULL) {
+		return;
+	}
+
+	struct wlr_pixman_texture *texture = pixman_get_texture(wlr_texture);
+
+	// Pending commands hold their own reference to the image
+	pixman_image_unref(texture->image);
+	free(texture);
+}
+
+static const struct wlr_texture_impl texture_impl = {
+	.get_size = pixman_texture_get_size,
+	.write_pixels = pixman_texture_write_pixels,
+	.destroy = pixman_texture_destroy,
+};
+
+struct wlr_texture *pixman_texture_from_pixels(enum wl_shm_format wl_fmt,
+		uint32_t stride, uint32_t width, uint32_t height, const void *data) {
+	const struct pixman_pixel_format *fmt = pixman_format_from_wl(wl_fmt);
+	if (fmt == NULL) {
+		wlr_log(L_ERROR, "Unsupported pixel format %"PRIu32, wl_fmt);
+		return NULL;
+	}
+
+	struct wlr_pixman_texture *texture =
+		calloc(1, sizeof(struct wlr_pixman_texture));
+	if (texture == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		return NULL;
+	}
+	wlr_texture_init(&texture->wlr_texture, &texture_impl);
+	texture->width = width;
+	texture->height = height;
+	texture->has_alpha = fmt->has_alpha;
+
+	// Let pixman allocate the storage, the client buffer can go away
+	// right after this call
+	texture->image = pixman_image_create_bits_no_clear(fmt->pixman_format,
+		width, height, NULL, 0);
+	if (texture->image == NULL) {
+		wlr_log(L_ERROR, "Failed to allocate texture image");
+		free(texture);
+		return NULL;
+	}
+
+	if (!pixman_texture_write_pixels(&texture->wlr_texture, wl_fmt, stride,
+			width, height, 0, 0, 0, 0, data)) {
+		pixman_texture_destroy(&texture->wlr_texture);
+		return NULL;
+	}
+
+	return &texture->wlr_texture;
+}
@@ -0,0 +1,141 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <wlr/util/log.h>
+#include "render/pixman.h"
+
+struct pixman_thread_pool {
+	pthread_mutex_t mutex;
+	pthread_cond_t job_cond; // signalled when a batch is submitted
+	pthread_cond_t done_cond; // signalled when a batch completes
+
+	pthread_t *threads;
+	size_t threads_len;
+	bool stop;
+
+	// Current batch
+	void (*func)(size_t index, void *data);
+	void *data;
+	size_t next, len, pending;
+};
+
+// Must be called with the mutex held, returns with the mutex held
+static void run_job(struct pixman_thread_pool *pool) {
+	size_t index = pool->next++;
+	void (*func)(size_t index, void *data) = pool->func;
+	void *data = pool->data;
+
+	pthread_mutex_unlock(&pool->mutex);
+	func(index, data);
+	pthread_mutex_lock(&pool->mutex);
+
+	if (--pool->pending == 0) {
+		pthread_cond_broadcast(&pool->done_cond);
+	}
+}
+
+static void *worker_run(void *data) {
+	struct pixman_thread_pool *pool = data;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (true) {
+		while (!pool->stop && pool->next >= pool->len) {
+			pthread_cond_wait(&pool->job_cond, &pool->mutex);
+		}
+		if (pool->stop) {
+			break;
+		}
+		run_job(pool);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+struct pixman_thread_pool *pixman_thread_pool_create(size_t workers) {
+	struct pixman_thread_pool *pool =
+		calloc(1, sizeof(struct pixman_thread_pool));
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->job_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	if (workers > 0) {
+		pool->threads = calloc(workers, sizeof(pthread_t));
+		if (pool->threads == NULL) {
+			workers = 0;
+		}
+	}
+
+	for (size_t i = 0; i < workers; ++i) {
+		if (pthread_create(&pool->threads[i], NULL, worker_run, pool) != 0) {
+			wlr_log(L_ERROR, "Failed to create worker thread, "
+				"continuing with %zu", pool->threads_len);
+			break;
+		}
+		pool->threads_len++;
+	}
+
+	return pool;
+}
+
+void pixman_thread_pool_destroy(struct pixman_thread_pool *pool) {
+	if (pool == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->job_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (size_t i = 0; i < pool->threads_len; ++i) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->job_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->threads);
+	free(pool);
+}
+
+size_t pixman_thread_pool_size(struct pixman_thread_pool *pool) {
+	return pool->threads_len + 1;
+}
+
+void pixman_thread_pool_run(struct pixman_thread_pool *pool, size_t len,
+		void (*func)(size_t index, void *data), void *data) {
+	if (len == 0) {
+		return;
+	}
+	if (pool->threads_len == 0 || len == 1) {
+		for (size_t i = 0; i < len; ++i) {
+			func(i, data);
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->func = func;
+	pool->data = data;
+	pool->next = 0;
+	pool->len = len;
+	pool->pending = len;
+	pthread_cond_broadcast(&pool->job_cond);
+
+	// Help out instead of idling
+	while (pool->next < pool->len) {
+		run_job(pool);
+	}
+	while (pool->pending > 0) {
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	}
+	pool->len = 0;
+	pool->next = 0;
+	pthread_mutex_unlock(&pool->mutex);
+}
@@ -1,6 +1,9 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <wlr/render/interface.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_matrix.h>
@@ -17,6 +20,10 @@ void wlr_renderer_init(struct wlr_renderer *renderer,
 	assert(impl->format_supported);
 	assert(impl->texture_from_pixels);
 	renderer->impl = impl;
+
+	memset(&renderer->stats, 0, sizeof(renderer->stats));
+	renderer->stats.cpu_time_ns = -1;
+	renderer->stats.gpu_time_ns = -1;
 }
 
 void wlr_renderer_destroy(struct wlr_renderer *r) {
@@ -27,7 +34,18 @@ void wlr_renderer_destroy(struct wlr_renderer *r) {
 	}
 }
 
+static int64_t timespec_to_nsec(const struct timespec *ts) {
+	return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
 void wlr_renderer_begin(struct wlr_renderer *r, int width, int height) {
+	uint64_t frame = r->stats.frame + 1;
+	memset(&r->stats, 0, sizeof(r->stats));
+	r->stats.frame = frame;
+	r->stats.cpu_time_ns = -1;
+	r->stats.gpu_time_ns = -1;
+	clock_gettime(CLOCK_MONOTONIC, &r->begin_time);
+
 	r->impl->begin(r, width, height);
 }
 
@@ -35,6 +53,22 @@ void wlr_renderer_end(struct wlr_renderer *r) {
 	if (r->impl->end) {
 		r->impl->end(r);
 	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	r->stats.cpu_time_ns =
+		timespec_to_nsec(&now) - timespec_to_nsec(&r->begin_time);
+}
+
+const struct wlr_render_stats *wlr_renderer_get_stats(struct wlr_renderer *r) {
+	return &r->stats;
+}
+
+int64_t wlr_renderer_get_gpu_time(struct wlr_renderer *r, uint64_t frame) {
+	if (!r->impl->get_gpu_time) {
+		return -1;
+	}
+	return r->impl->get_gpu_time(r, frame);
 }
 
 void wlr_renderer_clear(struct wlr_renderer *r, const float color[static 4]) {
@@ -42,6 +76,9 @@ void wlr_renderer_clear(struct wlr_renderer *r, const float color[static 4]) {
 }
 
 void wlr_renderer_scissor(struct wlr_renderer *r, struct wlr_box *box) {
+	if (box != NULL) {
+		r->stats.rects++;
+	}
 	r->impl->scissor(r, box);
 }
 
@@ -60,9 +97,66 @@ bool wlr_render_texture(struct wlr_renderer *r, struct wlr_texture *texture,
 bool wlr_render_texture_with_matrix(struct wlr_renderer *r,
 		struct wlr_texture *texture, const float matrix[static 9],
 		float alpha) {
+	r->stats.draw_calls++;
 	return r->impl->render_texture_with_matrix(r, texture, matrix, alpha);
 }
 
+bool wlr_render_texture_with_matrix_region(struct wlr_renderer *r,
+		struct wlr_texture *texture, const float matrix[static 9],
+		float alpha, pixman_region32_t *region) {
+	if (r->impl->render_texture_with_matrix_region) {
+		r->stats.draw_calls++;
+		r->stats.rects += pixman_region32_n_rects(region);
+		return r->impl->render_texture_with_matrix_region(r, texture, matrix,
+			alpha, region);
+	}
+
+	bool ok = true;
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		struct wlr_box box = {
+			.x = rects[i].x1,
+			.y = rects[i].y1,
+			.width = rects[i].x2 - rects[i].x1,
+			.height = rects[i].y2 - rects[i].y1,
+		};
+		wlr_renderer_scissor(r, &box);
+		ok = wlr_render_texture_with_matrix(r, texture, matrix, alpha) && ok;
+	}
+	wlr_renderer_scissor(r, NULL);
+	return ok;
+}
+
+bool wlr_render_texture_with_matrix_opaque_region(struct wlr_renderer *r,
+		struct wlr_texture *texture, const float matrix[static 9],
+		float alpha, pixman_region32_t *region, pixman_region32_t *opaque) {
+	if (!r->impl->render_opaque_texture_with_matrix_region || alpha < 1.0 ||
+			!pixman_region32_not_empty(opaque)) {
+		return wlr_render_texture_with_matrix_region(r, texture, matrix,
+			alpha, region);
+	}
+
+	pixman_region32_t opaque_region, translucent_region;
+	pixman_region32_init(&opaque_region);
+	pixman_region32_init(&translucent_region);
+	pixman_region32_intersect(&opaque_region, region, opaque);
+	pixman_region32_subtract(&translucent_region, region, opaque);
+
+	r->stats.draw_calls++;
+	r->stats.rects += pixman_region32_n_rects(&opaque_region);
+	bool ok = r->impl->render_opaque_texture_with_matrix_region(r, texture,
+		matrix, &opaque_region);
+	if (pixman_region32_not_empty(&translucent_region)) {
+		ok = wlr_render_texture_with_matrix_region(r, texture, matrix, alpha,
+			&translucent_region) && ok;
+	}
+
+	pixman_region32_fini(&opaque_region);
+	pixman_region32_fini(&translucent_region);
+	return ok;
+}
+
 void wlr_render_rect(struct wlr_renderer *r, const struct wlr_box *box,
 		const float color[static 4], const float projection[static 9]) {
 	float matrix[9];
@@ -74,6 +168,7 @@ void wlr_render_rect(struct wlr_renderer *r, const struct wlr_box *box,
 
 void wlr_render_quad_with_matrix(struct wlr_renderer *r,
 		const float color[static 4], const float matrix[static 9]) {
+	r->stats.draw_calls++;
 	r->impl->render_quad_with_matrix(r, color, matrix);
 }
 
@@ -88,6 +183,7 @@ void wlr_render_ellipse(struct wlr_renderer *r, const struct wlr_box *box,
 
 void wlr_render_ellipse_with_matrix(struct wlr_renderer *r,
 		const float color[static 4], const float matrix[static 9]) {
+	r->stats.draw_calls++;
 	r->impl->render_ellipse_with_matrix(r, color, matrix);
 }
 
@@ -147,6 +243,70 @@ bool wlr_renderer_read_pixels(struct wlr_renderer *r, enum wl_shm_format fmt,
 		dst_x, dst_y, data);
 }
 
+struct wlr_renderer_readback *wlr_renderer_readback_start(
+		struct wlr_renderer *r, enum wl_shm_format fmt, uint32_t width,
+		uint32_t height, uint32_t src_x, uint32_t src_y) {
+	if (r->impl->readback_start) {
+		struct wlr_renderer_readback *readback =
+			r->impl->readback_start(r, fmt, width, height, src_x, src_y);
+		if (readback != NULL) {
+			return readback;
+		}
+	}
+
+	// Fall back to a synchronous read into an intermediate buffer. All
+	// formats supported by renderers are 32bpp.
+	struct wlr_renderer_readback *readback =
+		calloc(1, sizeof(struct wlr_renderer_readback));
+	if (readback == NULL) {
+		return NULL;
+	}
+	readback->fmt = fmt;
+	readback->width = width;
+	readback->height = height;
+	readback->stride = width * 4;
+	readback->pixels = malloc((size_t)readback->stride * height);
+	if (readback->pixels == NULL ||
+			!wlr_renderer_read_pixels(r, fmt, readback->stride, width, height,
+				src_x, src_y, 0, 0, readback->pixels)) {
+		free(readback->pixels);
+		free(readback);
+		return NULL;
+	}
+	return readback;
+}
+
+bool wlr_renderer_readback_finish(struct wlr_renderer *r,
+		struct wlr_renderer_readback *readback, uint32_t stride, uint32_t dst_x,
+		uint32_t dst_y, void *data) {
+	bool ok = true;
+	if (readback->pixels != NULL) {
+		unsigned char *dst = (unsigned char *)data + dst_y * stride + dst_x * 4;
+		const unsigned char *src = readback->pixels;
+		for (uint32_t i = 0; i < readback->height; ++i) {
+			memcpy(dst + i * stride, src + i * readback->stride,
+				readback->width * 4);
+		}
+	} else {
+		ok = r->impl->readback_finish(r, readback, stride, dst_x, dst_y, data);
+	}
+	wlr_renderer_readback_destroy(r, readback);
+	return ok;
+}
+
+void wlr_renderer_readback_destroy(struct wlr_renderer *r,
+		struct wlr_renderer_readback *readback) {
+	if (readback == NULL) {
+		return;
+	}
+	if (readback->pixels != NULL) {
+		free(readback->pixels);
+		free(readback);
+		return;
+	}
+	r->impl->readback_destroy(r, readback);
+}
+
 bool wlr_renderer_format_supported(struct wlr_renderer *r,
 		enum wl_shm_format fmt) {
 	return r->impl->format_supported(r, fmt);
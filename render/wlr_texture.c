@@ -9,6 +9,7 @@ void wlr_texture_init(struct wlr_texture *texture,
 	assert(impl->get_size);
 	assert(impl->write_pixels);
 	texture->impl = impl;
+	texture->renderer = NULL;
 }
 
 void wlr_texture_destroy(struct wlr_texture *texture) {
@@ -22,8 +23,13 @@ void wlr_texture_destroy(struct wlr_texture *texture) {
 struct wlr_texture *wlr_texture_from_pixels(struct wlr_renderer *renderer,
 		enum wl_shm_format wl_fmt, uint32_t stride, uint32_t width,
 		uint32_t height, const void *data) {
-	return renderer->impl->texture_from_pixels(renderer, wl_fmt, stride, width,
-		height, data);
+	struct wlr_texture *texture = renderer->impl->texture_from_pixels(renderer,
+		wl_fmt, stride, width, height, data);
+	if (texture != NULL) {
+		texture->renderer = renderer;
+		renderer->stats.uploaded_bytes += (size_t)stride * height;
+	}
+	return texture;
 }
 
 struct wlr_texture *wlr_texture_from_wl_drm(struct wlr_renderer *renderer,
@@ -31,7 +37,13 @@ struct wlr_texture *wlr_texture_from_wl_drm(struct wlr_renderer *renderer,
 	if (!renderer->impl->texture_from_wl_drm) {
 		return NULL;
 	}
-	return renderer->impl->texture_from_wl_drm(renderer, data);
+	struct wlr_texture *texture =
+		renderer->impl->texture_from_wl_drm(renderer, data);
+	if (texture != NULL) {
+		texture->renderer = renderer;
+		renderer->stats.imported_textures++;
+	}
+	return texture;
 }
 
 struct wlr_texture *wlr_texture_from_dmabuf(struct wlr_renderer *renderer,
@@ -39,7 +51,13 @@ struct wlr_texture *wlr_texture_from_dmabuf(struct wlr_renderer *renderer,
 	if (!renderer->impl->texture_from_dmabuf) {
 		return NULL;
 	}
-	return renderer->impl->texture_from_dmabuf(renderer, attribs);
+	struct wlr_texture *texture =
+		renderer->impl->texture_from_dmabuf(renderer, attribs);
+	if (texture != NULL) {
+		texture->renderer = renderer;
+		renderer->stats.imported_textures++;
+	}
+	return texture;
 }
 
 void wlr_texture_get_size(struct wlr_texture *texture, int *width,
@@ -47,10 +65,74 @@ void wlr_texture_get_size(struct wlr_texture *texture, int *width,
 	return texture->impl->get_size(texture, width, height);
 }
 
+/**
+ * Returns the size of a pixel in bytes, or 0 if the format is unknown or has
+ * several planes.
+ */
+static size_t shm_format_bytes_per_pixel(enum wl_shm_format fmt) {
+	switch (fmt) {
+	case WL_SHM_FORMAT_C8:
+	case WL_SHM_FORMAT_RGB332:
+	case WL_SHM_FORMAT_BGR233:
+	case WL_SHM_FORMAT_R8:
+		return 1;
+	case WL_SHM_FORMAT_XRGB4444:
+	case WL_SHM_FORMAT_XBGR4444:
+	case WL_SHM_FORMAT_RGBX4444:
+	case WL_SHM_FORMAT_BGRX4444:
+	case WL_SHM_FORMAT_ARGB4444:
+	case WL_SHM_FORMAT_ABGR4444:
+	case WL_SHM_FORMAT_RGBA4444:
+	case WL_SHM_FORMAT_BGRA4444:
+	case WL_SHM_FORMAT_XRGB1555:
+	case WL_SHM_FORMAT_XBGR1555:
+	case WL_SHM_FORMAT_RGBX5551:
+	case WL_SHM_FORMAT_BGRX5551:
+	case WL_SHM_FORMAT_ARGB1555:
+	case WL_SHM_FORMAT_ABGR1555:
+	case WL_SHM_FORMAT_RGBA5551:
+	case WL_SHM_FORMAT_BGRA5551:
+	case WL_SHM_FORMAT_RGB565:
+	case WL_SHM_FORMAT_BGR565:
+	case WL_SHM_FORMAT_R16:
+	case WL_SHM_FORMAT_RG88:
+	case WL_SHM_FORMAT_GR88:
+		return 2;
+	case WL_SHM_FORMAT_RGB888:
+	case WL_SHM_FORMAT_BGR888:
+		return 3;
+	case WL_SHM_FORMAT_ARGB8888:
+	case WL_SHM_FORMAT_XRGB8888:
+	case WL_SHM_FORMAT_XBGR8888:
+	case WL_SHM_FORMAT_RGBX8888:
+	case WL_SHM_FORMAT_BGRX8888:
+	case WL_SHM_FORMAT_ABGR8888:
+	case WL_SHM_FORMAT_RGBA8888:
+	case WL_SHM_FORMAT_BGRA8888:
+	case WL_SHM_FORMAT_XRGB2101010:
+	case WL_SHM_FORMAT_XBGR2101010:
+	case WL_SHM_FORMAT_RGBX1010102:
+	case WL_SHM_FORMAT_BGRX1010102:
+	case WL_SHM_FORMAT_ARGB2101010:
+	case WL_SHM_FORMAT_ABGR2101010:
+	case WL_SHM_FORMAT_RGBA1010102:
+	case WL_SHM_FORMAT_BGRA1010102:
+	case WL_SHM_FORMAT_RG1616:
+	case WL_SHM_FORMAT_GR1616:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
 bool wlr_texture_write_pixels(struct wlr_texture *texture,
 		enum wl_shm_format wl_fmt, uint32_t stride, uint32_t width,
 		uint32_t height, uint32_t src_x, uint32_t src_y, uint32_t dst_x,
 		uint32_t dst_y, const void *data) {
+	if (texture->renderer != NULL) {
+		texture->renderer->stats.uploaded_bytes +=
+			(size_t)width * height * shm_format_bytes_per_pixel(wl_fmt);
+	}
 	return texture->impl->write_pixels(texture, wl_fmt, stride, width, height,
 		src_x, src_y, dst_x, dst_y, data);
 }
@@ -182,6 +182,16 @@ static void config_handle_cursor(struct roots_config *config,
 	} else if (strcmp(name, "default-image") == 0) {
 		free(cc->default_image);
 		cc->default_image = strdup(value);
+	} else if (strcmp(name, "pointer-frames") == 0) {
+		if (strcmp(value, "each-event") == 0) {
+			cc->pointer_frames = WLR_SEAT_POINTER_FRAME_EACH_EVENT;
+		} else if (strcmp(value, "hardware") == 0) {
+			cc->pointer_frames = WLR_SEAT_POINTER_FRAME_HARDWARE;
+		} else if (strcmp(value, "coalesce") == 0) {
+			cc->pointer_frames = WLR_SEAT_POINTER_FRAME_COALESCE;
+		} else {
+			wlr_log(L_ERROR, "got unknown pointer frames mode: %s", value);
+		}
 	} else {
 		wlr_log(L_ERROR, "got unknown cursor config: %s", name);
 	}
@@ -284,6 +294,18 @@ static int config_ini_handler(void *user, const char *section, const char *name,
 		} else if (strcmp(name, "scale") == 0) {
 			oc->scale = strtof(value, NULL);
 			assert(oc->scale > 0);
+		} else if (strcmp(name, "max-render-time") == 0) {
+			if (strcmp(value, "auto") == 0) {
+				oc->max_render_time = WLR_OUTPUT_MAX_RENDER_TIME_AUTO;
+			} else if (strcmp(value, "off") == 0) {
+				oc->max_render_time = 0;
+			} else {
+				oc->max_render_time = strtol(value, NULL, 10);
+				if (oc->max_render_time < 0) {
+					wlr_log(L_ERROR, "got invalid max render time: %s", value);
+					oc->max_render_time = 0;
+				}
+			}
 		} else if (strcmp(name, "rotate") == 0) {
 			if (strcmp(value, "normal") == 0) {
 				oc->transform = WL_OUTPUT_TRANSFORM_NORMAL;
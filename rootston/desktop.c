@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <wlr/config.h>
 #include <wlr/types/wlr_box.h>
@@ -428,6 +429,8 @@ struct roots_subsurface *subsurface_create(struct roots_view *view,
 	return subsurface;
 }
 
+static void view_index_remove(struct roots_view *view);
+
 void view_destroy(struct roots_view *view) {
 	if (view == NULL) {
 		return;
@@ -469,6 +472,7 @@ void view_map(struct roots_view *view, struct wlr_surface *surface) {
 		&view->new_subsurface);
 
 	wl_list_insert(&view->desktop->views, &view->link);
+	view->stack_serial = ++view->desktop->stack_serial;
 	view_damage_whole(view);
 }
 
@@ -479,6 +483,7 @@ void view_unmap(struct roots_view *view) {
 
 	view_damage_whole(view);
 	wl_list_remove(&view->link);
+	view_index_remove(view);
 
 	wl_list_remove(&view->new_subsurface.link);
 
@@ -516,14 +521,24 @@ void view_setup(struct roots_view *view) {
 	view_update_output(view, NULL);
 }
 
+// Everything that can change the input areas of a view (commits, moves,
+// resizes, rotation, popups) damages it, so the index is updated from there.
 void view_apply_damage(struct roots_view *view) {
+	view_update_index(view);
 	struct roots_output *output;
 	wl_list_for_each(output, &view->desktop->outputs, link) {
 		output_damage_from_view(output, view);
 	}
+
+	// Frame done events are only sent by the primary output, make sure it
+	// repaints even if the damage is elsewhere or empty
+	if (view->primary_output != NULL) {
+		wlr_output_schedule_frame(view->primary_output->wlr_output);
+	}
 }
 
 void view_damage_whole(struct roots_view *view) {
+	view_update_index(view);
 	struct roots_output *output;
 	wl_list_for_each(output, &view->desktop->outputs, link) {
 		output_damage_whole_view(output, view);
@@ -552,6 +567,269 @@ void view_update_size(struct roots_view *view, uint32_t width, uint32_t height)
 	view_damage_whole(view);
 }
 
+void view_raise(struct roots_view *view) {
+	wl_list_remove(&view->link);
+	wl_list_insert(&view->desktop->views, &view->link);
+	view->stack_serial = ++view->desktop->stack_serial;
+}
+
+static int view_index_cell(int coord) {
+	// Round towards negative infinity
+	return coord >= 0 ? coord / ROOTS_VIEW_INDEX_CELL_SIZE :
+		-1 - (-1 - coord) / ROOTS_VIEW_INDEX_CELL_SIZE;
+}
+
+static struct wl_array *view_index_bucket(struct roots_view_index *index,
+		int cx, int cy) {
+	uint32_t hash = (uint32_t)cx * 73856093u ^ (uint32_t)cy * 19349663u;
+	return &index->buckets[hash % ROOTS_VIEW_INDEX_BUCKETS];
+}
+
+static bool bucket_contains(struct wl_array *bucket, struct roots_view *view) {
+	struct roots_view **entry;
+	wl_array_for_each(entry, bucket) {
+		if (*entry == view) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void bucket_remove(struct wl_array *bucket, struct roots_view *view) {
+	struct roots_view **views = bucket->data;
+	size_t len = bucket->size / sizeof(struct roots_view *);
+	for (size_t i = 0; i < len; ++i) {
+		if (views[i] == view) {
+			views[i] = views[len - 1];
+			bucket->size -= sizeof(struct roots_view *);
+			return;
+		}
+	}
+}
+
+/**
+ * Calls `func` for each bucket overlapped by `box`. Buckets are visited at
+ * least once, but may be visited several times.
+ */
+static void view_index_for_each_bucket(struct roots_view_index *index,
+		const struct wlr_box *box,
+		void (*func)(struct wl_array *bucket, struct roots_view *view),
+		struct roots_view *view) {
+	int cx1 = view_index_cell(box->x);
+	int cy1 = view_index_cell(box->y);
+	int cx2 = view_index_cell(box->x + box->width - 1);
+	int cy2 = view_index_cell(box->y + box->height - 1);
+
+	if ((int64_t)(cx2 - cx1 + 1) * (cy2 - cy1 + 1) >=
+			ROOTS_VIEW_INDEX_BUCKETS) {
+		// Large views cover all buckets anyway
+		for (size_t i = 0; i < ROOTS_VIEW_INDEX_BUCKETS; ++i) {
+			func(&index->buckets[i], view);
+		}
+		return;
+	}
+
+	for (int cy = cy1; cy <= cy2; ++cy) {
+		for (int cx = cx1; cx <= cx2; ++cx) {
+			func(view_index_bucket(index, cx, cy), view);
+		}
+	}
+}
+
+static void bucket_add(struct wl_array *bucket, struct roots_view *view) {
+	// Several cells can hash to the same bucket
+	if (bucket_contains(bucket, view)) {
+		return;
+	}
+	struct roots_view **entry =
+		wl_array_add(bucket, sizeof(struct roots_view *));
+	if (entry == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		return;
+	}
+	*entry = view;
+}
+
+/**
+ * Updates the view lists of the outputs, and picks the output sending frame
+ * done events to the view: the one it overlaps the most.
+ */
+void view_update_outputs(struct roots_view *view) {
+	struct roots_desktop *desktop = view->desktop;
+	int best_area = 0;
+	view->primary_output = NULL;
+	view->n_outputs = 0;
+
+	struct roots_output *output;
+	wl_list_for_each(output, &desktop->outputs, link) {
+		output_update_view(output, view);
+
+		struct wlr_box *output_box =
+			wlr_output_layout_get_box(desktop->layout, output->wlr_output);
+		struct wlr_box intersection;
+		if (!view->indexed || output_box == NULL ||
+				!wlr_box_intersection(&view->index_box, output_box,
+					&intersection)) {
+			continue;
+		}
+
+		view->n_outputs++;
+		int area = intersection.width * intersection.height;
+		if (area > best_area) {
+			best_area = area;
+			view->primary_output = output;
+		}
+	}
+}
+
+static void view_index_remove(struct roots_view *view) {
+	if (!view->indexed) {
+		return;
+	}
+	view_index_for_each_bucket(&view->desktop->view_index, &view->index_box,
+		bucket_remove, view);
+	view->indexed = false;
+	view_update_outputs(view);
+}
+
+/**
+ * Calls `iterator` for each surface of the view, including popups. Surface
+ * coordinates are relative to the view and don't take rotation into account.
+ */
+static void view_for_each_local_surface(struct roots_view *view,
+		wlr_surface_iterator_func_t iterator, void *user_data) {
+	switch (view->type) {
+	case ROOTS_XDG_SHELL_V6_VIEW:
+		wlr_xdg_surface_v6_for_each_surface(view->xdg_surface_v6, iterator,
+			user_data);
+		break;
+	case ROOTS_XDG_SHELL_VIEW:
+		wlr_xdg_surface_for_each_surface(view->xdg_surface, iterator,
+			user_data);
+		break;
+	case ROOTS_WL_SHELL_VIEW:
+		wlr_wl_shell_surface_for_each_surface(view->wl_shell_surface, iterator,
+			user_data);
+		break;
+#ifdef WLR_HAS_XWAYLAND
+	case ROOTS_XWAYLAND_VIEW:
+		wlr_surface_for_each_surface(view->wlr_surface, iterator, user_data);
+		break;
+#endif
+	}
+}
+
+static void surface_send_frame_done(struct wlr_surface *surface,
+		int sx, int sy, void *data) {
+	struct timespec *when = data;
+	wlr_surface_send_frame_done(surface, when);
+}
+
+/**
+ * Sends frame done events to all surfaces of the view.
+ */
+void view_send_frame_done(struct roots_view *view, struct timespec *when) {
+	if (view->wlr_surface == NULL) {
+		return;
+	}
+	view_for_each_local_surface(view, surface_send_frame_done, when);
+	view->last_frame_done = *when;
+}
+
+static void view_bounds_add_surface(struct wlr_surface *surface,
+		int sx, int sy, void *data) {
+	struct wlr_box *bounds = data;
+	int x1 = sx < bounds->x ? sx : bounds->x;
+	int y1 = sy < bounds->y ? sy : bounds->y;
+	int x2 = bounds->x + bounds->width;
+	int y2 = bounds->y + bounds->height;
+	if (sx + surface->current->width > x2) {
+		x2 = sx + surface->current->width;
+	}
+	if (sy + surface->current->height > y2) {
+		y2 = sy + surface->current->height;
+	}
+	bounds->x = x1;
+	bounds->y = y1;
+	bounds->width = x2 - x1;
+	bounds->height = y2 - y1;
+}
+
+/**
+ * Computes the layout-space bounds of everything view_at can return for this
+ * view: the surface tree, popups included, and the decorations.
+ */
+static void view_get_input_bounds(struct roots_view *view,
+		struct wlr_box *box) {
+	struct wlr_surface_state *state = view->wlr_surface->current;
+	int bw = view->decorated ? view->border_width : 0;
+	int titlebar_h = view->decorated ? view->titlebar_height : 0;
+
+	// In view-local coordinates, before rotation
+	struct wlr_box bounds = {
+		.x = -bw,
+		.y = -(bw + titlebar_h),
+		.width = state->width + bw * 2,
+		.height = state->height + bw * 2 + titlebar_h,
+	};
+	view_for_each_local_surface(view, view_bounds_add_surface, &bounds);
+
+	double x1 = bounds.x, y1 = bounds.y;
+	double x2 = bounds.x + bounds.width, y2 = bounds.y + bounds.height;
+	if (view->rotation != 0.0) {
+		// Rotate the corners about the center of the view, like view_at
+		double cx = (double)state->width/2, cy = (double)state->height/2;
+		double c = cos(view->rotation), s = sin(view->rotation);
+		double corners[4][2] = {
+			{ x1 - cx, y1 - cy }, { x2 - cx, y1 - cy },
+			{ x2 - cx, y2 - cy }, { x1 - cx, y2 - cy },
+		};
+		x1 = y1 = INFINITY;
+		x2 = y2 = -INFINITY;
+		for (size_t i = 0; i < 4; ++i) {
+			double rx = c * corners[i][0] - s * corners[i][1] + cx;
+			double ry = s * corners[i][0] + c * corners[i][1] + cy;
+			x1 = fmin(x1, rx);
+			y1 = fmin(y1, ry);
+			x2 = fmax(x2, rx);
+			y2 = fmax(y2, ry);
+		}
+	}
+
+	// Round outwards, with some slack for rounding errors in the rotation
+	int slack = view->rotation != 0.0 ? 1 : 0;
+	box->x = floor(view->x + x1) - slack;
+	box->y = floor(view->y + y1) - slack;
+	box->width = ceil(view->x + x2) + slack - box->x;
+	box->height = ceil(view->y + y2) + slack - box->y;
+}
+
+/**
+ * Updates the position of the view in the spatial index, adding it if it has
+ * just been mapped.
+ */
+void view_update_index(struct roots_view *view) {
+	if (view->wlr_surface == NULL) {
+		return;
+	}
+
+	struct wlr_box box;
+	view_get_input_bounds(view, &box);
+	if (view->indexed && memcmp(&box, &view->index_box, sizeof(box)) == 0) {
+		return;
+	}
+
+	view_index_remove(view);
+	if (box.width <= 0 || box.height <= 0) {
+		return;
+	}
+	view->index_box = box;
+	view_index_for_each_bucket(&view->desktop->view_index, &view->index_box,
+		bucket_add, view);
+	view->indexed = true;
+	view_update_outputs(view);
+}
+
 static bool view_at(struct roots_view *view, double lx, double ly,
 		struct wlr_surface **surface, double *sx, double *sy) {
 	if (view->type == ROOTS_WL_SHELL_VIEW &&
@@ -634,10 +912,44 @@ static struct roots_view *desktop_view_at(struct roots_desktop *desktop,
 		}
 	}
 
-	struct roots_view *view;
-	wl_list_for_each(view, &desktop->views, link) {
-		if (view_at(view, lx, ly, surface, sx, sy)) {
-			return view;
+	// Only test the views whose bounds contain the point, from top to bottom
+	struct roots_view_index *index = &desktop->view_index;
+	int px = floor(lx), py = floor(ly);
+	struct wl_array *bucket = view_index_bucket(index,
+		view_index_cell(px), view_index_cell(py));
+
+	index->candidates.size = 0;
+	struct roots_view **entry;
+	wl_array_for_each(entry, bucket) {
+		struct wlr_box *box = &(*entry)->index_box;
+		if (px < box->x || px >= box->x + box->width ||
+				py < box->y || py >= box->y + box->height) {
+			continue;
+		}
+		struct roots_view **candidate =
+			wl_array_add(&index->candidates, sizeof(struct roots_view *));
+		if (candidate == NULL) {
+			wlr_log(L_ERROR, "Allocation failed");
+			return NULL;
+		}
+		*candidate = *entry;
+	}
+
+	struct roots_view **candidates = index->candidates.data;
+	size_t len = index->candidates.size / sizeof(struct roots_view *);
+	for (size_t i = 1; i < len; ++i) {
+		struct roots_view *view = candidates[i];
+		size_t j = i;
+		for (; j > 0 && candidates[j - 1]->stack_serial < view->stack_serial;
+				--j) {
+			candidates[j] = candidates[j - 1];
+		}
+		candidates[j] = view;
+	}
+
+	for (size_t i = 0; i < len; ++i) {
+		if (view_at(candidates[i], lx, ly, surface, sx, sy)) {
+			return candidates[i];
 		}
 	}
 	return NULL;
@@ -716,6 +1028,12 @@ static void handle_layout_change(struct wl_listener *listener, void *data) {
 	struct roots_desktop *desktop =
 		wl_container_of(listener, desktop, layout_change);
 
+	// Outputs may have moved, rebuild their view lists
+	struct roots_view *view;
+	wl_list_for_each(view, &desktop->views, link) {
+		view_update_outputs(view);
+	}
+
 	struct wlr_output *center_output =
 		wlr_output_layout_get_center_output(desktop->layout);
 	if (center_output == NULL) {
@@ -727,7 +1045,6 @@ static void handle_layout_change(struct wl_listener *listener, void *data) {
 	double center_x = center_output_box->x + center_output_box->width/2;
 	double center_y = center_output_box->y + center_output_box->height/2;
 
-	struct roots_view *view;
 	wl_list_for_each(view, &desktop->views, link) {
 		struct wlr_box box;
 		view_get_box(view, &box);
@@ -740,6 +1057,29 @@ static void handle_layout_change(struct wl_listener *listener, void *data) {
 	}
 }
 
+static int handle_frame_done_timer(void *data) {
+	struct roots_desktop *desktop = data;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	// Views which didn't get any frame done event lately are hidden or
+	// off-screen, throttle them instead of stalling them
+	struct roots_view *view;
+	wl_list_for_each(view, &desktop->views, link) {
+		int64_t elapsed_ms =
+			(int64_t)(now.tv_sec - view->last_frame_done.tv_sec) * 1000 +
+			(now.tv_nsec - view->last_frame_done.tv_nsec) / 1000000;
+		if (elapsed_ms >= ROOTS_FRAME_DONE_FALLBACK_MS) {
+			view_send_frame_done(view, &now);
+		}
+	}
+
+	wl_event_source_timer_update(desktop->frame_done_timer,
+		ROOTS_FRAME_DONE_FALLBACK_MS);
+	return 0;
+}
+
 static void input_inhibit_activate(struct wl_listener *listener, void *data) {
 	struct roots_desktop *desktop = wl_container_of(
 			listener, desktop, input_inhibit_activate);
@@ -770,6 +1110,10 @@ struct roots_desktop *desktop_create(struct roots_server *server,
 
 	wl_list_init(&desktop->views);
 	wl_list_init(&desktop->outputs);
+	for (size_t i = 0; i < ROOTS_VIEW_INDEX_BUCKETS; ++i) {
+		wl_array_init(&desktop->view_index.buckets[i]);
+	}
+	wl_array_init(&desktop->view_index.candidates);
 
 	desktop->new_output.notify = handle_new_output;
 	wl_signal_add(&server->backend->events.new_output, &desktop->new_output);
@@ -871,6 +1215,12 @@ struct roots_desktop *desktop_create(struct roots_server *server,
 
 	desktop->linux_dmabuf = wlr_linux_dmabuf_create(server->wl_display,
 		server->renderer);
+	desktop->presentation = wlr_presentation_create(server->wl_display);
+
+	desktop->frame_done_timer = wl_event_loop_add_timer(server->wl_event_loop,
+		handle_frame_done_timer, desktop);
+	wl_event_source_timer_update(desktop->frame_done_timer,
+		ROOTS_FRAME_DONE_FALLBACK_MS);
 	return desktop;
 }
 
@@ -1,7 +1,9 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <wlr/config.h>
 #include <wlr/types/wlr_matrix.h>
@@ -127,12 +129,31 @@ static void drag_icons_for_each_surface(struct roots_input *input,
 }
 
 
+enum render_entry_type {
+	RENDER_ENTRY_SURFACE,
+	RENDER_ENTRY_DECORATION,
+};
+
+/**
+ * Something to draw on the output. Entries are collected bottom to top so that
+ * parts hidden behind opaque entries can be culled before drawing.
+ */
+struct render_entry {
+	enum render_entry_type type;
+	struct wlr_surface *surface; // RENDER_ENTRY_SURFACE only
+	struct wlr_box box; // in output-local coordinates
+	float rotation;
+	float alpha;
+	pixman_region32_t damage; // area to redraw, in output-local coordinates
+};
+
 struct render_data {
 	struct layout_data layout;
 	struct roots_output *output;
 	struct timespec *when;
 	pixman_region32_t *damage;
 	float alpha;
+	struct wl_array entries; // struct render_entry
 };
 
 /**
@@ -185,6 +206,57 @@ static void scissor_output(struct roots_output *output, pixman_box32_t *rect) {
 	wlr_renderer_scissor(renderer, &box);
 }
 
+/**
+ * Transforms a region in output-local coordinates into renderer coordinates.
+ */
+static void region_to_renderer(struct roots_output *output,
+		pixman_region32_t *region) {
+	struct wlr_output *wlr_output = output->wlr_output;
+	int ow, oh;
+	wlr_output_transformed_resolution(wlr_output, &ow, &oh);
+
+	// Renderer coordinates are upside down
+	enum wl_output_transform transform = wlr_output_transform_compose(
+		wlr_output_transform_invert(wlr_output->transform),
+		WL_OUTPUT_TRANSFORM_FLIPPED_180);
+	wlr_region_transform_arena(region, region, transform, ow, oh,
+		&wlr_output->frame_arena);
+}
+
+/**
+ * Adds an entry to the render list if it intersects the damaged area.
+ */
+static void push_render_entry(struct render_data *data,
+		enum render_entry_type type, struct wlr_surface *surface,
+		const struct wlr_box *box, float rotation) {
+	struct wlr_box rotated;
+	wlr_box_rotated_bounds(box, rotation, &rotated);
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	pixman_region32_intersect_rect(&damage, data->damage, rotated.x,
+		rotated.y, rotated.width, rotated.height);
+	if (!pixman_region32_not_empty(&damage)) {
+		pixman_region32_fini(&damage);
+		return;
+	}
+
+	struct render_entry *entry =
+		wl_array_add(&data->entries, sizeof(struct render_entry));
+	if (entry == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		pixman_region32_fini(&damage);
+		return;
+	}
+	entry->type = type;
+	entry->surface = surface;
+	entry->box = *box;
+	entry->rotation = rotation;
+	entry->alpha = data->alpha;
+	// The region is moved into the entry
+	entry->damage = damage;
+}
+
 static void render_surface(struct wlr_surface *surface, int sx, int sy,
 		void *_data) {
 	struct render_data *data = _data;
@@ -195,10 +267,6 @@ static void render_surface(struct wlr_surface *surface, int sx, int sy,
 		return;
 	}
 
-	struct wlr_renderer *renderer =
-		wlr_backend_get_renderer(output->wlr_output->backend);
-	assert(renderer);
-
 	double lx, ly;
 	get_layout_position(&data->layout, &lx, &ly, surface, sx, sy);
 
@@ -209,35 +277,10 @@ static void render_surface(struct wlr_surface *surface, int sx, int sy,
 		return;
 	}
 
-	struct wlr_box rotated;
-	wlr_box_rotated_bounds(&box, rotation, &rotated);
-
-	pixman_region32_t damage;
-	pixman_region32_init(&damage);
-	pixman_region32_union_rect(&damage, &damage, rotated.x, rotated.y,
-		rotated.width, rotated.height);
-	pixman_region32_intersect(&damage, &damage, data->damage);
-	bool damaged = pixman_region32_not_empty(&damage);
-	if (!damaged) {
-		goto damage_finish;
-	}
-
-	float matrix[9];
-	enum wl_output_transform transform =
-		wlr_output_transform_invert(surface->current->transform);
-	wlr_matrix_project_box(matrix, &box, transform, rotation,
-		output->wlr_output->transform_matrix);
-
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
-		wlr_render_texture_with_matrix(renderer, surface->texture, matrix,
-			data->alpha);
-	}
+	wlr_presentation_surface_sampled_on_output(output->desktop->presentation,
+		surface, output->wlr_output);
 
-damage_finish:
-	pixman_region32_fini(&damage);
+	push_render_entry(data, RENDER_ENTRY_SURFACE, surface, &box, rotation);
 }
 
 static void get_decoration_box(struct roots_view *view,
@@ -268,42 +311,122 @@ static void render_decorations(struct roots_view *view,
 		return;
 	}
 
-	struct roots_output *output = data->output;
+	struct wlr_box box;
+	get_decoration_box(view, data->output, &box);
+
+	push_render_entry(data, RENDER_ENTRY_DECORATION, NULL, &box,
+		view->rotation);
+}
+
+/**
+ * Computes the opaque area of a render entry, in output-local coordinates.
+ */
+static void render_entry_opaque_region(struct roots_output *output,
+		struct render_entry *entry, pixman_region32_t *opaque) {
+	// Rotated and translucent entries don't hide anything
+	if (entry->rotation != 0.0 || entry->alpha < 1.0) {
+		pixman_region32_clear(opaque);
+		return;
+	}
+
+	switch (entry->type) {
+	case RENDER_ENTRY_SURFACE:;
+		float scale = output->wlr_output->scale;
+		wlr_region_scale(opaque, &entry->surface->current->opaque, scale);
+		if (scale != floorf(scale)) {
+			// Scaling rounds outwards, make sure we don't cull pixels that
+			// are only partly covered
+			wlr_region_expand(opaque, opaque, -1);
+		}
+		pixman_region32_translate(opaque, entry->box.x, entry->box.y);
+		pixman_region32_intersect_rect(opaque, opaque, entry->box.x,
+			entry->box.y, entry->box.width, entry->box.height);
+		break;
+	case RENDER_ENTRY_DECORATION:
+		pixman_region32_fini(opaque);
+		pixman_region32_init_rect(opaque, entry->box.x, entry->box.y,
+			entry->box.width, entry->box.height);
+		break;
+	}
+}
+
+/**
+ * Walks the render list front to back and removes the parts of each entry
+ * hidden behind opaque entries stacked above it. On return, `damage` only
+ * contains the damaged area not covered by any opaque entry.
+ */
+static void cull_render_entries(struct roots_output *output,
+		struct wl_array *entries, pixman_region32_t *damage) {
+	pixman_region32_t opaque;
+	pixman_region32_init(&opaque);
+
+	struct render_entry *first = entries->data;
+	size_t len = entries->size / sizeof(struct render_entry);
+	for (size_t i = len; i-- > 0;) {
+		struct render_entry *entry = &first[i];
+
+		pixman_region32_intersect(&entry->damage, &entry->damage, damage);
+		if (!pixman_region32_not_empty(&entry->damage)) {
+			continue;
+		}
+
+		render_entry_opaque_region(output, entry, &opaque);
+		pixman_region32_subtract(damage, damage, &opaque);
+	}
+
+	pixman_region32_fini(&opaque);
+}
+
+static void render_entry(struct roots_output *output,
+		struct render_entry *entry) {
 	struct wlr_renderer *renderer =
 		wlr_backend_get_renderer(output->wlr_output->backend);
 	assert(renderer);
 
-	struct wlr_box box;
-	get_decoration_box(view, output, &box);
-
-	struct wlr_box rotated;
-	wlr_box_rotated_bounds(&box, view->rotation, &rotated);
-
-	pixman_region32_t damage;
-	pixman_region32_init(&damage);
-	pixman_region32_union_rect(&damage, &damage, rotated.x, rotated.y,
-		rotated.width, rotated.height);
-	pixman_region32_intersect(&damage, &damage, data->damage);
-	bool damaged = pixman_region32_not_empty(&damage);
-	if (!damaged) {
-		goto damage_finish;
+	if (!pixman_region32_not_empty(&entry->damage)) {
+		return;
 	}
 
 	float matrix[9];
-	wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL,
-		view->rotation, output->wlr_output->transform_matrix);
-	float color[] = { 0.2, 0.2, 0.2, view->alpha };
+	switch (entry->type) {
+	case RENDER_ENTRY_SURFACE:;
+		struct wlr_surface *surface = entry->surface;
+		struct wlr_texture *texture = wlr_surface_get_texture(surface);
+		if (texture == NULL) {
+			// The upload of the surface's buffer failed
+			break;
+		}
 
-	int nrects;
-	pixman_box32_t *rects =
-		pixman_region32_rectangles(&damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
-		wlr_render_quad_with_matrix(renderer, color, matrix);
+		enum wl_output_transform transform =
+			wlr_output_transform_invert(surface->current->transform);
+		wlr_matrix_project_box(matrix, &entry->box, transform,
+			entry->rotation, output->wlr_output->transform_matrix);
+
+		// Opaque parts can be drawn without blending
+		pixman_region32_t opaque;
+		pixman_region32_init(&opaque);
+		render_entry_opaque_region(output, entry, &opaque);
+		region_to_renderer(output, &opaque);
+
+		region_to_renderer(output, &entry->damage);
+		wlr_render_texture_with_matrix_opaque_region(renderer, texture,
+			matrix, entry->alpha, &entry->damage, &opaque);
+		pixman_region32_fini(&opaque);
+		break;
+	case RENDER_ENTRY_DECORATION:
+		wlr_matrix_project_box(matrix, &entry->box, WL_OUTPUT_TRANSFORM_NORMAL,
+			entry->rotation, output->wlr_output->transform_matrix);
+		float color[] = { 0.2, 0.2, 0.2, entry->alpha };
+
+		int nrects;
+		pixman_box32_t *rects =
+			pixman_region32_rectangles(&entry->damage, &nrects);
+		for (int i = 0; i < nrects; ++i) {
+			scissor_output(output, &rects[i]);
+			wlr_render_quad_with_matrix(renderer, color, matrix);
+		}
+		break;
 	}
-
-damage_finish:
-	pixman_region32_fini(&damage);
 }
 
 static void render_view(struct roots_view *view, struct render_data *data) {
@@ -382,6 +505,160 @@ static void layers_send_done(
 	}
 }
 
+static bool output_find_view(struct roots_output *output,
+		struct roots_view *view, size_t *index) {
+	struct roots_view **views = output->views.data;
+	size_t len = output->views.size / sizeof(struct roots_view *);
+	for (size_t i = 0; i < len; ++i) {
+		if (views[i] == view) {
+			if (index != NULL) {
+				*index = i;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Adds the view to the output's view list if its bounds intersect the output,
+ * removes it otherwise.
+ */
+void output_update_view(struct roots_output *output, struct roots_view *view) {
+	bool intersects = view->indexed && wlr_output_layout_intersects(
+		output->desktop->layout, output->wlr_output, &view->index_box);
+
+	size_t index;
+	bool found = output_find_view(output, view, &index);
+	if (intersects && !found) {
+		struct roots_view **entry =
+			wl_array_add(&output->views, sizeof(struct roots_view *));
+		if (entry == NULL) {
+			wlr_log(L_ERROR, "Allocation failed");
+			return;
+		}
+		*entry = view;
+	} else if (!intersects && found) {
+		struct roots_view **views = output->views.data;
+		size_t len = output->views.size / sizeof(struct roots_view *);
+		memmove(&views[index], &views[index + 1],
+			(len - index - 1) * sizeof(struct roots_view *));
+		output->views.size -= sizeof(struct roots_view *);
+	}
+}
+
+/**
+ * Sorts the output's view list from bottom to top. The list is kept in the
+ * previous frame's order, so it's almost always sorted already.
+ */
+static void output_sort_views(struct roots_output *output) {
+	struct roots_view **views = output->views.data;
+	size_t len = output->views.size / sizeof(struct roots_view *);
+	for (size_t i = 1; i < len; ++i) {
+		struct roots_view *view = views[i];
+		size_t j = i;
+		for (; j > 0 && views[j - 1]->stack_serial > view->stack_serial; --j) {
+			views[j] = views[j - 1];
+		}
+		views[j] = view;
+	}
+}
+
+struct opaque_data {
+	struct layout_data layout;
+	pixman_region32_t *opaque; // in layout coordinates
+};
+
+static void opaque_add_surface(struct wlr_surface *surface, int sx, int sy,
+		void *_data) {
+	struct opaque_data *data = _data;
+	pixman_region32_t *opaque = data->opaque;
+
+	if (!wlr_surface_has_buffer(surface)) {
+		return;
+	}
+
+	double lx, ly;
+	get_layout_position(&data->layout, &lx, &ly, surface, sx, sy);
+
+	pixman_region32_t region;
+	pixman_region32_init(&region);
+	pixman_region32_copy(&region, &surface->current->opaque);
+	pixman_region32_intersect_rect(&region, &region, 0, 0,
+		surface->current->width, surface->current->height);
+	// Round inwards, a partly covered pixel isn't hidden
+	pixman_region32_translate(&region, floor(lx), floor(ly));
+	if (lx != floor(lx) || ly != floor(ly)) {
+		wlr_region_expand(&region, &region, -1);
+	}
+	pixman_region32_union(opaque, opaque, &region);
+	pixman_region32_fini(&region);
+}
+
+/**
+ * Adds the area hidden by the view to `opaque`, in layout coordinates.
+ */
+static void view_add_opaque_region(struct roots_view *view,
+		pixman_region32_t *opaque) {
+	if (view->rotation != 0.0 || view->alpha < 1.0) {
+		return;
+	}
+
+	if (view->decorated) {
+		struct wlr_box deco_box;
+		view_get_deco_box(view, &deco_box);
+		pixman_region32_union_rect(opaque, opaque, deco_box.x, deco_box.y,
+			deco_box.width, deco_box.height);
+	}
+
+	struct opaque_data data = { .opaque = opaque };
+	view_for_each_surface(view, &data.layout, opaque_add_surface, &data);
+}
+
+/**
+ * Sends frame done events to the views whose primary output is this one,
+ * except those entirely hidden behind opaque views. Views spanning several
+ * outputs are never considered hidden.
+ */
+static void output_send_frame_done(struct roots_output *output,
+		struct timespec *when) {
+	const struct wlr_box *output_box =
+		wlr_output_layout_get_box(output->desktop->layout, output->wlr_output);
+
+	pixman_region32_t opaque, visible;
+	pixman_region32_init(&opaque);
+	pixman_region32_init(&visible);
+
+	output_sort_views(output);
+	struct roots_view **views = output->views.data;
+	size_t len = output->views.size / sizeof(struct roots_view *);
+	for (size_t i = len; i-- > 0;) {
+		struct roots_view *view = views[i];
+
+		if (view->primary_output == output) {
+			bool hidden = false;
+			if (view->n_outputs == 1) {
+				struct wlr_box box;
+				wlr_box_intersection(&view->index_box, output_box, &box);
+				pixman_region32_fini(&visible);
+				pixman_region32_init_rect(&visible, box.x, box.y,
+					box.width, box.height);
+				pixman_region32_subtract(&visible, &visible, &opaque);
+				hidden = !pixman_region32_not_empty(&visible);
+			}
+
+			if (!hidden) {
+				view_send_frame_done(view, when);
+			}
+		}
+
+		view_add_opaque_region(view, &opaque);
+	}
+
+	pixman_region32_fini(&visible);
+	pixman_region32_fini(&opaque);
+}
+
 static void render_output(struct roots_output *output) {
 	struct wlr_output *wlr_output = output->wlr_output;
 	struct roots_desktop *desktop = output->desktop;
@@ -417,6 +694,8 @@ static void render_output(struct roots_output *output) {
 
 		if (has_standalone_surface(view)) {
 			wlr_output_set_fullscreen_surface(wlr_output, view->wlr_surface);
+			wlr_presentation_surface_sampled_on_output(desktop->presentation,
+				view->wlr_surface, wlr_output);
 		} else {
 			wlr_output_set_fullscreen_surface(wlr_output, NULL);
 		}
@@ -440,6 +719,8 @@ static void render_output(struct roots_output *output) {
 		.damage = &damage,
 		.alpha = 1.0,
 	};
+	wl_array_init(&data.entries);
+	struct render_entry *entry;
 
 	if (!needs_swap) {
 		// Output doesn't need swap and isn't damaged, skip rendering completely
@@ -457,13 +738,6 @@ static void render_output(struct roots_output *output) {
 		wlr_renderer_clear(renderer, (float[]){1, 1, 0, 0});
 	}
 
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
-		wlr_renderer_clear(renderer, clear_color);
-	}
-
 	render_layer(output, output_box, &data,
 			&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND]);
 	render_layer(output, output_box, &data,
@@ -475,7 +749,7 @@ static void render_output(struct roots_output *output) {
 
 		if (wlr_output->fullscreen_surface == view->wlr_surface) {
 			// The output will render the fullscreen view
-			goto renderer_end;
+			goto render_entries;
 		}
 
 		if (view->wlr_surface != NULL) {
@@ -492,10 +766,11 @@ static void render_output(struct roots_output *output) {
 		}
 #endif
 	} else {
-		// Render all views
-		struct roots_view *view;
-		wl_list_for_each_reverse(view, &desktop->views, link) {
-			render_view(view, &data);
+		// Render all views on this output
+		output_sort_views(output);
+		struct roots_view **view;
+		wl_array_for_each(view, &output->views) {
+			render_view(*view, &data);
 		}
 		// Render top layer above shell views
 		render_layer(output, output_box, &data,
@@ -510,6 +785,25 @@ static void render_output(struct roots_output *output) {
 	render_layer(output, output_box, &data,
 			&output->layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY]);
 
+render_entries:;
+	// Don't clear or draw what is hidden behind opaque surfaces
+	pixman_region32_t clear;
+	pixman_region32_init(&clear);
+	pixman_region32_copy(&clear, &damage);
+	cull_render_entries(output, &data.entries, &clear);
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(&clear, &nrects);
+	for (int i = 0; i < nrects; ++i) {
+		scissor_output(output, &rects[i]);
+		wlr_renderer_clear(renderer, clear_color);
+	}
+	pixman_region32_fini(&clear);
+
+	wl_array_for_each(entry, &data.entries) {
+		render_entry(output, entry);
+	}
+
 renderer_end:
 	wlr_renderer_scissor(renderer, NULL);
 	wlr_renderer_end(renderer);
@@ -520,6 +814,10 @@ renderer_end:
 
 damage_finish:
 	pixman_region32_fini(&damage);
+	wl_array_for_each(entry, &data.entries) {
+		pixman_region32_fini(&entry->damage);
+	}
+	wl_array_release(&data.entries);
 
 	// Send frame done events to all surfaces
 	if (output->fullscreen_view != NULL) {
@@ -529,8 +827,7 @@ damage_finish:
 			return;
 		}
 
-		view_for_each_surface(view, &data.layout, surface_send_frame_done,
-			&data);
+		view_send_frame_done(view, data.when);
 
 #ifdef WLR_HAS_XWAYLAND
 		if (view->type == ROOTS_XWAYLAND_VIEW) {
@@ -539,11 +836,7 @@ damage_finish:
 		}
 #endif
 	} else {
-		struct roots_view *view;
-		wl_list_for_each_reverse(view, &desktop->views, link) {
-			view_for_each_surface(view, &data.layout, surface_send_frame_done,
-				&data);
-		}
+		output_send_frame_done(output, data.when);
 
 		drag_icons_for_each_surface(server->input, surface_send_frame_done,
 			&data.layout, &data);
@@ -560,6 +853,9 @@ static bool view_accept_damage(struct roots_output *output,
 	if (view->wlr_surface == NULL) {
 		return false;
 	}
+	// Don't look at the view list of the output: the damage may cover the
+	// previous extent of a view that has just left the output. Damage outside
+	// of the output is clipped anyway.
 	if (output->fullscreen_view == NULL) {
 		return true;
 	}
@@ -683,8 +979,8 @@ static void damage_from_surface(struct wlr_surface *surface, int sx, int sy,
 
 	pixman_region32_t damage;
 	pixman_region32_init(&damage);
-	pixman_region32_copy(&damage, &surface->current->surface_damage);
-	wlr_region_scale(&damage, &damage, wlr_output->scale);
+	wlr_region_scale(&damage, &surface->current->surface_damage,
+		wlr_output->scale);
 	if (ceil(wlr_output->scale) > surface->current->scale) {
 		// When scaling up a surface, it'll become blurry so we need to
 		// expand the damage region
@@ -693,7 +989,11 @@ static void damage_from_surface(struct wlr_surface *surface, int sx, int sy,
 	}
 	pixman_region32_translate(&damage, box.x, box.y);
 	wlr_region_rotated_bounds(&damage, &damage, rotation, center_x, center_y);
-	wlr_output_damage_add(output->damage, &damage);
+	// Don't schedule a frame for damage that is entirely off the output
+	pixman_region32_intersect_rect(&damage, &damage, 0, 0, ow, oh);
+	if (pixman_region32_not_empty(&damage)) {
+		wlr_output_damage_add(output->damage, &damage);
+	}
 	pixman_region32_fini(&damage);
 }
 
@@ -750,6 +1050,14 @@ static void output_destroy(struct roots_output *output) {
 	//	sample->compositor);
 
 	wl_list_remove(&output->link);
+	wl_array_release(&output->views);
+
+	struct roots_view *view;
+	wl_list_for_each(view, &output->desktop->views, link) {
+		if (view->primary_output == output) {
+			view_update_outputs(view);
+		}
+	}
 	wl_list_remove(&output->destroy.link);
 	wl_list_remove(&output->damage_frame.link);
 	wl_list_remove(&output->damage_destroy.link);
@@ -765,6 +1073,14 @@ static void output_damage_handle_frame(struct wl_listener *listener,
 		void *data) {
 	struct roots_output *output =
 		wl_container_of(listener, output, damage_frame);
+
+	// Deliver the latest pointer position before clients draw their next
+	// frame
+	struct roots_seat *seat;
+	wl_list_for_each(seat, &output->desktop->server->input->seats, link) {
+		wlr_seat_pointer_flush(seat->seat);
+	}
+
 	render_output(output);
 }
 
@@ -810,6 +1126,7 @@ void handle_new_output(struct wl_listener *listener, void *data) {
 	output->desktop = desktop;
 	output->wlr_output = wlr_output;
 	wlr_output->data = output;
+	wl_array_init(&output->views);
 	wl_list_insert(&desktop->outputs, &output->link);
 
 	output->damage = wlr_output_damage_create(wlr_output);
@@ -840,6 +1157,8 @@ void handle_new_output(struct wl_listener *listener, void *data) {
 			}
 			wlr_output_set_scale(wlr_output, output_config->scale);
 			wlr_output_set_transform(wlr_output, output_config->transform);
+			wlr_output_set_max_render_time(wlr_output,
+				output_config->max_render_time);
 			wlr_output_layout_add(desktop->layout, wlr_output, output_config->x,
 				output_config->y);
 		} else {
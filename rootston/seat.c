@@ -70,6 +70,12 @@ static void handle_cursor_axis(struct wl_listener *listener, void *data) {
 	roots_cursor_handle_axis(cursor, event);
 }
 
+static void handle_cursor_frame(struct wl_listener *listener, void *data) {
+	struct roots_cursor *cursor =
+		wl_container_of(listener, cursor, frame);
+	roots_cursor_handle_frame(cursor);
+}
+
 static void handle_touch_down(struct wl_listener *listener, void *data) {
 	struct roots_cursor *cursor =
 		wl_container_of(listener, cursor, touch_down);
@@ -177,6 +183,7 @@ void roots_seat_configure_cursor(struct roots_seat *seat) {
 		roots_config_get_cursor(config, seat->seat->name);
 	if (cc != NULL) {
 		mapped_output = cc->mapped_output;
+		wlr_seat_pointer_set_frame_mode(seat->seat, cc->pointer_frames);
 	}
 	wl_list_for_each(output, &desktop->outputs, link) {
 		if (mapped_output &&
@@ -226,6 +233,9 @@ static void roots_seat_init_cursor(struct roots_seat *seat) {
 	wl_signal_add(&wlr_cursor->events.axis, &seat->cursor->axis);
 	seat->cursor->axis.notify = handle_cursor_axis;
 
+	wl_signal_add(&wlr_cursor->events.frame, &seat->cursor->frame);
+	seat->cursor->frame.notify = handle_cursor_frame;
+
 	wl_signal_add(&wlr_cursor->events.touch_down, &seat->cursor->touch_down);
 	seat->cursor->touch_down.notify = handle_touch_down;
 
@@ -732,8 +742,7 @@ void roots_seat_set_focus(struct roots_seat *seat, struct roots_view *view) {
 	// Make sure the view will be rendered on top of others, even if it's
 	// already focused in this seat
 	if (view != NULL) {
-		wl_list_remove(&view->link);
-		wl_list_insert(&seat->input->server->desktop->views, &view->link);
+		view_raise(view);
 	}
 
 	bool unfullscreen = true;
@@ -991,7 +1000,7 @@ void roots_seat_end_compositor_grab(struct roots_seat *seat) {
 			view_move_resize(view, cursor->view_x, cursor->view_y, cursor->view_width, cursor->view_height);
 			break;
 		case ROOTS_CURSOR_ROTATE:
-			view->rotation = cursor->view_rotation;
+			view_rotate(view, cursor->view_rotation);
 			break;
 		case ROOTS_CURSOR_PASSTHROUGH:
 			break;
@@ -0,0 +1,96 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <wayland-server.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_linux_dmabuf.h>
+#include <wlr/util/log.h>
+
+static void buffer_handle_resource_destroy(struct wl_listener *listener,
+		void *data) {
+	struct wlr_buffer *buffer =
+		wl_container_of(listener, buffer, resource_destroy);
+	wl_list_remove(&buffer->resource_destroy.link);
+	wl_list_init(&buffer->resource_destroy.link);
+	buffer->resource = NULL;
+
+	// Drop the reference held by the resource, users may keep the texture
+	// around for a while
+	wlr_buffer_unref(buffer);
+}
+
+static struct wlr_buffer *buffer_from_resource(struct wl_resource *resource) {
+	struct wl_listener *listener = wl_resource_get_destroy_listener(resource,
+		buffer_handle_resource_destroy);
+	if (listener == NULL) {
+		return NULL;
+	}
+	struct wlr_buffer *buffer;
+	return wl_container_of(listener, buffer, resource_destroy);
+}
+
+struct wlr_buffer *wlr_buffer_get(struct wlr_renderer *renderer,
+		struct wl_resource *resource) {
+	struct wlr_buffer *buffer = buffer_from_resource(resource);
+	if (buffer != NULL) {
+		if (buffer->renderer == renderer) {
+			return wlr_buffer_ref(buffer);
+		}
+		// Imported by another renderer, evict it from the cache
+		buffer_handle_resource_destroy(&buffer->resource_destroy, NULL);
+	}
+
+	struct wlr_texture *texture = NULL;
+	if (wlr_renderer_resource_is_wl_drm_buffer(renderer, resource)) {
+		texture = wlr_texture_from_wl_drm(renderer, resource);
+	} else if (wlr_dmabuf_resource_is_buffer(resource)) {
+		struct wlr_dmabuf_buffer *dmabuf =
+			wlr_dmabuf_buffer_from_buffer_resource(resource);
+		texture = wlr_texture_from_dmabuf(renderer, &dmabuf->attributes);
+	} else {
+		wlr_log(L_ERROR, "Cannot import buffer: unknown buffer type");
+		return NULL;
+	}
+	if (texture == NULL) {
+		wlr_log(L_ERROR, "Failed to import buffer");
+		return NULL;
+	}
+
+	buffer = calloc(1, sizeof(struct wlr_buffer));
+	if (buffer == NULL) {
+		wlr_log(L_ERROR, "Allocation failed");
+		wlr_texture_destroy(texture);
+		return NULL;
+	}
+	buffer->resource = resource;
+	buffer->renderer = renderer;
+	buffer->texture = texture;
+	// One reference for the resource, one for the caller
+	buffer->n_refs = 2;
+
+	buffer->resource_destroy.notify = buffer_handle_resource_destroy;
+	wl_resource_add_destroy_listener(resource, &buffer->resource_destroy);
+
+	return buffer;
+}
+
+struct wlr_buffer *wlr_buffer_ref(struct wlr_buffer *buffer) {
+	buffer->n_refs++;
+	return buffer;
+}
+
+void wlr_buffer_unref(struct wlr_buffer *buffer) {
+	if (buffer == NULL) {
+		return;
+	}
+
+	assert(buffer->n_refs > 0);
+	buffer->n_refs--;
+	if (buffer->n_refs > 0) {
+		return;
+	}
+
+	wlr_texture_destroy(buffer->texture);
+	free(buffer);
+}
@@ -4,6 +4,11 @@
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_output.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 void wlr_matrix_identity(float mat[static 9]) {
 	static const float identity[9] = {
@@ -16,8 +21,35 @@ void wlr_matrix_identity(float mat[static 9]) {
 
 void wlr_matrix_multiply(float mat[static 9], const float a[static 9],
 		const float b[static 9]) {
-	float product[9];
+	// Each row of the product is a linear combination of the rows of b. The
+	// vector kernels store 4 floats per row, rows are stored in order so that
+	// the extra lane is overwritten by the next one.
+	float product[12];
 
+#if defined(__SSE__)
+	__m128 b0 = _mm_loadu_ps(&b[0]);
+	__m128 b1 = _mm_loadu_ps(&b[3]);
+	// Don't read past the end of b
+	__m128 b2 = _mm_setr_ps(b[6], b[7], b[8], 0.0f);
+	for (int i = 0; i < 3; ++i) {
+		__m128 row = _mm_mul_ps(_mm_set1_ps(a[3*i]), b0);
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[3*i + 1]), b1));
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[3*i + 2]), b2));
+		_mm_storeu_ps(&product[3*i], row);
+	}
+#elif defined(__ARM_NEON)
+	float32x4_t b0 = vld1q_f32(&b[0]);
+	float32x4_t b1 = vld1q_f32(&b[3]);
+	// Don't read past the end of b
+	float32x4_t b2 = vcombine_f32(vld1_f32(&b[6]),
+		vset_lane_f32(b[8], vdup_n_f32(0.0f), 0));
+	for (int i = 0; i < 3; ++i) {
+		float32x4_t row = vmulq_n_f32(b0, a[3*i]);
+		row = vaddq_f32(row, vmulq_n_f32(b1, a[3*i + 1]));
+		row = vaddq_f32(row, vmulq_n_f32(b2, a[3*i + 2]));
+		vst1q_f32(&product[3*i], row);
+	}
+#else
 	product[0] = a[0]*b[0] + a[1]*b[3] + a[2]*b[6];
 	product[1] = a[0]*b[1] + a[1]*b[4] + a[2]*b[7];
 	product[2] = a[0]*b[2] + a[1]*b[5] + a[2]*b[8];
@@ -29,8 +61,9 @@ void wlr_matrix_multiply(float mat[static 9], const float a[static 9],
 	product[6] = a[6]*b[0] + a[7]*b[3] + a[8]*b[6];
 	product[7] = a[6]*b[1] + a[7]*b[4] + a[8]*b[7];
 	product[8] = a[6]*b[2] + a[7]*b[5] + a[8]*b[8];
+#endif
 
-	memcpy(mat, product, sizeof(product));
+	memcpy(mat, product, 9 * sizeof(float));
 }
 
 void wlr_matrix_transpose(float mat[static 9], const float a[static 9]) {
@@ -112,6 +145,46 @@ static const float transforms[][9] = {
 	},
 };
 
+/**
+ * The transforms above applied about the center of the unit square, ie.
+ * translate(0.5, 0.5) * transforms[transform] * translate(-0.5, -0.5). Only
+ * the first two rows are stored, the last one is always [0 0 1].
+ */
+static const float box_transforms[][6] = {
+	[WL_OUTPUT_TRANSFORM_NORMAL] = {
+		1.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f,
+	},
+	[WL_OUTPUT_TRANSFORM_90] = {
+		0.0f, -1.0f, 1.0f,
+		1.0f, 0.0f, 0.0f,
+	},
+	[WL_OUTPUT_TRANSFORM_180] = {
+		-1.0f, 0.0f, 1.0f,
+		0.0f, -1.0f, 1.0f,
+	},
+	[WL_OUTPUT_TRANSFORM_270] = {
+		0.0f, 1.0f, 0.0f,
+		-1.0f, 0.0f, 1.0f,
+	},
+	[WL_OUTPUT_TRANSFORM_FLIPPED] = {
+		-1.0f, 0.0f, 1.0f,
+		0.0f, 1.0f, 0.0f,
+	},
+	[WL_OUTPUT_TRANSFORM_FLIPPED_90] = {
+		0.0f, -1.0f, 1.0f,
+		-1.0f, 0.0f, 1.0f,
+	},
+	[WL_OUTPUT_TRANSFORM_FLIPPED_180] = {
+		1.0f, 0.0f, 0.0f,
+		0.0f, -1.0f, 1.0f,
+	},
+	[WL_OUTPUT_TRANSFORM_FLIPPED_270] = {
+		0.0f, 1.0f, 0.0f,
+		1.0f, 0.0f, 0.0f,
+	},
+};
+
 void wlr_matrix_transform(float mat[static 9],
 		enum wl_output_transform transform) {
 	wlr_matrix_multiply(mat, mat, transforms[transform]);
@@ -148,22 +221,46 @@ void wlr_matrix_project_box(float mat[static 9], const struct wlr_box *box,
 	int width = box->width;
 	int height = box->height;
 
-	wlr_matrix_identity(mat);
-	wlr_matrix_translate(mat, x, y);
-
+	// This is translate(x, y) * rotate(rotation) about the center of the
+	// box * scale(width, height) * box_transforms[transform], computed
+	// directly. All of these are affine, so only the first two rows of the
+	// model matrix are needed.
+	float m[6] = {
+		width, 0.0f,   x,
+		0.0f,  height, y,
+	};
 	if (rotation != 0) {
-		wlr_matrix_translate(mat, width/2, height/2);
-		wlr_matrix_rotate(mat, rotation);
-		wlr_matrix_translate(mat, -width/2, -height/2);
+		float c = cos(rotation);
+		float s = sin(rotation);
+		int cx = width/2;
+		int cy = height/2;
+		m[0] = c * width;
+		m[1] = -s * height;
+		m[2] = x + cx - c * cx + s * cy;
+		m[3] = s * width;
+		m[4] = c * height;
+		m[5] = y + cy - s * cx - c * cy;
 	}
 
-	wlr_matrix_scale(mat, width, height);
-
 	if (transform != WL_OUTPUT_TRANSFORM_NORMAL) {
-		wlr_matrix_translate(mat, 0.5, 0.5);
-		wlr_matrix_transform(mat, transform);
-		wlr_matrix_translate(mat, -0.5, -0.5);
+		const float *t = box_transforms[transform];
+		float r[6] = {
+			m[0]*t[0] + m[1]*t[3], m[0]*t[1] + m[1]*t[4],
+			m[0]*t[2] + m[1]*t[5] + m[2],
+			m[3]*t[0] + m[4]*t[3], m[3]*t[1] + m[4]*t[4],
+			m[3]*t[2] + m[4]*t[5] + m[5],
+		};
+		memcpy(m, r, sizeof(r));
 	}
 
-	wlr_matrix_multiply(mat, projection, mat);
+	const float *p = projection;
+	float product[9] = {
+		p[0]*m[0] + p[1]*m[3], p[0]*m[1] + p[1]*m[4],
+		p[0]*m[2] + p[1]*m[5] + p[2],
+		p[3]*m[0] + p[4]*m[3], p[3]*m[1] + p[4]*m[4],
+		p[3]*m[2] + p[4]*m[5] + p[5],
+		p[6]*m[0] + p[7]*m[3], p[6]*m[1] + p[7]*m[4],
+		p[6]*m[2] + p[7]*m[5] + p[8],
+	};
+	memcpy(mat, product, sizeof(product));
 }
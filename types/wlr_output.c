@@ -15,6 +15,10 @@
 #include <wlr/util/region.h>
 #include "util/signal.h"
 
+// Added to the measured render time, to account for the work done outside of
+// the renderer and for scheduling latency
+#define OUTPUT_RENDER_TIME_SLACK_NS 2000000
+
 static void wl_output_send_to_resource(struct wl_resource *resource) {
 	struct wlr_output *output = wlr_output_from_resource(resource);
 	const uint32_t version = wl_resource_get_version(resource);
@@ -169,6 +173,8 @@ bool wlr_output_set_custom_mode(struct wlr_output *output, int32_t width,
 	return output->impl->set_custom_mode(output, width, height, refresh);
 }
 
+static void output_flush_deferred_frame(struct wlr_output *output);
+
 void wlr_output_update_mode(struct wlr_output *output,
 		struct wlr_output_mode *mode) {
 	output->current_mode = mode;
@@ -190,6 +196,9 @@ void wlr_output_update_custom_mode(struct wlr_output *output, int32_t width,
 	}
 
 	wlr_signal_emit_safe(&output->events.mode, output);
+
+	// The deadline of a deferred frame was computed for the old refresh rate
+	output_flush_deferred_frame(output);
 }
 
 void wlr_output_set_transform(struct wlr_output *output,
@@ -258,17 +267,22 @@ void wlr_output_init(struct wlr_output *output, struct wlr_backend *backend,
 	wl_signal_init(&output->events.frame);
 	wl_signal_init(&output->events.needs_swap);
 	wl_signal_init(&output->events.swap_buffers);
+	wl_signal_init(&output->events.present);
 	wl_signal_init(&output->events.enable);
 	wl_signal_init(&output->events.mode);
 	wl_signal_init(&output->events.scale);
 	wl_signal_init(&output->events.transform);
 	wl_signal_init(&output->events.destroy);
 	pixman_region32_init(&output->damage);
+	wlr_arena_init(&output->frame_arena);
 
 	output->display_destroy.notify = handle_display_destroy;
 	wl_display_add_destroy_listener(display, &output->display_destroy);
 
 	output->frame_pending = true;
+	output->render_stats.cpu_time_ns = -1;
+	output->render_stats.gpu_time_ns = -1;
+	output->render_time_estimate_ns = -1;
 }
 
 void wlr_output_destroy(struct wlr_output *output) {
@@ -294,6 +308,14 @@ void wlr_output_destroy(struct wlr_output *output) {
 	}
 
 	pixman_region32_fini(&output->damage);
+	wlr_arena_finish(&output->frame_arena);
+
+	if (output->idle_frame != NULL) {
+		wl_event_source_remove(output->idle_frame);
+	}
+	if (output->frame_timer != NULL) {
+		wl_event_source_remove(output->frame_timer);
+	}
 
 	if (output->impl && output->impl->destroy) {
 		output->impl->destroy(output);
@@ -347,6 +369,22 @@ static void output_scissor(struct wlr_output *output, pixman_box32_t *rect) {
 	wlr_renderer_scissor(renderer, &box);
 }
 
+/**
+ * Transforms a region in output-local coordinates into renderer coordinates.
+ */
+static void output_region_to_renderer(struct wlr_output *output,
+		pixman_region32_t *dst, pixman_region32_t *src) {
+	int ow, oh;
+	wlr_output_transformed_resolution(output, &ow, &oh);
+
+	// Renderer coordinates are upside down
+	enum wl_output_transform transform = wlr_output_transform_compose(
+		wlr_output_transform_invert(output->transform),
+		WL_OUTPUT_TRANSFORM_FLIPPED_180);
+	wlr_region_transform_arena(dst, src, transform, ow, oh,
+		&output->frame_arena);
+}
+
 static void output_fullscreen_surface_get_box(struct wlr_output *output,
 		struct wlr_surface *surface, struct wlr_box *box) {
 	int width, height;
@@ -367,7 +405,12 @@ static void output_fullscreen_surface_render(struct wlr_output *output,
 	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
 	assert(renderer);
 
-	if (!wlr_surface_has_buffer(surface)) {
+	// The texture upload may fail even if the surface has a buffer
+	struct wlr_texture *texture = NULL;
+	if (wlr_surface_has_buffer(surface)) {
+		texture = wlr_surface_get_texture(surface);
+	}
+	if (texture == NULL) {
 		wlr_renderer_clear(renderer, (float[]){0, 0, 0, 0});
 		return;
 	}
@@ -386,10 +429,16 @@ static void output_fullscreen_surface_render(struct wlr_output *output,
 	for (int i = 0; i < nrects; ++i) {
 		output_scissor(output, &rects[i]);
 		wlr_renderer_clear(renderer, (float[]){0, 0, 0, 0});
-		wlr_render_texture_with_matrix(surface->renderer, surface->texture, matrix, 1.0f);
 	}
 	wlr_renderer_scissor(renderer, NULL);
 
+	pixman_region32_t surface_damage;
+	pixman_region32_init(&surface_damage);
+	output_region_to_renderer(output, &surface_damage, damage);
+	wlr_render_texture_with_matrix_region(surface->renderer, texture, matrix,
+		1.0f, &surface_damage);
+	pixman_region32_fini(&surface_damage);
+
 	wlr_surface_send_frame_done(surface, when);
 }
 
@@ -417,7 +466,7 @@ static void output_cursor_render(struct wlr_output_cursor *cursor,
 
 	struct wlr_texture *texture = cursor->texture;
 	if (cursor->surface != NULL) {
-		texture = cursor->surface->texture;
+		texture = wlr_surface_get_texture(cursor->surface);
 	}
 	if (texture == NULL) {
 		return;
@@ -428,9 +477,8 @@ static void output_cursor_render(struct wlr_output_cursor *cursor,
 
 	pixman_region32_t surface_damage;
 	pixman_region32_init(&surface_damage);
-	pixman_region32_union_rect(&surface_damage, &surface_damage, box.x, box.y,
+	pixman_region32_intersect_rect(&surface_damage, damage, box.x, box.y,
 		box.width, box.height);
-	pixman_region32_intersect(&surface_damage, &surface_damage, damage);
 	if (!pixman_region32_not_empty(&surface_damage)) {
 		goto surface_damage_finish;
 	}
@@ -439,13 +487,10 @@ static void output_cursor_render(struct wlr_output_cursor *cursor,
 	wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0,
 		cursor->output->transform_matrix);
 
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&surface_damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		output_scissor(cursor->output, &rects[i]);
-		wlr_render_texture_with_matrix(renderer, texture, matrix, 1.0f);
-	}
-	wlr_renderer_scissor(renderer, NULL);
+	output_region_to_renderer(cursor->output, &surface_damage,
+		&surface_damage);
+	wlr_render_texture_with_matrix_region(renderer, texture, matrix, 1.0f,
+		&surface_damage);
 
 	if (cursor->surface != NULL) {
 		wlr_surface_send_frame_done(cursor->surface, when);
@@ -455,6 +500,13 @@ surface_damage_finish:
 	pixman_region32_fini(&surface_damage);
 }
 
+static void output_update_render_stats(struct wlr_output *output) {
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	if (renderer != NULL) {
+		output->render_stats = *wlr_renderer_get_stats(renderer);
+	}
+}
+
 bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
 		pixman_region32_t *damage) {
 	if (output->frame_pending) {
@@ -466,18 +518,20 @@ bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
 		output->idle_frame = NULL;
 	}
 
+	output_update_render_stats(output);
 	wlr_signal_emit_safe(&output->events.swap_buffers, damage);
 
 	int width, height;
 	wlr_output_transformed_resolution(output, &width, &height);
 
 	pixman_region32_t render_damage;
-	pixman_region32_init(&render_damage);
-	pixman_region32_union_rect(&render_damage, &render_damage, 0, 0,
-		width, height);
 	if (damage != NULL) {
 		// Damage tracking supported
-		pixman_region32_intersect(&render_damage, &render_damage, damage);
+		pixman_region32_init(&render_damage);
+		pixman_region32_intersect_rect(&render_damage, damage, 0, 0,
+			width, height);
+	} else {
+		pixman_region32_init_rect(&render_damage, 0, 0, width, height);
 	}
 
 	if (when == NULL) {
@@ -502,30 +556,169 @@ bool wlr_output_swap_buffers(struct wlr_output *output, struct timespec *when,
 		}
 	}
 
-	// Transform damage into renderer coordinates, ie. upside down
-	enum wl_output_transform transform = wlr_output_transform_compose(
-		wlr_output_transform_invert(output->transform),
-		WL_OUTPUT_TRANSFORM_FLIPPED_180);
-	wlr_region_transform(&render_damage, &render_damage, transform, width,
-		height);
+	output_region_to_renderer(output, &render_damage, &render_damage);
+
+	// Account for software cursors
+	output_update_render_stats(output);
 
-	if (!output->impl->swap_buffers(output, damage ? &render_damage : NULL)) {
+	bool ok = output->impl->swap_buffers(output,
+		damage ? &render_damage : NULL);
+	pixman_region32_fini(&render_damage);
+	wlr_arena_reset(&output->frame_arena);
+	if (!ok) {
 		return false;
 	}
 
 	output->frame_pending = true;
 	output->needs_swap = false;
 	pixman_region32_clear(&output->damage);
-
-	pixman_region32_fini(&render_damage);
 	return true;
 }
 
-void wlr_output_send_frame(struct wlr_output *output) {
+static void output_update_render_time(struct wlr_output *output) {
+	int64_t sample = output->render_stats.cpu_time_ns;
+	if (output->render_stats.gpu_time_ns > sample) {
+		sample = output->render_stats.gpu_time_ns;
+	}
+	if (sample < 0) {
+		return;
+	}
+
+	// Follow increases right away and decreases slowly: missing a vblank is
+	// worse than starting to render a bit early
+	int64_t *estimate = &output->render_time_estimate_ns;
+	if (sample > *estimate) {
+		*estimate = sample;
+	} else {
+		*estimate -= (*estimate - sample) / 8;
+	}
+}
+
+static void output_send_frame(struct wlr_output *output) {
 	output->frame_pending = false;
+	output->frame_deferred = false;
+
+	// The previous frame has most likely been rendered by now
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	if (renderer != NULL && output->render_stats.gpu_time_ns < 0) {
+		output->render_stats.gpu_time_ns = wlr_renderer_get_gpu_time(renderer,
+			output->render_stats.frame);
+	}
+	output_update_render_time(output);
+
 	wlr_signal_emit_safe(&output->events.frame, output);
 }
 
+static int64_t timespec_to_nsec(const struct timespec *t) {
+	return (int64_t)t->tv_sec * 1000000000 + t->tv_nsec;
+}
+
+/**
+ * Computes how long to wait before sending the `frame` event so that
+ * rendering ends right before the next vblank, in milliseconds.
+ */
+static int output_frame_delay(struct wlr_output *output) {
+	if (output->max_render_time == 0 || output->refresh <= 0 ||
+			(output->last_vblank.tv_sec == 0 &&
+			output->last_vblank.tv_nsec == 0)) {
+		return 0;
+	}
+
+	int64_t render_time_ns;
+	if (output->max_render_time == WLR_OUTPUT_MAX_RENDER_TIME_AUTO) {
+		if (output->render_time_estimate_ns < 0) {
+			return 0;
+		}
+		render_time_ns =
+			output->render_time_estimate_ns + OUTPUT_RENDER_TIME_SLACK_NS;
+	} else {
+		render_time_ns = (int64_t)output->max_render_time * 1000000;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t since_vblank_ns =
+		timespec_to_nsec(&now) - timespec_to_nsec(&output->last_vblank);
+	if (since_vblank_ns < 0) {
+		return 0;
+	}
+
+	// Vblanks keep happening while the output is idle, predict the next one
+	int64_t refresh_ns = 1000000000000 / output->refresh;
+	int64_t until_vblank_ns = refresh_ns - since_vblank_ns % refresh_ns;
+	int64_t delay_ns = until_vblank_ns - render_time_ns;
+	return delay_ns > 0 ? delay_ns / 1000000 : 0;
+}
+
+static int handle_frame_timer(void *data) {
+	struct wlr_output *output = data;
+	output_send_frame(output);
+	return 0;
+}
+
+static void output_flush_deferred_frame(struct wlr_output *output) {
+	if (!output->frame_deferred) {
+		return;
+	}
+	wl_event_source_timer_update(output->frame_timer, 0);
+	output_send_frame(output);
+}
+
+void wlr_output_send_frame(struct wlr_output *output) {
+	if (output->frame_deferred) {
+		// Already scheduled, don't push the deadline back
+		return;
+	}
+
+	int delay = output_frame_delay(output);
+	if (delay <= 0) {
+		output_send_frame(output);
+		return;
+	}
+
+	if (output->frame_timer == NULL) {
+		struct wl_event_loop *ev = wl_display_get_event_loop(output->display);
+		output->frame_timer =
+			wl_event_loop_add_timer(ev, handle_frame_timer, output);
+		if (output->frame_timer == NULL) {
+			output_send_frame(output);
+			return;
+		}
+	}
+
+	// No rendering until the deadline
+	output->frame_pending = true;
+	output->frame_deferred = true;
+	wl_event_source_timer_update(output->frame_timer, delay);
+}
+
+void wlr_output_send_present(struct wlr_output *output, struct timespec *when,
+		unsigned seq, uint32_t flags) {
+	struct timespec now;
+	if (when == NULL) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		when = &now;
+	}
+
+	// Frame scheduling needs to know when retraces happen
+	if (flags & WLR_OUTPUT_PRESENT_VSYNC) {
+		output->last_vblank = *when;
+	}
+
+	struct wlr_output_event_present event = {
+		.output = output,
+		.when = when,
+		.seq = seq,
+		.refresh = output->refresh > 0 ? 1000000000000 / output->refresh : 0,
+		.flags = flags,
+	};
+	wlr_signal_emit_safe(&output->events.present, &event);
+}
+
+void wlr_output_set_max_render_time(struct wlr_output *output, int ms) {
+	output->max_render_time = ms;
+}
+
 static void schedule_frame_handle_idle_timer(void *data) {
 	struct wlr_output *output = data;
 	output->idle_frame = NULL;
@@ -5,6 +5,8 @@
 #include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+#include <wlr/util/region.h>
 #include "util/signal.h"
 
 static void output_handle_destroy(struct wl_listener *listener, void *data) {
@@ -50,6 +52,42 @@ static void output_handle_frame(struct wl_listener *listener, void *data) {
 	wlr_signal_emit_safe(&output_damage->events.frame, output_damage);
 }
 
+/**
+ * Resizes the damage history, keeping the most recent frames.
+ */
+static bool output_damage_resize_previous(
+		struct wlr_output_damage *output_damage, size_t len) {
+	pixman_region32_t *previous = calloc(len, sizeof(pixman_region32_t));
+	if (previous == NULL && len > 0) {
+		wlr_log(L_ERROR, "Allocation failed");
+		return false;
+	}
+
+	// Unroll the circular queue, most recent frame first
+	size_t old_len = output_damage->previous_len;
+	for (size_t i = 0; i < old_len; ++i) {
+		pixman_region32_t *region = &output_damage->previous[
+			(output_damage->previous_idx + i) % old_len];
+		if (i < len) {
+			previous[i] = *region;
+		} else {
+			pixman_region32_fini(region);
+		}
+	}
+	for (size_t i = old_len; i < len; ++i) {
+		pixman_region32_init(&previous[i]);
+	}
+
+	free(output_damage->previous);
+	output_damage->previous = previous;
+	output_damage->previous_len = len;
+	output_damage->previous_idx = 0;
+	if (output_damage->previous_valid > len) {
+		output_damage->previous_valid = len;
+	}
+	return true;
+}
+
 struct wlr_output_damage *wlr_output_damage_create(struct wlr_output *output) {
 	struct wlr_output_damage *output_damage =
 		calloc(1, sizeof(struct wlr_output_damage));
@@ -62,8 +100,14 @@ struct wlr_output_damage *wlr_output_damage_create(struct wlr_output *output) {
 	wl_signal_init(&output_damage->events.destroy);
 
 	pixman_region32_init(&output_damage->current);
-	for (size_t i = 0; i < WLR_OUTPUT_DAMAGE_PREVIOUS_LEN; ++i) {
-		pixman_region32_init(&output_damage->previous[i]);
+	output_damage->max_previous_len = WLR_OUTPUT_DAMAGE_MAX_PREVIOUS_LEN;
+	output_damage->max_rects = WLR_OUTPUT_DAMAGE_MAX_RECTS;
+	output_damage->max_overdraw = WLR_OUTPUT_DAMAGE_MAX_OVERDRAW;
+	if (!output_damage_resize_previous(output_damage,
+			WLR_OUTPUT_DAMAGE_PREVIOUS_LEN)) {
+		pixman_region32_fini(&output_damage->current);
+		free(output_damage);
+		return NULL;
 	}
 
 	wl_signal_add(&output->events.destroy, &output_damage->output_destroy);
@@ -94,12 +138,22 @@ void wlr_output_damage_destroy(struct wlr_output_damage *output_damage) {
 	wl_list_remove(&output_damage->output_needs_swap.link);
 	wl_list_remove(&output_damage->output_frame.link);
 	pixman_region32_fini(&output_damage->current);
-	for (size_t i = 0; i < WLR_OUTPUT_DAMAGE_PREVIOUS_LEN; ++i) {
+	for (size_t i = 0; i < output_damage->previous_len; ++i) {
 		pixman_region32_fini(&output_damage->previous[i]);
 	}
+	free(output_damage->previous);
 	free(output_damage);
 }
 
+bool wlr_output_damage_set_max_previous_len(
+		struct wlr_output_damage *output_damage, size_t max_len) {
+	output_damage->max_previous_len = max_len;
+	if (output_damage->previous_len > max_len) {
+		return output_damage_resize_previous(output_damage, max_len);
+	}
+	return true;
+}
+
 bool wlr_output_damage_make_current(struct wlr_output_damage *output_damage,
 		bool *needs_swap, pixman_region32_t *damage) {
 	struct wlr_output *output = output_damage->output;
@@ -109,20 +163,33 @@ bool wlr_output_damage_make_current(struct wlr_output_damage *output_damage,
 		return false;
 	}
 
+	output_damage->frame_count++;
+
+	// The damage of the buffer_age - 1 previous frames is needed
+	size_t history_len = buffer_age > 0 ? (size_t)buffer_age - 1 : 0;
+	if (history_len > output_damage->previous_len &&
+			history_len <= output_damage->max_previous_len) {
+		// Grow the history so that this buffer age can be handled next time
+		wlr_log(L_DEBUG, "Growing damage history of output %s to %zu frames",
+			output->name, history_len);
+		output_damage_resize_previous(output_damage, history_len);
+	}
+
 	// Check if we can use damage tracking
-	if (buffer_age <= 0 || buffer_age - 1 > WLR_OUTPUT_DAMAGE_PREVIOUS_LEN) {
+	if (buffer_age <= 0 || history_len > output_damage->previous_valid) {
 		int width, height;
 		wlr_output_transformed_resolution(output, &width, &height);
 
 		// Buffer new or too old, damage the whole output
 		pixman_region32_union_rect(damage, damage, 0, 0, width, height);
+		output_damage->full_repaint_count++;
 	} else {
 		pixman_region32_copy(damage, &output_damage->current);
 
 		// Accumulate damage from old buffers
 		size_t idx = output_damage->previous_idx;
-		for (int i = 0; i < buffer_age - 1; ++i) {
-			int j = (idx + i) % WLR_OUTPUT_DAMAGE_PREVIOUS_LEN;
+		for (size_t i = 0; i < history_len; ++i) {
+			size_t j = (idx + i) % output_damage->previous_len;
 			pixman_region32_union(damage, damage, &output_damage->previous[j]);
 		}
 	}
@@ -137,17 +204,29 @@ bool wlr_output_damage_swap_buffers(struct wlr_output_damage *output_damage,
 		return false;
 	}
 
-	// same as decrementing, but works on unsigned integers
-	output_damage->previous_idx += WLR_OUTPUT_DAMAGE_PREVIOUS_LEN - 1;
-	output_damage->previous_idx %= WLR_OUTPUT_DAMAGE_PREVIOUS_LEN;
+	size_t len = output_damage->previous_len;
+	if (len > 0) {
+		// same as decrementing, but works on unsigned integers
+		output_damage->previous_idx += len - 1;
+		output_damage->previous_idx %= len;
 
-	pixman_region32_copy(&output_damage->previous[output_damage->previous_idx],
-		&output_damage->current);
+		pixman_region32_copy(
+			&output_damage->previous[output_damage->previous_idx],
+			&output_damage->current);
+		if (output_damage->previous_valid < len) {
+			output_damage->previous_valid++;
+		}
+	}
 	pixman_region32_clear(&output_damage->current);
 
 	return true;
 }
 
+static void output_damage_simplify(struct wlr_output_damage *output_damage) {
+	wlr_region_simplify(&output_damage->current, &output_damage->current,
+		output_damage->max_rects, output_damage->max_overdraw);
+}
+
 void wlr_output_damage_add(struct wlr_output_damage *output_damage,
 		pixman_region32_t *damage) {
 	int width, height;
@@ -157,6 +236,7 @@ void wlr_output_damage_add(struct wlr_output_damage *output_damage,
 		damage);
 	pixman_region32_intersect_rect(&output_damage->current,
 		&output_damage->current, 0, 0, width, height);
+	output_damage_simplify(output_damage);
 	wlr_output_schedule_frame(output_damage->output);
 }
 
@@ -179,5 +259,6 @@ void wlr_output_damage_add_box(struct wlr_output_damage *output_damage,
 		box->x, box->y, box->width, box->height);
 	pixman_region32_intersect_rect(&output_damage->current,
 		&output_damage->current, 0, 0, width, height);
+	output_damage_simplify(output_damage);
 	wlr_output_schedule_frame(output_damage->output);
 }
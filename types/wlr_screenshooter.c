@@ -18,8 +18,15 @@ static struct wlr_screenshot *screenshot_from_resource(
 
 struct screenshot_state {
 	struct wl_shm_buffer *shm_buffer;
-	struct wlr_screenshot *screenshot;
-	struct wl_listener frame_listener;
+	struct wl_resource *screenshot_resource;
+	struct wlr_output *output;
+	struct wlr_renderer_readback *readback;
+
+	struct wl_listener swap_buffers;
+	struct wl_listener frame;
+	struct wl_listener output_destroy;
+	struct wl_listener buffer_destroy;
+	struct wl_listener screenshot_destroy;
 };
 
 static void screenshot_destroy(struct wlr_screenshot *screenshot) {
@@ -37,33 +44,89 @@ static void handle_screenshot_resource_destroy(
 	}
 }
 
-static void output_handle_frame(struct wl_listener *listener, void *_data) {
-	struct screenshot_state *state = wl_container_of(listener, state,
-		frame_listener);
-	struct wlr_output *output = state->screenshot->output;
+static void screenshot_state_destroy(struct screenshot_state *state) {
+	struct wlr_output *output = state->output;
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	wlr_renderer_readback_destroy(renderer, state->readback);
+
+	wl_list_remove(&state->swap_buffers.link);
+	wl_list_remove(&state->frame.link);
+	wl_list_remove(&state->output_destroy.link);
+	wl_list_remove(&state->buffer_destroy.link);
+	wl_list_remove(&state->screenshot_destroy.link);
+	free(state);
+}
+
+static void output_handle_swap_buffers(struct wl_listener *listener,
+		void *_data) {
+	struct screenshot_state *state =
+		wl_container_of(listener, state, swap_buffers);
+	struct wlr_output *output = state->output;
 	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
 	struct wl_shm_buffer *shm_buffer = state->shm_buffer;
 
+	// Only queue the copy of the frame that's about to be presented, and
+	// retrieve it on the next frame so that we don't stall the GPU
 	enum wl_shm_format format = wl_shm_buffer_get_format(shm_buffer);
 	int32_t width = wl_shm_buffer_get_width(shm_buffer);
 	int32_t height = wl_shm_buffer_get_height(shm_buffer);
+	state->readback = wlr_renderer_readback_start(renderer, format, width,
+		height, 0, 0);
+	if (state->readback == NULL) {
+		wlr_log(L_ERROR, "Cannot read pixels");
+		screenshot_state_destroy(state);
+		return;
+	}
+
+	wl_list_remove(&state->swap_buffers.link);
+	wl_list_init(&state->swap_buffers.link);
+	wl_signal_add(&output->events.frame, &state->frame);
+}
+
+static void output_handle_frame(struct wl_listener *listener, void *_data) {
+	struct screenshot_state *state = wl_container_of(listener, state, frame);
+	struct wlr_output *output = state->output;
+	struct wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
+	struct wl_shm_buffer *shm_buffer = state->shm_buffer;
+
 	int32_t stride = wl_shm_buffer_get_stride(shm_buffer);
 	wl_shm_buffer_begin_access(shm_buffer);
 	void *data = wl_shm_buffer_get_data(shm_buffer);
-	bool ok = wlr_renderer_read_pixels(renderer, format, stride, width, height,
-		0, 0, 0, 0, data);
+	bool ok = wlr_renderer_readback_finish(renderer, state->readback, stride,
+		0, 0, data);
 	wl_shm_buffer_end_access(shm_buffer);
+	state->readback = NULL;
 
 	if (!ok) {
 		wlr_log(L_ERROR, "Cannot read pixels");
 		goto cleanup;
 	}
 
-	orbital_screenshot_send_done(state->screenshot->resource);
+	orbital_screenshot_send_done(state->screenshot_resource);
 
 cleanup:
-	wl_list_remove(&listener->link);
-	free(state);
+	screenshot_state_destroy(state);
+}
+
+static void state_handle_output_destroy(struct wl_listener *listener,
+		void *data) {
+	struct screenshot_state *state =
+		wl_container_of(listener, state, output_destroy);
+	screenshot_state_destroy(state);
+}
+
+static void state_handle_buffer_destroy(struct wl_listener *listener,
+		void *data) {
+	struct screenshot_state *state =
+		wl_container_of(listener, state, buffer_destroy);
+	screenshot_state_destroy(state);
+}
+
+static void state_handle_screenshot_destroy(struct wl_listener *listener,
+		void *data) {
+	struct screenshot_state *state =
+		wl_container_of(listener, state, screenshot_destroy);
+	screenshot_state_destroy(state);
 }
 
 static const struct orbital_screenshooter_interface screenshooter_impl;
@@ -140,9 +203,19 @@ static void screenshooter_shoot(struct wl_client *client,
 		return;
 	}
 	state->shm_buffer = shm_buffer;
-	state->screenshot = screenshot;
-	state->frame_listener.notify = output_handle_frame;
-	wl_signal_add(&output->events.swap_buffers, &state->frame_listener);
+	state->screenshot_resource = screenshot->resource;
+	state->output = output;
+	state->swap_buffers.notify = output_handle_swap_buffers;
+	wl_signal_add(&output->events.swap_buffers, &state->swap_buffers);
+	state->frame.notify = output_handle_frame;
+	wl_list_init(&state->frame.link);
+	state->output_destroy.notify = state_handle_output_destroy;
+	wl_signal_add(&output->events.destroy, &state->output_destroy);
+	state->buffer_destroy.notify = state_handle_buffer_destroy;
+	wl_resource_add_destroy_listener(buffer_resource, &state->buffer_destroy);
+	state->screenshot_destroy.notify = state_handle_screenshot_destroy;
+	wl_resource_add_destroy_listener(screenshot->resource,
+		&state->screenshot_destroy);
 
 	// Schedule a buffer swap
 	output->needs_swap = true;
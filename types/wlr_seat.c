@@ -11,6 +11,10 @@
 #include <wlr/util/log.h>
 #include "util/signal.h"
 
+// Accumulated pointer events are sent after this delay if the compositor
+// doesn't flush them, eg. because no output is rendering
+#define POINTER_FLUSH_TIMEOUT_MS 16
+
 static void resource_destroy(struct wl_client *client,
 		struct wl_resource *resource) {
 	wl_resource_destroy(resource);
@@ -280,6 +284,10 @@ static void default_pointer_axis(struct wlr_seat_pointer_grab *grab,
 	wlr_seat_pointer_send_axis(grab->seat, time, orientation, value);
 }
 
+static void default_pointer_frame(struct wlr_seat_pointer_grab *grab) {
+	wlr_seat_pointer_send_frame(grab->seat);
+}
+
 static void default_pointer_cancel(struct wlr_seat_pointer_grab *grab) {
 	// cannot be cancelled
 }
@@ -289,6 +297,7 @@ static const struct  wlr_pointer_grab_interface default_pointer_grab_impl = {
 	.motion = default_pointer_motion,
 	.button = default_pointer_button,
 	.axis = default_pointer_axis,
+	.frame = default_pointer_frame,
 	.cancel = default_pointer_cancel,
 };
 
@@ -382,6 +391,10 @@ void wlr_seat_destroy(struct wlr_seat *seat) {
 		wl_resource_destroy(client->wl_resource);
 	}
 
+	if (seat->pointer_state.flush_timer != NULL) {
+		wl_event_source_remove(seat->pointer_state.flush_timer);
+	}
+
 	wl_global_destroy(seat->wl_global);
 	free(seat->pointer_state.default_grab);
 	free(seat->keyboard_state.default_grab);
@@ -558,6 +571,10 @@ void wlr_seat_pointer_enter(struct wlr_seat *wlr_seat,
 		client = wlr_seat_client_for_wl_client(wlr_seat, wl_client);
 	}
 
+	// Events accumulated for the previously entered surface go before the
+	// leave event
+	wlr_seat_pointer_flush(wlr_seat);
+
 	struct wlr_seat_client *focused_client =
 		wlr_seat->pointer_state.focused_client;
 	struct wlr_surface *focused_surface =
@@ -610,7 +627,7 @@ void wlr_seat_pointer_clear_focus(struct wlr_seat *wlr_seat) {
 	wlr_seat_pointer_enter(wlr_seat, NULL, 0, 0);
 }
 
-void wlr_seat_pointer_send_motion(struct wlr_seat *wlr_seat, uint32_t time,
+static void pointer_motion(struct wlr_seat *wlr_seat, uint32_t time,
 		double sx, double sy) {
 	struct wlr_seat_client *client = wlr_seat->pointer_state.focused_client;
 	if (client == NULL) {
@@ -621,10 +638,116 @@ void wlr_seat_pointer_send_motion(struct wlr_seat *wlr_seat, uint32_t time,
 	wl_resource_for_each(resource, &client->pointers) {
 		wl_pointer_send_motion(resource, time, wl_fixed_from_double(sx),
 			wl_fixed_from_double(sy));
-		pointer_send_frame(resource);
+	}
+	wlr_seat->pointer_state.frame_pending = true;
+}
+
+static void pointer_axis(struct wlr_seat *wlr_seat, uint32_t time,
+		enum wlr_axis_orientation orientation, double value) {
+	struct wlr_seat_client *client = wlr_seat->pointer_state.focused_client;
+	if (client == NULL) {
+		return;
+	}
+
+	struct wl_resource *resource;
+	wl_resource_for_each(resource, &client->pointers) {
+		if (value) {
+			wl_pointer_send_axis(resource, time, orientation,
+				wl_fixed_from_double(value));
+		} else if (wl_resource_get_version(resource) >=
+				WL_POINTER_AXIS_STOP_SINCE_VERSION) {
+			wl_pointer_send_axis_stop(resource, time, orientation);
+		}
+	}
+	wlr_seat->pointer_state.frame_pending = true;
+}
+
+/**
+ * Called after an event has been sent to the focused client. Ends the frame
+ * right away, unless frames follow the hardware ones.
+ */
+static void pointer_end_event(struct wlr_seat *wlr_seat) {
+	if (wlr_seat->pointer_state.frame_mode !=
+			WLR_SEAT_POINTER_FRAME_HARDWARE) {
+		wlr_seat_pointer_send_frame(wlr_seat);
+	}
+}
+
+static bool pointer_has_accumulated(struct wlr_seat_pointer_state *state) {
+	return state->motion_pending ||
+		state->axis[0].pending || state->axis[0].stop ||
+		state->axis[1].pending || state->axis[1].stop;
+}
+
+/**
+ * Sends the accumulated motion and axis events, without a frame event.
+ */
+static void pointer_send_accumulated(struct wlr_seat *wlr_seat) {
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	if (!pointer_has_accumulated(state)) {
+		return;
+	}
+
+	if (state->motion_pending) {
+		pointer_motion(wlr_seat, state->motion_time, state->motion_sx,
+			state->motion_sy);
+		state->motion_pending = false;
+	}
+
+	for (size_t i = 0; i < sizeof(state->axis) / sizeof(state->axis[0]); ++i) {
+		// Accumulated values can cancel each other out, a zero value would
+		// be sent as a stop event
+		if (state->axis[i].pending && state->axis[i].value != 0) {
+			pointer_axis(wlr_seat, state->axis[i].time, i,
+				state->axis[i].value);
+		}
+		if (state->axis[i].stop) {
+			pointer_axis(wlr_seat, state->axis[i].time, i, 0);
+		}
+		state->axis[i].pending = state->axis[i].stop = false;
+		state->axis[i].value = 0;
+	}
+
+	wl_event_source_timer_update(state->flush_timer, 0);
+}
+
+/**
+ * Called before an event is accumulated.
+ */
+static void pointer_schedule_flush(struct wlr_seat *wlr_seat) {
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	if (!pointer_has_accumulated(state)) {
+		wl_event_source_timer_update(state->flush_timer,
+			POINTER_FLUSH_TIMEOUT_MS);
 	}
 }
 
+static int handle_pointer_flush_timer(void *data) {
+	struct wlr_seat *wlr_seat = data;
+	wlr_seat_pointer_flush(wlr_seat);
+	return 0;
+}
+
+void wlr_seat_pointer_send_motion(struct wlr_seat *wlr_seat, uint32_t time,
+		double sx, double sy) {
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	if (state->focused_client == NULL) {
+		return;
+	}
+
+	if (state->frame_mode == WLR_SEAT_POINTER_FRAME_COALESCE) {
+		pointer_schedule_flush(wlr_seat);
+		state->motion_pending = true;
+		state->motion_time = time;
+		state->motion_sx = sx;
+		state->motion_sy = sy;
+		return;
+	}
+
+	pointer_motion(wlr_seat, time, sx, sy);
+	pointer_end_event(wlr_seat);
+}
+
 uint32_t wlr_seat_pointer_send_button(struct wlr_seat *wlr_seat, uint32_t time,
 		uint32_t button, uint32_t state) {
 	struct wlr_seat_client *client = wlr_seat->pointer_state.focused_client;
@@ -632,35 +755,90 @@ uint32_t wlr_seat_pointer_send_button(struct wlr_seat *wlr_seat, uint32_t time,
 		return 0;
 	}
 
+	// The button has been pressed at the last accumulated position
+	pointer_send_accumulated(wlr_seat);
+
 	uint32_t serial = wl_display_next_serial(wlr_seat->display);
 	struct wl_resource *resource;
 	wl_resource_for_each(resource, &client->pointers) {
 		wl_pointer_send_button(resource, serial, time, button, state);
-		pointer_send_frame(resource);
 	}
+	wlr_seat->pointer_state.frame_pending = true;
+	pointer_end_event(wlr_seat);
 	return serial;
 }
 
 void wlr_seat_pointer_send_axis(struct wlr_seat *wlr_seat, uint32_t time,
 		enum wlr_axis_orientation orientation, double value) {
-	struct wlr_seat_client *client = wlr_seat->pointer_state.focused_client;
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	if (state->focused_client == NULL) {
+		return;
+	}
+
+	if (state->frame_mode == WLR_SEAT_POINTER_FRAME_COALESCE) {
+		if (value != 0 && state->axis[orientation].stop) {
+			// Scrolling started again, keep the stop event before
+			pointer_send_accumulated(wlr_seat);
+			wlr_seat_pointer_send_frame(wlr_seat);
+		}
+
+		pointer_schedule_flush(wlr_seat);
+		if (value != 0) {
+			state->axis[orientation].pending = true;
+			state->axis[orientation].value += value;
+		} else {
+			state->axis[orientation].stop = true;
+		}
+		state->axis[orientation].time = time;
+		return;
+	}
+
+	pointer_axis(wlr_seat, time, orientation, value);
+	pointer_end_event(wlr_seat);
+}
+
+void wlr_seat_pointer_send_frame(struct wlr_seat *wlr_seat) {
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	if (!state->frame_pending) {
+		return;
+	}
+	state->frame_pending = false;
+
+	struct wlr_seat_client *client = state->focused_client;
 	if (client == NULL) {
 		return;
 	}
 
 	struct wl_resource *resource;
 	wl_resource_for_each(resource, &client->pointers) {
-		if (value) {
-			wl_pointer_send_axis(resource, time, orientation,
-				wl_fixed_from_double(value));
-		} else if (wl_resource_get_version(resource) >=
-				WL_POINTER_AXIS_STOP_SINCE_VERSION) {
-			wl_pointer_send_axis_stop(resource, time, orientation);
-		}
 		pointer_send_frame(resource);
 	}
 }
 
+void wlr_seat_pointer_flush(struct wlr_seat *wlr_seat) {
+	pointer_send_accumulated(wlr_seat);
+	wlr_seat_pointer_send_frame(wlr_seat);
+}
+
+void wlr_seat_pointer_set_frame_mode(struct wlr_seat *wlr_seat,
+		enum wlr_seat_pointer_frame_mode mode) {
+	struct wlr_seat_pointer_state *state = &wlr_seat->pointer_state;
+	if (mode == WLR_SEAT_POINTER_FRAME_COALESCE && state->flush_timer == NULL) {
+		struct wl_event_loop *loop =
+			wl_display_get_event_loop(wlr_seat->display);
+		state->flush_timer = wl_event_loop_add_timer(loop,
+			handle_pointer_flush_timer, wlr_seat);
+		if (state->flush_timer == NULL) {
+			wlr_log(L_ERROR, "Failed to create pointer flush timer");
+			return;
+		}
+	}
+
+	// Don't leave events of the previous mode behind
+	wlr_seat_pointer_flush(wlr_seat);
+	state->frame_mode = mode;
+}
+
 void wlr_seat_pointer_start_grab(struct wlr_seat *wlr_seat,
 		struct wlr_seat_pointer_grab *grab) {
 	assert(wlr_seat);
@@ -725,6 +903,15 @@ void wlr_seat_pointer_notify_axis(struct wlr_seat *wlr_seat, uint32_t time,
 	grab->interface->axis(grab, time, orientation, value);
 }
 
+void wlr_seat_pointer_notify_frame(struct wlr_seat *wlr_seat) {
+	struct wlr_seat_pointer_grab *grab = wlr_seat->pointer_state.grab;
+	if (grab->interface->frame) {
+		grab->interface->frame(grab);
+	} else {
+		wlr_seat_pointer_send_frame(wlr_seat);
+	}
+}
+
 bool wlr_seat_pointer_has_grab(struct wlr_seat *seat) {
 	return seat->pointer_state.grab->interface != &default_pointer_grab_impl;
 }
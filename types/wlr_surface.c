@@ -3,6 +3,7 @@
 #include <wayland-server.h>
 #include <wlr/render/egl.h>
 #include <wlr/render/interface.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_region.h>
 #include <wlr/types/wlr_surface.h>
@@ -10,6 +11,10 @@
 #include <wlr/util/region.h>
 #include "util/signal.h"
 
+// Policy used to simplify committed damage, see wlr_region_simplify
+#define SURFACE_DAMAGE_MAX_RECTS 32
+#define SURFACE_DAMAGE_MAX_OVERDRAW 1.25f
+
 static void wlr_surface_state_reset_buffer(struct wlr_surface_state *state) {
 	if (state->buffer) {
 		wl_list_remove(&state->buffer_destroy_listener.link);
@@ -274,11 +279,20 @@ static void wlr_surface_move_state(struct wlr_surface *surface,
 		pixman_region32_union(&state->surface_damage, &state->surface_damage,
 			&surface_damage);
 
+		// Clients can send very fragmented damage, eg. one rectangle per
+		// glyph. Every consumer scales with the number of rectangles.
+		wlr_region_simplify(&state->buffer_damage, &state->buffer_damage,
+			SURFACE_DAMAGE_MAX_RECTS, SURFACE_DAMAGE_MAX_OVERDRAW);
+		wlr_region_simplify(&state->surface_damage, &state->surface_damage,
+			SURFACE_DAMAGE_MAX_RECTS, SURFACE_DAMAGE_MAX_OVERDRAW);
+
 		pixman_region32_fini(&buffer_damage);
 		pixman_region32_fini(&surface_damage);
 	}
 	if ((next->invalid & WLR_SURFACE_INVALID_OPAQUE_REGION)) {
-		// TODO: process buffer
+		// The opaque region is already in surface-local coordinates. It isn't
+		// clipped to the surface size here because it must survive resizes.
+		pixman_region32_copy(&state->opaque, &next->opaque);
 		pixman_region32_clear(&next->opaque);
 	}
 	if ((next->invalid & WLR_SURFACE_INVALID_INPUT_REGION)) {
@@ -331,6 +345,65 @@ static void wlr_surface_damage_subsurfaces(struct wlr_subsurface *subsurface) {
 	}
 }
 
+static void surface_release_texture(struct wlr_surface *surface) {
+	if (surface->buffer != NULL) {
+		// The texture is owned by the imported buffer
+		wlr_buffer_unref(surface->buffer);
+		surface->buffer = NULL;
+	} else {
+		wlr_texture_destroy(surface->texture);
+	}
+	surface->texture = NULL;
+}
+
+/**
+ * Uploads the damaged parts of the current shm buffer into the texture and
+ * releases the buffer.
+ */
+static void surface_upload_buffer(struct wlr_surface *surface) {
+	struct wl_resource *resource = surface->current->buffer;
+	if (resource == NULL) {
+		return;
+	}
+	struct wl_shm_buffer *buf = wl_shm_buffer_get(resource);
+	if (buf == NULL) {
+		return;
+	}
+
+	wl_shm_buffer_begin_access(buf);
+
+	enum wl_shm_format fmt = wl_shm_buffer_get_format(buf);
+	int32_t stride = wl_shm_buffer_get_stride(buf);
+	int32_t width = wl_shm_buffer_get_width(buf);
+	int32_t height = wl_shm_buffer_get_height(buf);
+	void *data = wl_shm_buffer_get_data(buf);
+
+	if (surface->texture == NULL) {
+		surface->texture = wlr_texture_from_pixels(surface->renderer, fmt,
+			stride, width, height, data);
+	} else {
+		pixman_region32_intersect_rect(&surface->upload_damage,
+			&surface->upload_damage, 0, 0, width, height);
+
+		int n;
+		pixman_box32_t *rects =
+			pixman_region32_rectangles(&surface->upload_damage, &n);
+		for (int i = 0; i < n; ++i) {
+			pixman_box32_t *r = &rects[i];
+			if (!wlr_texture_write_pixels(surface->texture, fmt, stride,
+					r->x2 - r->x1, r->y2 - r->y1, r->x1, r->y1,
+					r->x1, r->y1, data)) {
+				break;
+			}
+		}
+	}
+
+	wl_shm_buffer_end_access(buf);
+
+	pixman_region32_clear(&surface->upload_damage);
+	wlr_surface_state_release_buffer(surface->current);
+}
+
 static void wlr_surface_apply_damage(struct wlr_surface *surface,
 		bool invalid_buffer, bool reupload_buffer) {
 	struct wl_resource *resource = surface->current->buffer;
@@ -340,55 +413,32 @@ static void wlr_surface_apply_damage(struct wlr_surface *surface,
 
 	struct wl_shm_buffer *buf = wl_shm_buffer_get(resource);
 	if (buf != NULL) {
-		wl_shm_buffer_begin_access(buf);
-
-		enum wl_shm_format fmt = wl_shm_buffer_get_format(buf);
-		int32_t stride = wl_shm_buffer_get_stride(buf);
-		int32_t width = wl_shm_buffer_get_width(buf);
-		int32_t height = wl_shm_buffer_get_height(buf);
-		void *data = wl_shm_buffer_get_data(buf);
-
-		if (surface->texture == NULL || reupload_buffer) {
-			wlr_texture_destroy(surface->texture);
-			surface->texture = wlr_texture_from_pixels(surface->renderer, fmt,
-				stride, width, height, data);
-		} else {
-			pixman_region32_t damage;
-			pixman_region32_init(&damage);
-			pixman_region32_copy(&damage, &surface->current->buffer_damage);
-			pixman_region32_intersect_rect(&damage, &damage, 0, 0,
-				surface->current->buffer_width,
-				surface->current->buffer_height);
-
-			int n;
-			pixman_box32_t *rects = pixman_region32_rectangles(&damage, &n);
-			for (int i = 0; i < n; ++i) {
-				pixman_box32_t *r = &rects[i];
-				if (!wlr_texture_write_pixels(surface->texture, fmt, stride,
-						r->x2 - r->x1, r->y2 - r->y1, r->x1, r->y1,
-						r->x1, r->y1, data)) {
-					break;
-				}
-			}
+		// Imported textures can't be written to, and resized buffers need a
+		// new texture
+		if (surface->buffer != NULL || reupload_buffer) {
+			surface_release_texture(surface);
+		}
 
-			pixman_region32_fini(&damage);
+		// Defer the upload until the texture is used and keep the buffer
+		// until then. If the client commits another buffer in the meantime,
+		// this one is released without ever being uploaded.
+		if (surface->texture != NULL) {
+			pixman_region32_union(&surface->upload_damage,
+				&surface->upload_damage, &surface->current->buffer_damage);
+		} else {
+			pixman_region32_clear(&surface->upload_damage);
 		}
+		return;
+	}
 
-		wl_shm_buffer_end_access(buf);
-	} else if (invalid_buffer || reupload_buffer) {
-		wlr_texture_destroy(surface->texture);
+	if (invalid_buffer || reupload_buffer) {
+		// Drop our reference first, the import stays cached on the buffer if
+		// the client attaches it again
+		surface_release_texture(surface);
 
-		if (wlr_renderer_resource_is_wl_drm_buffer(surface->renderer, resource)) {
-			surface->texture =
-				wlr_texture_from_wl_drm(surface->renderer, resource);
-		} else if (wlr_dmabuf_resource_is_buffer(resource)) {
-			struct wlr_dmabuf_buffer *dmabuf =
-				wlr_dmabuf_buffer_from_buffer_resource(resource);
-			surface->texture =
-				wlr_texture_from_dmabuf(surface->renderer, &dmabuf->attributes);
-		} else {
-			surface->texture = NULL;
-			wlr_log(L_ERROR, "Unknown buffer handle attached");
+		surface->buffer = wlr_buffer_get(surface->renderer, resource);
+		if (surface->buffer != NULL) {
+			surface->texture = surface->buffer->texture;
 		}
 	}
 
@@ -405,8 +455,7 @@ static void wlr_surface_commit_pending(struct wlr_surface *surface) {
 	wlr_surface_move_state(surface, surface->pending, surface->current);
 
 	if (null_buffer_commit) {
-		wlr_texture_destroy(surface->texture);
-		surface->texture = NULL;
+		surface_release_texture(surface);
 	}
 
 	bool reupload_buffer = oldw != surface->current->buffer_width ||
@@ -626,7 +675,10 @@ static void destroy_surface(struct wl_resource *resource) {
 		wlr_subsurface_destroy(surface->subsurface);
 	}
 
-	wlr_texture_destroy(surface->texture);
+	surface_release_texture(surface);
+	pixman_region32_fini(&surface->upload_damage);
+	// Give back a buffer that was never uploaded
+	wlr_surface_state_release_buffer(surface->current);
 	wlr_surface_state_destroy(surface->pending);
 	wlr_surface_state_destroy(surface->current);
 
@@ -646,6 +698,7 @@ struct wlr_surface *wlr_surface_create(struct wl_resource *res,
 
 	surface->current = wlr_surface_state_create();
 	surface->pending = wlr_surface_state_create();
+	pixman_region32_init(&surface->upload_damage);
 
 	wl_signal_init(&surface->events.commit);
 	wl_signal_init(&surface->events.destroy);
@@ -658,7 +711,17 @@ struct wlr_surface *wlr_surface_create(struct wl_resource *res,
 }
 
 bool wlr_surface_has_buffer(struct wlr_surface *surface) {
-	return surface->texture != NULL;
+	if (surface->texture != NULL) {
+		return true;
+	}
+	// The upload of the current shm buffer may still be pending
+	struct wl_resource *buffer = surface->current->buffer;
+	return buffer != NULL && wl_shm_buffer_get(buffer) != NULL;
+}
+
+struct wlr_texture *wlr_surface_get_texture(struct wlr_surface *surface) {
+	surface_upload_buffer(surface);
+	return surface->texture;
 }
 
 int wlr_surface_set_role(struct wlr_surface *surface, const char *role,
@@ -0,0 +1,84 @@
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <wlr/util/arena.h>
+
+#define ARENA_MIN_CHUNK_SIZE 4096
+
+struct wlr_arena_chunk {
+	struct wlr_arena_chunk *prev;
+	size_t size;
+	max_align_t data[];
+};
+
+static struct wlr_arena_chunk *chunk_create(struct wlr_arena_chunk *prev,
+		size_t size) {
+	struct wlr_arena_chunk *chunk =
+		malloc(sizeof(struct wlr_arena_chunk) + size);
+	if (chunk == NULL) {
+		return NULL;
+	}
+	chunk->prev = prev;
+	chunk->size = size;
+	return chunk;
+}
+
+static void chunks_destroy(struct wlr_arena_chunk *chunk) {
+	while (chunk != NULL) {
+		struct wlr_arena_chunk *prev = chunk->prev;
+		free(chunk);
+		chunk = prev;
+	}
+}
+
+void wlr_arena_init(struct wlr_arena *arena) {
+	arena->chunk = NULL;
+	arena->used = 0;
+	arena->allocated = 0;
+}
+
+void wlr_arena_finish(struct wlr_arena *arena) {
+	chunks_destroy(arena->chunk);
+	wlr_arena_init(arena);
+}
+
+void *wlr_arena_alloc(struct wlr_arena *arena, size_t size) {
+	size_t align = alignof(max_align_t);
+	size = (size + align - 1) / align * align;
+
+	if (arena->chunk == NULL || size > arena->chunk->size - arena->used) {
+		size_t chunk_size = ARENA_MIN_CHUNK_SIZE;
+		if (arena->chunk != NULL && chunk_size < 2 * arena->chunk->size) {
+			chunk_size = 2 * arena->chunk->size;
+		}
+		if (chunk_size < size) {
+			chunk_size = size;
+		}
+
+		struct wlr_arena_chunk *chunk = chunk_create(arena->chunk, chunk_size);
+		if (chunk == NULL) {
+			return NULL;
+		}
+		arena->chunk = chunk;
+		arena->used = 0;
+	}
+
+	void *ptr = (char *)arena->chunk->data + arena->used;
+	arena->used += size;
+	arena->allocated += size;
+	return ptr;
+}
+
+void wlr_arena_reset(struct wlr_arena *arena) {
+	if (arena->chunk != NULL && arena->chunk->prev != NULL) {
+		// The previous allocations didn't fit in a single chunk, replace the
+		// chunks with one that does
+		size_t size = arena->allocated;
+		chunks_destroy(arena->chunk);
+		// If this fails, the next allocation will try again
+		arena->chunk = chunk_create(NULL, size);
+	}
+
+	arena->used = 0;
+	arena->allocated = 0;
+}
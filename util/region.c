@@ -1,7 +1,48 @@
 #include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <wlr/util/arena.h>
 #include <wlr/util/region.h>
 
+// Most regions only have a handful of rectangles: use a buffer on the stack
+// for those and only fall back to `arena`, or the heap if it's NULL, for
+// larger ones
+#define REGION_STACK_RECTS 64
+
+static pixman_box32_t *region_rects_alloc(pixman_box32_t *stack, int nrects,
+		struct wlr_arena *arena) {
+	if (nrects <= REGION_STACK_RECTS) {
+		return stack;
+	}
+	size_t size = nrects * sizeof(pixman_box32_t);
+	if (arena != NULL) {
+		return wlr_arena_alloc(arena, size);
+	}
+	return malloc(size);
+}
+
+static void region_rects_finish(pixman_region32_t *dst, pixman_box32_t *rects,
+		int nrects, pixman_box32_t *stack, struct wlr_arena *arena) {
+	pixman_region32_fini(dst);
+	pixman_region32_init_rects(dst, rects, nrects);
+	if (rects != stack && arena == NULL) {
+		free(rects);
+	}
+}
+
+// Branchless floor and ceil, so that the loops below can be vectorized
+static inline int32_t floor_i32(float f) {
+	int32_t i = (int32_t)f;
+	return i - (f < i);
+}
+
+static inline int32_t ceil_i32(float f) {
+	int32_t i = (int32_t)f;
+	return i + (f > i);
+}
+
 void wlr_region_scale(pixman_region32_t *dst, pixman_region32_t *src,
 		float scale) {
 	if (scale == 1) {
@@ -11,26 +52,56 @@ void wlr_region_scale(pixman_region32_t *dst, pixman_region32_t *src,
 
 	int nrects;
 	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
+	if (nrects <= 1) {
+		pixman_box32_t *e = pixman_region32_extents(src);
+		int32_t x1 = floor_i32(e->x1 * scale), y1 = floor_i32(e->y1 * scale);
+		int32_t x2 = ceil_i32(e->x2 * scale), y2 = ceil_i32(e->y2 * scale);
+		pixman_region32_fini(dst);
+		pixman_region32_init_rect(dst, x1, y1, x2 - x1, y2 - y1);
+		return;
+	}
 
-	pixman_box32_t *dst_rects = malloc(nrects * sizeof(pixman_box32_t));
+	pixman_box32_t stack[REGION_STACK_RECTS];
+	pixman_box32_t *dst_rects = region_rects_alloc(stack, nrects, NULL);
 	if (dst_rects == NULL) {
 		return;
 	}
 
 	for (int i = 0; i < nrects; ++i) {
-		dst_rects[i].x1 = floor(src_rects[i].x1 * scale);
-		dst_rects[i].x2 = ceil(src_rects[i].x2 * scale);
-		dst_rects[i].y1 = floor(src_rects[i].y1 * scale);
-		dst_rects[i].y2 = ceil(src_rects[i].y2 * scale);
+		dst_rects[i].x1 = floor_i32(src_rects[i].x1 * scale);
+		dst_rects[i].x2 = ceil_i32(src_rects[i].x2 * scale);
+		dst_rects[i].y1 = floor_i32(src_rects[i].y1 * scale);
+		dst_rects[i].y2 = ceil_i32(src_rects[i].y2 * scale);
 	}
 
-	pixman_region32_fini(dst);
-	pixman_region32_init_rects(dst, dst_rects, nrects);
-	free(dst_rects);
+	region_rects_finish(dst, dst_rects, nrects, stack, NULL);
 }
 
-void wlr_region_transform(pixman_region32_t *dst, pixman_region32_t *src,
-		enum wl_output_transform transform, int width, int height) {
+/**
+ * Every transform is a combination of swapping the axes then flipping them.
+ * `width` and `height` are the size of the box after the swap. Callers pass
+ * constants for the flags, so that each transform gets its own loop without
+ * any branch in it.
+ */
+static inline void transform_rects(pixman_box32_t *restrict dst,
+		const pixman_box32_t *restrict src, int nrects, bool swap,
+		bool flip_x, bool flip_y, int32_t width, int32_t height) {
+	for (int i = 0; i < nrects; ++i) {
+		int32_t x1 = swap ? src[i].y1 : src[i].x1;
+		int32_t y1 = swap ? src[i].x1 : src[i].y1;
+		int32_t x2 = swap ? src[i].y2 : src[i].x2;
+		int32_t y2 = swap ? src[i].x2 : src[i].y2;
+
+		dst[i].x1 = flip_x ? width - x2 : x1;
+		dst[i].y1 = flip_y ? height - y2 : y1;
+		dst[i].x2 = flip_x ? width - x1 : x2;
+		dst[i].y2 = flip_y ? height - y1 : y2;
+	}
+}
+
+static void region_transform(pixman_region32_t *dst, pixman_region32_t *src,
+		enum wl_output_transform transform, int width, int height,
+		struct wlr_arena *arena) {
 	if (transform == WL_OUTPUT_TRANSFORM_NORMAL) {
 		pixman_region32_copy(dst, src);
 		return;
@@ -39,67 +110,58 @@ void wlr_region_transform(pixman_region32_t *dst, pixman_region32_t *src,
 	int nrects;
 	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
 
-	pixman_box32_t *dst_rects = malloc(nrects * sizeof(pixman_box32_t));
+	pixman_box32_t stack[REGION_STACK_RECTS];
+	pixman_box32_t *dst_rects = region_rects_alloc(stack, nrects, arena);
 	if (dst_rects == NULL) {
 		return;
 	}
 
-	for (int i = 0; i < nrects; ++i) {
-		switch (transform) {
-		case WL_OUTPUT_TRANSFORM_NORMAL:
-			dst_rects[i].x1 = src_rects[i].x1;
-			dst_rects[i].y1 = src_rects[i].y1;
-			dst_rects[i].x2 = src_rects[i].x2;
-			dst_rects[i].y2 = src_rects[i].y2;
-			break;
-		case WL_OUTPUT_TRANSFORM_90:
-			dst_rects[i].x1 = src_rects[i].y1;
-			dst_rects[i].y1 = width - src_rects[i].x2;
-			dst_rects[i].x2 = src_rects[i].y2;
-			dst_rects[i].y2 = width - src_rects[i].x1;
-			break;
-		case WL_OUTPUT_TRANSFORM_180:
-			dst_rects[i].x1 = width - src_rects[i].x2;
-			dst_rects[i].y1 = height - src_rects[i].y2;
-			dst_rects[i].x2 = width - src_rects[i].x1;
-			dst_rects[i].y2 = height - src_rects[i].y1;
-			break;
-		case WL_OUTPUT_TRANSFORM_270:
-			dst_rects[i].x1 = height - src_rects[i].y2;
-			dst_rects[i].y1 = src_rects[i].x1;
-			dst_rects[i].x2 = height - src_rects[i].y1;
-			dst_rects[i].y2 = src_rects[i].x2;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED:
-			dst_rects[i].x1 = width - src_rects[i].x2;
-			dst_rects[i].y1 = src_rects[i].y1;
-			dst_rects[i].x2 = width - src_rects[i].x1;
-			dst_rects[i].y2 = src_rects[i].y2;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED_90:
-			dst_rects[i].x1 = height - src_rects[i].y2;
-			dst_rects[i].y1 = width - src_rects[i].x2;
-			dst_rects[i].x2 = height - src_rects[i].y1;
-			dst_rects[i].y2 = width - src_rects[i].x1;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED_180:
-			dst_rects[i].x1 = src_rects[i].x1;
-			dst_rects[i].y1 = height - src_rects[i].y2;
-			dst_rects[i].x2 = src_rects[i].x2;
-			dst_rects[i].y2 = height - src_rects[i].y1;
-			break;
-		case WL_OUTPUT_TRANSFORM_FLIPPED_270:
-			dst_rects[i].x1 = src_rects[i].y1;
-			dst_rects[i].y1 = src_rects[i].x1;
-			dst_rects[i].x2 = src_rects[i].y2;
-			dst_rects[i].y2 = src_rects[i].x2;
-			break;
-		}
+	switch (transform) {
+	case WL_OUTPUT_TRANSFORM_NORMAL:
+		memcpy(dst_rects, src_rects, nrects * sizeof(pixman_box32_t));
+		break;
+	case WL_OUTPUT_TRANSFORM_90:
+		transform_rects(dst_rects, src_rects, nrects, true, false, true,
+			height, width);
+		break;
+	case WL_OUTPUT_TRANSFORM_180:
+		transform_rects(dst_rects, src_rects, nrects, false, true, true,
+			width, height);
+		break;
+	case WL_OUTPUT_TRANSFORM_270:
+		transform_rects(dst_rects, src_rects, nrects, true, true, false,
+			height, width);
+		break;
+	case WL_OUTPUT_TRANSFORM_FLIPPED:
+		transform_rects(dst_rects, src_rects, nrects, false, true, false,
+			width, height);
+		break;
+	case WL_OUTPUT_TRANSFORM_FLIPPED_90:
+		transform_rects(dst_rects, src_rects, nrects, true, true, true,
+			height, width);
+		break;
+	case WL_OUTPUT_TRANSFORM_FLIPPED_180:
+		transform_rects(dst_rects, src_rects, nrects, false, false, true,
+			width, height);
+		break;
+	case WL_OUTPUT_TRANSFORM_FLIPPED_270:
+		transform_rects(dst_rects, src_rects, nrects, true, false, false,
+			height, width);
+		break;
 	}
 
-	pixman_region32_fini(dst);
-	pixman_region32_init_rects(dst, dst_rects, nrects);
-	free(dst_rects);
+	region_rects_finish(dst, dst_rects, nrects, stack, arena);
+}
+
+void wlr_region_transform(pixman_region32_t *dst, pixman_region32_t *src,
+		enum wl_output_transform transform, int width, int height) {
+	region_transform(dst, src, transform, width, height, NULL);
+}
+
+void wlr_region_transform_arena(pixman_region32_t *dst,
+		pixman_region32_t *src, enum wl_output_transform transform,
+		int width, int height, struct wlr_arena *arena) {
+	region_transform(dst, src, transform, width, height, arena);
 }
 
 void wlr_region_expand(pixman_region32_t *dst, pixman_region32_t *src,
@@ -112,21 +174,28 @@ void wlr_region_expand(pixman_region32_t *dst, pixman_region32_t *src,
 	int nrects;
 	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
 
-	pixman_box32_t *dst_rects = malloc(nrects * sizeof(pixman_box32_t));
+	pixman_box32_t stack[REGION_STACK_RECTS];
+	pixman_box32_t *dst_rects = region_rects_alloc(stack, nrects, NULL);
 	if (dst_rects == NULL) {
 		return;
 	}
 
+	int n = 0;
 	for (int i = 0; i < nrects; ++i) {
-		dst_rects[i].x1 = src_rects[i].x1 - distance;
-		dst_rects[i].x2 = src_rects[i].x2 + distance;
-		dst_rects[i].y1 = src_rects[i].y1 - distance;
-		dst_rects[i].y2 = src_rects[i].y2 + distance;
+		pixman_box32_t box = {
+			.x1 = src_rects[i].x1 - distance,
+			.x2 = src_rects[i].x2 + distance,
+			.y1 = src_rects[i].y1 - distance,
+			.y2 = src_rects[i].y2 + distance,
+		};
+		// Shrinking drops the rectangles that aren't large enough
+		if (box.x1 >= box.x2 || box.y1 >= box.y2) {
+			continue;
+		}
+		dst_rects[n++] = box;
 	}
 
-	pixman_region32_fini(dst);
-	pixman_region32_init_rects(dst, dst_rects, nrects);
-	free(dst_rects);
+	region_rects_finish(dst, dst_rects, n, stack, NULL);
 }
 
 void wlr_region_rotated_bounds(pixman_region32_t *dst, pixman_region32_t *src,
@@ -139,28 +208,30 @@ void wlr_region_rotated_bounds(pixman_region32_t *dst, pixman_region32_t *src,
 	int nrects;
 	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
 
-	pixman_box32_t *dst_rects = malloc(nrects * sizeof(pixman_box32_t));
+	pixman_box32_t stack[REGION_STACK_RECTS];
+	pixman_box32_t *dst_rects = region_rects_alloc(stack, nrects, NULL);
 	if (dst_rects == NULL) {
 		return;
 	}
 
+	double c = cos(rotation), s = sin(rotation);
 	for (int i = 0; i < nrects; ++i) {
 		double x1 = src_rects[i].x1 - ox;
 		double y1 = src_rects[i].y1 - oy;
 		double x2 = src_rects[i].x2 - ox;
 		double y2 = src_rects[i].y2 - oy;
 
-		double rx1 = x1 * cos(rotation) - y1 * sin(rotation);
-		double ry1 = x1 * sin(rotation) + y1 * cos(rotation);
+		double rx1 = x1 * c - y1 * s;
+		double ry1 = x1 * s + y1 * c;
 
-		double rx2 = x2 * cos(rotation) - y1 * sin(rotation);
-		double ry2 = x2 * sin(rotation) + y1 * cos(rotation);
+		double rx2 = x2 * c - y1 * s;
+		double ry2 = x2 * s + y1 * c;
 
-		double rx3 = x2 * cos(rotation) - y2 * sin(rotation);
-		double ry3 = x2 * sin(rotation) + y2 * cos(rotation);
+		double rx3 = x2 * c - y2 * s;
+		double ry3 = x2 * s + y2 * c;
 
-		double rx4 = x1 * cos(rotation) - y2 * sin(rotation);
-		double ry4 = x1 * sin(rotation) + y2 * cos(rotation);
+		double rx4 = x1 * c - y2 * s;
+		double ry4 = x1 * s + y2 * c;
 
 		x1 = fmin(fmin(rx1, rx2), fmin(rx3, rx4));
 		y1 = fmin(fmin(ry1, ry2), fmin(ry3, ry4));
@@ -173,7 +244,88 @@ void wlr_region_rotated_bounds(pixman_region32_t *dst, pixman_region32_t *src,
 		dst_rects[i].y2 = ceil(oy + y2);
 	}
 
-	pixman_region32_fini(dst);
-	pixman_region32_init_rects(dst, dst_rects, nrects);
-	free(dst_rects);
+	region_rects_finish(dst, dst_rects, nrects, stack, NULL);
+}
+
+static int64_t box_area(const pixman_box32_t *box) {
+	return (int64_t)(box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static void box_union(pixman_box32_t *dst, const pixman_box32_t *a,
+		const pixman_box32_t *b) {
+	dst->x1 = a->x1 < b->x1 ? a->x1 : b->x1;
+	dst->y1 = a->y1 < b->y1 ? a->y1 : b->y1;
+	dst->x2 = a->x2 > b->x2 ? a->x2 : b->x2;
+	dst->y2 = a->y2 > b->y2 ? a->y2 : b->y2;
+}
+
+void wlr_region_simplify(pixman_region32_t *dst, pixman_region32_t *src,
+		int max_rects, float max_overdraw) {
+	int nrects;
+	pixman_box32_t *src_rects = pixman_region32_rectangles(src, &nrects);
+	if (nrects <= 1) {
+		pixman_region32_copy(dst, src);
+		return;
+	}
+
+	// A single rectangle is the cheapest to process, use the bounding box if
+	// it doesn't add too much area
+	int64_t area = 0;
+	for (int i = 0; i < nrects; ++i) {
+		area += box_area(&src_rects[i]);
+	}
+	pixman_box32_t extents = *pixman_region32_extents(src);
+	if (box_area(&extents) <= max_overdraw * area) {
+		pixman_region32_fini(dst);
+		pixman_region32_init_rect(dst, extents.x1, extents.y1,
+			extents.x2 - extents.x1, extents.y2 - extents.y1);
+		return;
+	}
+
+	if (max_rects <= 0 || nrects <= max_rects) {
+		pixman_region32_copy(dst, src);
+		return;
+	}
+
+	pixman_box32_t stack[REGION_STACK_RECTS];
+	pixman_box32_t *dst_rects = region_rects_alloc(stack, nrects, NULL);
+	if (dst_rects == NULL) {
+		pixman_region32_copy(dst, src);
+		return;
+	}
+
+	// Rectangles are sorted in bands of the same height, sorted from left to
+	// right. Collapse each band into a single rectangle.
+	int n = 0;
+	for (int i = 0; i < nrects; ++i) {
+		if (n > 0 && dst_rects[n - 1].y1 == src_rects[i].y1) {
+			dst_rects[n - 1].x2 = src_rects[i].x2;
+		} else {
+			dst_rects[n++] = src_rects[i];
+		}
+	}
+
+	// Merge the neighbouring bands that add the least area. Bands don't
+	// overlap vertically, so merged bands don't overlap either.
+	while (n > max_rects) {
+		int best = 0;
+		int64_t best_cost = INT64_MAX;
+		for (int i = 0; i + 1 < n; ++i) {
+			pixman_box32_t merged;
+			box_union(&merged, &dst_rects[i], &dst_rects[i + 1]);
+			int64_t cost = box_area(&merged) - box_area(&dst_rects[i]) -
+				box_area(&dst_rects[i + 1]);
+			if (cost < best_cost) {
+				best = i;
+				best_cost = cost;
+			}
+		}
+
+		box_union(&dst_rects[best], &dst_rects[best], &dst_rects[best + 1]);
+		memmove(&dst_rects[best + 1], &dst_rects[best + 2],
+			(n - best - 2) * sizeof(pixman_box32_t));
+		--n;
+	}
+
+	region_rects_finish(dst, dst_rects, n, stack, NULL);
 }